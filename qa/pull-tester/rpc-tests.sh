@@ -77,6 +77,12 @@ testScripts=(
   'cbh_rpfix.py'
   'cbh_rpcheck.py'
   'tlsprotocols.py'
+  'compactblocks.py'
+  'feefilter.py'
+  'wallet_rescan.py'
+  'wallet_unspentindex.py'
+  'addressindex.py'
+  'blockfilter.py'
 );
 testScriptsExt=(
   'getblocktemplate_longpoll.py'
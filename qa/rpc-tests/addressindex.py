@@ -0,0 +1,102 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the address and spent indexes: the balance, unspent outputs, txids
+# and deltas of an address, its mempool deltas and the spender of an output
+# are answered from the indexes, and follow blocks being disconnected.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks, sync_mempools
+
+from decimal import Decimal
+
+class AddressIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        # Node 0 mines, node 1 keeps the indexes
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-addressindex", "-spentindex"]))
+        connect_nodes(self.nodes[1], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        [miner, indexer] = self.nodes
+
+        print "Mining blocks..."
+        miner.generate(101)
+        self.sync_all()
+
+        addr = miner.getnewaddress()
+        query = {"addresses": [addr]}
+        assert_equal(indexer.getaddressbalance(query), {"balance": 0, "received": 0})
+
+        print "Paying to %s..." % addr
+        txid1 = miner.sendtoaddress(addr, Decimal('2.5'))
+        txid2 = miner.sendtoaddress(addr, Decimal('1.5'))
+        sync_mempools(self.nodes)
+
+        mempool = indexer.getaddressmempool(query)
+        assert_equal(sorted([delta['txid'] for delta in mempool]), sorted([txid1, txid2]))
+        assert_equal(sum([delta['satoshis'] for delta in mempool]), 400000000)
+
+        miner.generate(1)
+        self.sync_all()
+        height = indexer.getblockcount()
+        assert_equal(indexer.getaddressmempool(query), [])
+        assert_equal(indexer.getaddressbalance(query), {"balance": 400000000, "received": 400000000})
+        assert_equal(sorted(indexer.getaddresstxids(query)), sorted([txid1, txid2]))
+
+        utxos = indexer.getaddressutxos(query)
+        assert_equal(len(utxos), 2)
+        for utxo in utxos:
+            assert_equal(utxo['address'], addr)
+            assert_equal(utxo['height'], height)
+
+        print "Spending from %s..." % addr
+        utxo = [u for u in utxos if u['satoshis'] == 250000000][0]
+        rawtx = miner.createrawtransaction([{"txid": utxo['txid'], "vout": utxo['outputIndex']}],
+                                           {miner.getnewaddress(): Decimal('2.4999')})
+        txid3 = miner.sendrawtransaction(miner.signrawtransaction(rawtx)['hex'])
+        sync_mempools(self.nodes)
+
+        spent = indexer.getspentinfo({"txid": utxo['txid'], "index": utxo['outputIndex']})
+        assert_equal(spent, {"txid": txid3, "index": 0, "height": -1})
+        mempool = indexer.getaddressmempool(query)
+        assert_equal(len(mempool), 1)
+        assert_equal(mempool[0]['satoshis'], -250000000)
+        assert_equal(mempool[0]['prevtxid'], utxo['txid'])
+
+        miner.generate(1)
+        self.sync_all()
+        assert_equal(indexer.getspentinfo({"txid": utxo['txid'], "index": utxo['outputIndex']})['height'], height + 1)
+        assert_equal(indexer.getaddressbalance(query), {"balance": 150000000, "received": 400000000})
+        assert_equal(len(indexer.getaddressutxos(query)), 1)
+        assert_equal(indexer.getaddresstxids(query)[-1], txid3)
+        assert_equal(indexer.getaddresstxids({"addresses": [addr], "start": height + 1, "end": height + 1}), [txid3])
+
+        deltas = indexer.getaddressdeltas(query)
+        assert_equal([delta['satoshis'] for delta in deltas if delta['txid'] == txid3], [-250000000])
+        assert_equal(sum([delta['satoshis'] for delta in deltas]), 150000000)
+
+        print "Disconnecting the spending block..."
+        indexer.invalidateblock(indexer.getbestblockhash())
+        assert_equal(indexer.getaddressbalance(query), {"balance": 400000000, "received": 400000000})
+        assert_equal(len(indexer.getaddressutxos(query)), 2)
+        # The spending transaction is back in the mempool
+        assert_equal(indexer.getspentinfo({"txid": utxo['txid'], "index": utxo['outputIndex']})['height'], -1)
+        assert_true(txid3 not in indexer.getaddresstxids(query))
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the block filter index: the compact filter (BIP 158) of every block
+# is returned by getblockfilter, and the filter headers chain from the
+# genesis block on, including across a reorganization.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks
+
+import hashlib
+
+def dsha256(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+def filter_header(filter_hex, prev_header_hex):
+    # Headers are shown as uint256 hex, that is byte reversed
+    prev_header = prev_header_hex.decode('hex')[::-1]
+    return dsha256(dsha256(filter_hex.decode('hex')) + prev_header)[::-1].encode('hex')
+
+class BlockFilterTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self, split=False):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-blockfilterindex", "-peerbloomfilters=0"]))
+        if not split:
+            connect_nodes(self.nodes[1], 0)
+        self.is_network_split = split
+        self.sync_all()
+
+    def check_header_chain(self, node):
+        prev_header = "00" * 32
+        for height in range(node.getblockcount() + 1):
+            result = node.getblockfilter(node.getblockhash(height))
+            assert_equal(result['header'], filter_header(result['filter'], prev_header))
+            prev_header = result['header']
+
+    def run_test(self):
+        [miner, indexer] = self.nodes
+
+        print "Mining blocks..."
+        miner.generate(101)
+        self.sync_all()
+        miner.sendtoaddress(indexer.getnewaddress(), 1)
+        miner.generate(1)
+        self.sync_all()
+
+        print "Checking the filter headers..."
+        self.check_header_chain(indexer)
+        # The filter of a block holding only a coinbase is not empty
+        assert_true(len(indexer.getblockfilter(indexer.getblockhash(1))['filter']) > 2)
+
+        try:
+            indexer.getblockfilter(indexer.getbestblockhash(), "extended")
+            assert(False)
+        except JSONRPCException as e:
+            assert_equal(e.error['message'], "Unknown filtertype")
+
+        try:
+            miner.getblockfilter(miner.getbestblockhash())
+            assert(False)
+        except JSONRPCException as e:
+            assert_true("not enabled" in e.error['message'])
+
+        print "Reorganizing the chain..."
+        stale = indexer.getbestblockhash()
+        stale_filter = indexer.getblockfilter(stale)
+        miner.invalidateblock(stale)
+        miner.generate(3)
+        sync_blocks(self.nodes)
+        assert_true(indexer.getbestblockhash() != stale)
+        self.check_header_chain(indexer)
+
+        # The filter of the stale block is still served
+        assert_equal(indexer.getblockfilter(stale), stale_filter)
+
+if __name__ == '__main__':
+    BlockFilterTest().main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay: a peer that understands compact blocks receives
+# new blocks as short transaction IDs and rebuilds them from its mempool,
+# which takes far fewer bytes on the wire than the full block sent to a peer
+# running with -compactblocks=0.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks, sync_mempools
+
+import time
+
+NUMB_OF_TXS = 50
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.nodes = []
+        # Node 0 mines, node 1 relays compact blocks, node 2 does not
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(2, self.options.tmpdir, ["-debug=cmpctblock", "-compactblocks=0"]))
+        connect_nodes(self.nodes[1], 0)
+        connect_nodes(self.nodes[2], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def bytes_from_miner(self, node):
+        peers = node.getpeerinfo()
+        assert_equal(len(peers), 1)
+        return peers[0]['bytesrecv']
+
+    def relay_block(self, nTxs):
+        for i in range(nTxs):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 0.1)
+        sync_mempools(self.nodes)
+
+        before = [self.bytes_from_miner(self.nodes[1]), self.bytes_from_miner(self.nodes[2])]
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+        # let the last messages be accounted for
+        time.sleep(1)
+        after = [self.bytes_from_miner(self.nodes[1]), self.bytes_from_miner(self.nodes[2])]
+        return [after[0] - before[0], after[1] - before[1]]
+
+    def run_test(self):
+        print "Checking compact block negotiation..."
+        assert_true(self.nodes[1].getpeerinfo()[0]['compactblocks'])
+        assert_true(not self.nodes[2].getpeerinfo()[0]['compactblocks'])
+
+        print "Mining blocks..."
+        self.nodes[0].generate(NUMB_OF_TXS + 101)
+        self.sync_all()
+
+        print "Relaying a block of %d transactions..." % NUMB_OF_TXS
+        delta = self.relay_block(NUMB_OF_TXS)
+        print "Bytes received: compact %d, full %d" % (delta[0], delta[1])
+        assert_true(delta[0] * 2 < delta[1])
+
+        # Having delivered a new tip, node 0 is asked to push the next ones right away
+        peers = self.nodes[0].getpeerinfo()
+        assert_equal(len([p for p in peers if p['compactblocks']]), 1)
+        assert_equal(len([p for p in peers if p['compactblocks_hb']]), 1)
+
+        print "Relaying a block in high-bandwidth mode..."
+        delta = self.relay_block(NUMB_OF_TXS)
+        print "Bytes received: compact %d, full %d" % (delta[0], delta[1])
+        assert_true(delta[0] * 2 < delta[1])
+
+        print "Relaying a block with transactions missing from the mempool..."
+        for i in range(5):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 0.1)
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+        for node in self.nodes[1:]:
+            assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+            assert_equal(node.getmempoolinfo()['size'], 0)
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
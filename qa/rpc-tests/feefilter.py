@@ -0,0 +1,71 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the feefilter and sendheaders messages: a node that does not accept
+# free transactions tells its peers so, and is no longer sent them, while
+# new blocks keep propagating when announced with headers.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks
+
+from decimal import Decimal
+import time
+
+class FeeFilterTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=net"]))
+        # Node 1 only accepts transactions paying at least the relay fee
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=net", "-limitfreerelay=0"]))
+        connect_nodes(self.nodes[1], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def wait_for(self, predicate, timeout=30):
+        for i in range(timeout * 2):
+            if predicate():
+                return True
+            time.sleep(0.5)
+        return False
+
+    def run_test(self):
+        print "Mining blocks..."
+        self.nodes[0].generate(101)
+        self.sync_all()
+
+        print "Checking the fee filters exchanged..."
+        relayfee = self.nodes[1].getnetworkinfo()['relayfee']
+        assert_true(self.wait_for(lambda: self.nodes[0].getpeerinfo()[0]['minfeefilter'] == relayfee))
+        assert_equal(self.nodes[1].getpeerinfo()[0]['minfeefilter'], Decimal('0'))
+
+        print "Relaying a free and a paying transaction..."
+        utxo = self.nodes[0].listunspent()[0]
+        rawtx = self.nodes[0].createrawtransaction([{"txid": utxo['txid'], "vout": utxo['vout']}],
+                                                   {self.nodes[0].getnewaddress(): utxo['amount']})
+        txid_free = self.nodes[0].sendrawtransaction(self.nodes[0].signrawtransaction(rawtx)['hex'])
+        txid_paid = self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        assert_true(txid_free in self.nodes[0].getrawmempool())
+
+        assert_true(self.wait_for(lambda: txid_paid in self.nodes[1].getrawmempool()))
+        time.sleep(2)
+        assert_true(txid_free not in self.nodes[1].getrawmempool())
+
+        print "Announcing a new block..."
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].getbestblockhash(), self.nodes[0].getbestblockhash())
+        assert_equal(self.nodes[1].getrawmempool(), [])
+
+if __name__ == '__main__':
+    FeeFilterTest().main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test a wallet rescan spanning several batches of blocks: outputs paying to
+# an imported key are found, and so are the later transactions spending them,
+# while the node keeps following the chain.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks
+
+from decimal import Decimal
+
+# Blocks between the payments, more than a rescan batch
+BLOCKS_BETWEEN_TXS = 70
+
+class WalletRescanTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.nodes = []
+        for i in range(3):
+            self.nodes.append(start_node(i, self.options.tmpdir))
+        connect_nodes(self.nodes[1], 0)
+        connect_nodes(self.nodes[2], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def utxo_amounts(self, node, addr):
+        return sorted([utxo['amount'] for utxo in node.listunspent(1, 10**9, [addr])])
+
+    def run_test(self):
+        [miner, owner, importer] = self.nodes
+
+        print "Mining blocks..."
+        miner.generate(101)
+        self.sync_all()
+
+        addr = owner.getnewaddress()
+        print "Paying to %s across several batches..." % addr
+        for amount in ['2.5', '1.5', '4.0']:
+            miner.sendtoaddress(addr, Decimal(amount))
+            self.sync_all()
+            miner.generate(BLOCKS_BETWEEN_TXS)
+            self.sync_all()
+
+        # Spending from the key in a later batch needs the outputs found earlier
+        owner.sendtoaddress(miner.getnewaddress(), Decimal('3.0'))
+        self.sync_all()
+        miner.generate(BLOCKS_BETWEEN_TXS)
+        self.sync_all()
+        assert_true(sum(self.utxo_amounts(owner, addr)) < Decimal('8.0'))
+
+        print "Importing the key..."
+        importer.importprivkey(owner.dumpprivkey(addr))
+        assert_equal(self.utxo_amounts(importer, addr), self.utxo_amounts(owner, addr))
+
+        print "Following the chain after the rescan..."
+        miner.sendtoaddress(addr, Decimal('0.5'))
+        self.sync_all()
+        miner.generate(1)
+        sync_blocks(self.nodes)
+        assert_equal(importer.getbestblockhash(), miner.getbestblockhash())
+        assert_true(Decimal('0.5') in self.utxo_amounts(importer, addr))
+        assert_equal(self.utxo_amounts(importer, addr), self.utxo_amounts(owner, addr))
+
+if __name__ == '__main__':
+    WalletRescanTest().main()
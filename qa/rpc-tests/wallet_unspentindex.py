@@ -0,0 +1,151 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the balances and unspent outputs and notes that the wallet answers
+# from its index of transactions holding unspent outputs: after spends are
+# mined, after the spending block is disconnected and connected again, after
+# keys and watch-only addresses are imported without a rescan, and after a
+# rescan.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, \
+    start_node, connect_nodes, sync_blocks, sync_mempools, \
+    wait_and_assert_operationid_status
+
+from decimal import Decimal
+
+FEE = Decimal('0.0001')
+
+class WalletUnspentIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.nodes = []
+        for i in range(3):
+            self.nodes.append(start_node(i, self.options.tmpdir))
+        connect_nodes(self.nodes[1], 0)
+        connect_nodes(self.nodes[2], 0)
+
+        self.is_network_split = False
+        self.sync_all()
+
+    def utxo_amounts(self, node, addrs, minconf=1):
+        return sorted([(utxo['txid'], utxo['amount'], utxo['spendable'])
+                       for utxo in node.listunspent(minconf, 10**9, addrs)])
+
+    def wallet_state(self, node, addrs, zaddr, minconf=1):
+        return (node.getbalance(),
+                self.utxo_amounts(node, addrs, minconf),
+                node.z_getbalance(zaddr, minconf),
+                node.z_gettotalbalance(minconf, True))
+
+    def run_test(self):
+        [miner, owner, importer] = self.nodes
+
+        print "Mining blocks..."
+        miner.generate(101)
+        self.sync_all()
+
+        taddr = owner.getnewaddress()
+        taddr_shield = owner.getnewaddress()
+        zaddr = owner.z_getnewaddress()
+        miner.sendtoaddress(taddr, Decimal('10.0'))
+        miner.sendtoaddress(taddr_shield, Decimal('5.0'))
+        self.sync_all()
+        miner.generate(1)
+        self.sync_all()
+
+        opid = owner.z_sendmany(taddr_shield, [{"address": zaddr, "amount": Decimal('5.0') - FEE}])
+        wait_and_assert_operationid_status(owner, opid)
+        self.sync_all()
+        miner.generate(1)
+        self.sync_all()
+        assert_equal(owner.getbalance(), Decimal('10.0'))
+        assert_equal(owner.z_getbalance(zaddr), Decimal('5.0') - FEE)
+
+        print "Spending an output and a note..."
+        opid = owner.z_sendmany(taddr, [{"address": miner.getnewaddress(), "amount": Decimal('4.0')}], 1, FEE, True)
+        wait_and_assert_operationid_status(owner, opid)
+        opid = owner.z_sendmany(zaddr, [{"address": miner.getnewaddress(), "amount": Decimal('1.0')}])
+        wait_and_assert_operationid_status(owner, opid)
+        sync_mempools(self.nodes)
+        state_unconfirmed = self.wallet_state(owner, [taddr, taddr_shield], zaddr, 0)
+
+        miner.generate(1)
+        self.sync_all()
+        spend_block = miner.getbestblockhash()
+        state_mined = self.wallet_state(owner, [taddr, taddr_shield], zaddr)
+        (balance, utxos, zbalance, totals) = state_mined
+        assert_equal(balance, Decimal('6.0') - FEE)
+        assert_equal([utxo[1] for utxo in utxos], [Decimal('6.0') - FEE])
+        assert_equal(zbalance, Decimal('4.0') - 2 * FEE)
+        assert_equal(Decimal(totals['transparent']), Decimal('6.0') - FEE)
+        assert_equal(Decimal(totals['private']), Decimal('4.0') - 2 * FEE)
+
+        print "Disconnecting the spending block..."
+        owner.invalidateblock(spend_block)
+        assert_equal(owner.getbestblockhash(), miner.getblockheader(spend_block)['previousblockhash'])
+        assert_equal(self.wallet_state(owner, [taddr, taddr_shield], zaddr, 0), state_unconfirmed)
+        # The spends are back in the mempool, leaving nothing confirmed to spend
+        assert_equal(len(owner.getrawmempool()), 2)
+        assert_equal(self.utxo_amounts(owner, [taddr]), [])
+        assert_equal(owner.z_getbalance(zaddr), 0)
+
+        owner.reconsiderblock(spend_block)
+        sync_blocks(self.nodes)
+        assert_equal(owner.getbestblockhash(), spend_block)
+        assert_equal(self.wallet_state(owner, [taddr, taddr_shield], zaddr), state_mined)
+
+        # Pay the owner from the importer, so that the importer's wallet holds
+        # transactions none of whose outputs are its own
+        print "Importing keys and addresses without a rescan..."
+        taddr_funds1 = importer.getnewaddress()
+        taddr_funds2 = importer.getnewaddress()
+        miner.sendtoaddress(taddr_funds1, Decimal('3.0'))
+        miner.sendtoaddress(taddr_funds2, Decimal('2.0'))
+        self.sync_all()
+        miner.generate(1)
+        self.sync_all()
+
+        taddr_key = owner.getnewaddress()
+        taddr_watch = owner.getnewaddress()
+        opid = importer.z_sendmany(taddr_funds1, [{"address": taddr_key, "amount": Decimal('3.0') - FEE}])
+        wait_and_assert_operationid_status(importer, opid)
+        opid = importer.z_sendmany(taddr_funds2, [{"address": taddr_watch, "amount": Decimal('2.0') - FEE}])
+        wait_and_assert_operationid_status(importer, opid)
+        sync_mempools(self.nodes)
+        miner.generate(1)
+        self.sync_all()
+        assert_equal(importer.getbalance(), 0)
+        assert_equal(importer.listunspent(), [])
+
+        importer.importprivkey(owner.dumpprivkey(taddr_key), "", False)
+        assert_equal(importer.getbalance(), Decimal('3.0') - FEE)
+        assert_equal(self.utxo_amounts(importer, [taddr_key]), self.utxo_amounts(owner, [taddr_key]))
+
+        # A watch-only output is listed, but not spendable
+        importer.importaddress(taddr_watch, "", False)
+        utxos = importer.listunspent(1, 10**9, [taddr_watch])
+        assert_equal(len(utxos), 1)
+        assert_equal(utxos[0]['amount'], Decimal('2.0') - FEE)
+        assert_equal(utxos[0]['spendable'], False)
+        assert_equal(importer.getbalance(), Decimal('3.0') - FEE)
+        assert_equal(Decimal(importer.z_gettotalbalance(1)['transparent']), Decimal('3.0') - FEE)
+        assert_equal(Decimal(importer.z_gettotalbalance(1, True)['transparent']), Decimal('5.0') - 2 * FEE)
+
+        print "Importing keys with a rescan..."
+        importer.importprivkey(owner.dumpprivkey(taddr))
+        importer.z_importkey(owner.z_exportkey(zaddr), "yes")
+        assert_equal(self.utxo_amounts(importer, [taddr, taddr_shield]), self.utxo_amounts(owner, [taddr, taddr_shield]))
+        assert_equal(importer.z_getbalance(zaddr), owner.z_getbalance(zaddr))
+        assert_equal(importer.getbalance(), Decimal('9.0') - 2 * FEE)
+
+if __name__ == '__main__':
+    WalletUnspentIndexTest().main()
@@ -152,11 +152,23 @@ case "$1" in
             verifyjoinsplit)
                 zcash_rpc zcbenchmark verifyjoinsplit 1000 "\"$RAWJOINSPLIT\""
                 ;;
+            verifyblockjoinsplits)
+                zcash_rpc_slow zcbenchmark verifyblockjoinsplits 10 "${@:3}"
+                ;;
+            sigcachelookup)
+                zcash_rpc zcbenchmark sigcachelookup 10 "${@:3}"
+                ;;
+            socketevents)
+                zcash_rpc zcbenchmark socketevents 10 "${@:3}"
+                ;;
+            tlsaccept)
+                zcash_rpc_slow zcbenchmark tlsaccept 10 "${@:3}"
+                ;;
             solveequihash)
                 zcash_rpc_slow zcbenchmark solveequihash 50 "${@:3}"
                 ;;
             verifyequihash)
-                zcash_rpc zcbenchmark verifyequihash 1000
+                zcash_rpc zcbenchmark verifyequihash 1000 "${@:3}"
                 ;;
             validatelargetx)
                 zcash_rpc zcbenchmark validatelargetx 5
@@ -178,7 +190,18 @@ case "$1" in
                 zcash_rpc zcbenchmark loadwallet 10 
                 ;;
             listunspent)
-                zcash_rpc zcbenchmark listunspent 10
+                zcash_rpc zcbenchmark listunspent 10 "${@:3}"
+                ;;
+            blocktemplate)
+                zcash_rpc_slow zcbenchmark blocktemplate 10 "${@:3}"
+                ;;
+            getrawtransaction)
+                zcashd_generate
+                zcash_rpc zcbenchmark getrawtransaction 10 "${@:3}"
+                ;;
+            serveblocks)
+                zcashd_generate
+                zcash_rpc zcbenchmark serveblocks 10 "${@:3}"
                 ;;
             *)
                 zcashd_stop
@@ -0,0 +1,204 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "pubkey.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <boost/variant/get.hpp>
+
+/** Kinds of transparent addresses, as stored in the address and spent indexes */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1,
+    ADDRESS_INDEX_SCRIPTHASH = 2,
+};
+
+/** Gets the kind and hash a destination is indexed under; false if it is not indexed */
+inline bool GetAddressIndexKey(const CTxDestination& dest, uint160& hashBytes, uint8_t& type)
+{
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_INDEX_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_INDEX_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+/** As above, for the address an output script pays to, replay protected or not */
+inline bool GetAddressIndexKey(const CScript& scriptPubKey, uint160& hashBytes, uint8_t& type)
+{
+    CTxDestination dest;
+    return ExtractDestination(scriptPubKey, dest) && GetAddressIndexKey(dest, hashBytes, type);
+}
+
+inline CTxDestination GetAddressIndexDestination(uint8_t type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_PUBKEYHASH)
+        return CKeyID(hashBytes);
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CScriptID(hashBytes);
+    return CNoDestination();
+}
+
+/**
+ * Entry of the address index: an output received by, or an input spending
+ * from, an address. Heights and positions are serialized big endian so that
+ * the entries of an address are stored in chain order.
+ */
+struct CAddressIndexKey {
+    uint8_t type;
+    uint160 hashBytes;
+    uint32_t nHeight;
+    uint32_t nTxIndex;
+    uint256 txhash;
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : type(ADDRESS_INDEX_NONE), nHeight(0), nTxIndex(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(uint8_t typeIn, const uint160& hashBytesIn, int nHeightIn, unsigned int nTxIndexIn,
+                     const uint256& txhashIn, unsigned int nIndexIn, bool fSpendingIn) :
+        type(typeIn), hashBytes(hashBytesIn), nHeight(nHeightIn), nTxIndex(nTxIndexIn),
+        txhash(txhashIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(BIGENDIAN32(nHeight));
+        READWRITE(BIGENDIAN32(nTxIndex));
+        READWRITE(txhash);
+        READWRITE(nIndex);
+        READWRITE(fSpending);
+    }
+};
+
+/** Prefix of the address index keys of one address */
+struct CAddressIndexIteratorKey {
+    uint8_t type;
+    uint160 hashBytes;
+
+    CAddressIndexIteratorKey(uint8_t typeIn, const uint160& hashBytesIn) : type(typeIn), hashBytes(hashBytesIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(type);
+        READWRITE(hashBytes);
+    }
+};
+
+/** Prefix of the address index keys of one address from a given height on */
+struct CAddressIndexIteratorHeightKey {
+    uint8_t type;
+    uint160 hashBytes;
+    uint32_t nHeight;
+
+    CAddressIndexIteratorHeightKey(uint8_t typeIn, const uint160& hashBytesIn, int nHeightIn) :
+        type(typeIn), hashBytes(hashBytesIn), nHeight(nHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(BIGENDIAN32(nHeight));
+    }
+};
+
+/** An unspent output of an address */
+struct CAddressUnspentKey {
+    uint8_t type;
+    uint160 hashBytes;
+    uint256 txhash;
+    uint32_t nIndex;
+
+    CAddressUnspentKey() : type(ADDRESS_INDEX_NONE), nIndex(0) {}
+    CAddressUnspentKey(uint8_t typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int nIndexIn) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), nIndex(nIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(nIndex);
+    }
+};
+
+/** Value of an unspent output; a null value erases the output from the index */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int nHeight;
+
+    CAddressUnspentValue() : satoshis(-1), nHeight(0) {}
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int nHeightIn) :
+        satoshis(satoshisIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    bool IsNull() const { return satoshis == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(nHeight);
+    }
+};
+
+/** An output received by, or an input spending from, an address in the mempool */
+struct CMempoolAddressDeltaKey {
+    uint8_t type;
+    uint160 hashBytes;
+    uint256 txhash;
+    uint32_t nIndex;
+    bool fSpending;
+
+    CMempoolAddressDeltaKey(uint8_t typeIn, const uint160& hashBytesIn, const uint256& txhashIn = uint256(),
+                            unsigned int nIndexIn = 0, bool fSpendingIn = false) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    friend bool operator<(const CMempoolAddressDeltaKey& a, const CMempoolAddressDeltaKey& b) {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.hashBytes != b.hashBytes)
+            return a.hashBytes < b.hashBytes;
+        if (a.txhash != b.txhash)
+            return a.txhash < b.txhash;
+        if (a.nIndex != b.nIndex)
+            return a.nIndex < b.nIndex;
+        return a.fSpending < b.fSpending;
+    }
+};
+
+struct CMempoolAddressDelta {
+    int64_t nTime;
+    CAmount amount;
+    uint256 prevhash;
+    uint32_t nPrevOut;
+
+    CMempoolAddressDelta(int64_t nTimeIn, CAmount amountIn, const uint256& prevhashIn = uint256(), unsigned int nPrevOutIn = 0) :
+        nTime(nTimeIn), amount(amountIn), prevhash(prevhashIn), nPrevOut(nPrevOutIn) {}
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,205 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+#include <vector>
+
+class CTxMemPool;
+
+/** Version of the compact block encoding announced in "sendcmpct" */
+static const uint64_t COMPACT_BLOCKS_ENCODING_VERSION = 1;
+/** Maximum number of peers asked to announce new blocks with "cmpctblock" right away */
+static const unsigned int MAX_COMPACT_BLOCKS_HB_PEERS = 3;
+/** Blocks deeper than this are served in full rather than as a compact block */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Missing transactions are only served for blocks up to this deep; deeper ones are sent in full */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+
+/** Transaction indexes of a block, serialized as differences to save space */
+class BlockTransactionsRequest {
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        uint64_t nIndexes = (uint64_t)indexes.size();
+        READWRITE(COMPACTSIZE(nIndexes));
+        if (ser_action.ForRead()) {
+            size_t i = 0;
+            while (indexes.size() < nIndexes) {
+                indexes.resize(std::min((uint64_t)(1000 + indexes.size()), nIndexes));
+                for (; i < indexes.size(); i++) {
+                    uint64_t nIndex = 0;
+                    READWRITE(COMPACTSIZE(nIndex));
+                    if (nIndex > std::numeric_limits<uint16_t>::max())
+                        throw std::ios_base::failure("index overflowed 16 bits");
+                    indexes[i] = nIndex;
+                }
+            }
+
+            uint16_t nOffset = 0;
+            for (size_t j = 0; j < indexes.size(); j++) {
+                if (uint64_t(indexes[j]) + uint64_t(nOffset) > std::numeric_limits<uint16_t>::max())
+                    throw std::ios_base::failure("indexes overflowed 16 bits");
+                indexes[j] = indexes[j] + nOffset;
+                nOffset = indexes[j] + 1;
+            }
+        } else {
+            for (size_t i = 0; i < indexes.size(); i++) {
+                uint64_t nIndex = indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1));
+                READWRITE(COMPACTSIZE(nIndex));
+            }
+        }
+    }
+};
+
+/** Transactions of a block sent in reply to a BlockTransactionsRequest */
+class BlockTransactions {
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest& req) :
+        blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent along with a compact block, at a differentially encoded index */
+struct PrefilledTransaction {
+    uint16_t index;
+    CTransaction tx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        uint64_t nIndex = index;
+        READWRITE(COMPACTSIZE(nIndex));
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("index overflowed 16 bits");
+        index = nIndex;
+        READWRITE(tx);
+    }
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, // Invalid object, peer is sending bogus data
+    READ_STATUS_FAILED, // Failed to process object, fall back to requesting the full block
+} ReadStatus;
+
+/**
+ * A block header together with 6 byte short IDs of its transactions, which
+ * a peer can usually match against its own mempool to rebuild the block
+ * without receiving the transactions again. The coinbase, which no mempool
+ * can hold, is always sent in full.
+ *
+ * Short IDs are the first 6 bytes of SHA256(k || txid), where k is
+ * SHA256(header || nonce) and the nonce is chosen by the sender, so that
+ * collisions cannot be precomputed against a specific block.
+ */
+class CBlockHeaderAndShortTxIDs {
+private:
+    mutable uint256 shorttxidk;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        uint64_t nShortTxIDs = (uint64_t)shorttxids.size();
+        READWRITE(COMPACTSIZE(nShortTxIDs));
+        if (ser_action.ForRead()) {
+            size_t i = 0;
+            while (shorttxids.size() < nShortTxIDs) {
+                shorttxids.resize(std::min((uint64_t)(1000 + shorttxids.size()), nShortTxIDs));
+                for (; i < shorttxids.size(); i++) {
+                    uint32_t lsb = 0; uint16_t msb = 0;
+                    READWRITE(lsb);
+                    READWRITE(msb);
+                    shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+                }
+            }
+        } else {
+            for (size_t i = 0; i < shorttxids.size(); i++) {
+                uint32_t lsb = shorttxids[i] & 0xffffffff;
+                uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+                READWRITE(lsb);
+                READWRITE(msb);
+            }
+        }
+
+        READWRITE(prefilledtxn);
+
+        if (ser_action.ForRead())
+            FillShortTxIDSelector();
+    }
+};
+
+/** A block being rebuilt from a compact block and the transactions of the mempool */
+class PartiallyDownloadedBlock {
+protected:
+    std::vector<CTransaction> txn_available;
+    std::vector<bool> have_txn;
+    size_t prefilled_count, mempool_count;
+    CTxMemPool* pool;
+public:
+    CBlockHeader header;
+    explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : prefilled_count(0), mempool_count(0), pool(poolIn) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    bool IsTxAvailable(size_t index) const;
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const;
+
+    size_t GetPrefilledCount() const { return prefilled_count; }
+    size_t GetMempoolCount() const { return mempool_count; }
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap(const_cast<char*>(pdata), nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Map(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    // Block files are read through stdio on Windows
+    return std::shared_ptr<const CMappedFile>();
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::shared_ptr<const CMappedFile>();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return std::shared_ptr<const CMappedFile>();
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("blockfilemap", "Unable to map %s\n", path.string());
+        return std::shared_ptr<const CMappedFile>();
+    }
+    return std::make_shared<const CMappedFile>((const char*)p, (size_t)st.st_size);
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(size_t nMaxMappingsIn) : nMaxMappings(nMaxMappingsIn)
+{
+}
+
+void CBlockFileMap::Evict(size_t nKeep)
+{
+    AssertLockHeld(cs);
+    while (listLRU.size() > nKeep) {
+        mapMappings.erase(listLRU.back());
+        listLRU.pop_back();
+    }
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Get(int nFile)
+{
+    LOCK(cs);
+    MappingMap::iterator it = mapMappings.find(nFile);
+    if (it == mapMappings.end())
+        return std::shared_ptr<const CMappedFile>();
+    listLRU.splice(listLRU.begin(), listLRU, it->second.second);
+    return it->second.first;
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Map(int nFile, const boost::filesystem::path& path)
+{
+    {
+        LOCK(cs);
+        if (nMaxMappings == 0)
+            return std::shared_ptr<const CMappedFile>();
+    }
+
+    // Map outside the lock, readers of other files need not wait for it
+    std::shared_ptr<const CMappedFile> mapping = CMappedFile::Map(path);
+    if (!mapping)
+        return mapping;
+
+    LOCK(cs);
+    if (nMaxMappings == 0)
+        return mapping;
+    Forget(nFile);
+    Evict(nMaxMappings - 1);
+    listLRU.push_front(nFile);
+    mapMappings[nFile] = std::make_pair(mapping, listLRU.begin());
+    return mapping;
+}
+
+void CBlockFileMap::Forget(int nFile)
+{
+    LOCK(cs);
+    MappingMap::iterator it = mapMappings.find(nFile);
+    if (it == mapMappings.end())
+        return;
+    listLRU.erase(it->second.second);
+    mapMappings.erase(it);
+}
+
+void CBlockFileMap::SetMaxMappings(size_t nMaxMappingsIn)
+{
+    LOCK(cs);
+    nMaxMappings = nMaxMappingsIn;
+    Evict(nMaxMappings);
+}
+
+size_t CBlockFileMap::GetMaxMappings() const
+{
+    LOCK(cs);
+    return nMaxMappings;
+}
+
+size_t CBlockFileMap::GetMappingCount() const
+{
+    LOCK(cs);
+    return mapMappings.size();
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+#include <boost/filesystem/path.hpp>
+
+/** Default for -maxblockfilemaps, the number of block files kept memory-mapped */
+static const unsigned int DEFAULT_MAX_BLOCKFILE_MAPS = 32;
+
+/** A read-only memory mapping of a whole file, unmapped with its last reference */
+class CMappedFile
+{
+private:
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pdata;
+    size_t nSize;
+
+public:
+    CMappedFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedFile();
+
+    /** Map the file at path; returns NULL if it cannot be mapped */
+    static std::shared_ptr<const CMappedFile> Map(const boost::filesystem::path& path);
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Keeps up to a fixed number of block files memory-mapped, dropping the least
+ * recently used one when a new file needs to be mapped. Readers hold on to the
+ * returned mapping while deserializing, so a file evicted meanwhile is only
+ * unmapped once they are done with it.
+ *
+ * Block files are only appended to, or truncated back to the end of their
+ * data when finalized, so a mapping stays valid for every block it covers. A
+ * file that grew past its mapping has to be remapped with Forget() and Map().
+ */
+class CBlockFileMap
+{
+private:
+    mutable CCriticalSection cs;
+    size_t nMaxMappings;
+    typedef std::map<int, std::pair<std::shared_ptr<const CMappedFile>, std::list<int>::iterator> > MappingMap;
+
+    std::list<int> listLRU;
+    MappingMap mapMappings;
+
+    void Evict(size_t nKeep);
+
+public:
+    explicit CBlockFileMap(size_t nMaxMappingsIn);
+
+    /** Mapping of file nFile if it is currently mapped, NULL otherwise */
+    std::shared_ptr<const CMappedFile> Get(int nFile);
+    /** Map file nFile from path, returning NULL if mapping is disabled or fails */
+    std::shared_ptr<const CMappedFile> Map(int nFile, const boost::filesystem::path& path);
+    /** Drop the mapping of file nFile, e.g. because it was pruned or grew */
+    void Forget(int nFile);
+    /** Change the number of files kept mapped; 0 disables mapping */
+    void SetMaxMappings(size_t nMaxMappingsIn);
+    size_t GetMaxMappings() const;
+    size_t GetMappingCount() const;
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
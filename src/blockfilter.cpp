@@ -0,0 +1,288 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+/** Writes bits to a byte vector, most significant bit first */
+class BitStreamWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    uint8_t buffer;
+    int offset;
+
+public:
+    BitStreamWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), buffer(0), offset(0) {}
+    ~BitStreamWriter() { Flush(); }
+
+    /** Writes the nbits (at most 64) least significant bits of data */
+    void Write(uint64_t data, int nbits)
+    {
+        while (nbits > 0) {
+            int bits = std::min(8 - offset, nbits);
+            buffer |= (data << (64 - nbits)) >> (64 - 8 + offset);
+            offset += bits;
+            nbits -= bits;
+            if (offset == 8)
+                Flush();
+        }
+    }
+
+    /** Writes the last partial byte, padded with zero bits */
+    void Flush()
+    {
+        if (offset == 0)
+            return;
+        vch.push_back(buffer);
+        buffer = 0;
+        offset = 0;
+    }
+};
+
+/** Reads bits from a byte vector, most significant bit first */
+class BitStreamReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t pos;
+    uint8_t buffer;
+    int offset;
+
+public:
+    BitStreamReader(const std::vector<unsigned char>& vchIn, size_t posIn) : vch(vchIn), pos(posIn), buffer(0), offset(8) {}
+
+    /** Whether all the bytes were read, the bits left in the last one being padding */
+    bool AtEnd() const { return pos == vch.size(); }
+
+    /** Reads nbits (at most 64) bits */
+    uint64_t Read(int nbits)
+    {
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (offset == 8) {
+                if (pos >= vch.size())
+                    throw std::ios_base::failure("BitStreamReader::Read(): end of data");
+                buffer = vch[pos++];
+                offset = 0;
+            }
+            int bits = std::min(8 - offset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(buffer << offset) >> (8 - bits);
+            offset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
+void GolombRiceEncode(BitStreamWriter& writer, uint8_t P, uint64_t x)
+{
+    // The quotient is written in unary, the remainder in P bits
+    uint64_t q = x >> P;
+    while (q > 0) {
+        int nbits = q <= 64 ? static_cast<int>(q) : 64;
+        writer.Write(~0ULL, nbits);
+        q -= nbits;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, P);
+}
+
+uint64_t GolombRiceDecode(BitStreamReader& reader, uint8_t P)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    uint64_t r = reader.Read(P);
+    return (q << P) + r;
+}
+
+/** Maps x uniformly into [0, n), as (x * n) >> 64 */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+/** Reads the number of elements at the start of an encoded filter, returning the size of that prefix */
+size_t ReadFilterSize(const std::vector<unsigned char>& encoded, uint32_t& nN)
+{
+    CDataStream ss(encoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nSize = ReadCompactSize(ss);
+    if (nSize > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("N must be < 2^32");
+    nN = static_cast<uint32_t>(nSize);
+    return encoded.size() - ss.size();
+}
+
+} // namespace
+
+GCSFilter::GCSFilter(uint64_t k0, uint64_t k1, uint8_t P, uint32_t M) :
+    nSipHashK0(k0), nSipHashK1(k1), nP(P), nM(M), nN(0), nF(0), vEncoded(1, 0)
+{
+}
+
+GCSFilter::GCSFilter(uint64_t k0, uint64_t k1, uint8_t P, uint32_t M, const std::vector<unsigned char>& encoded) :
+    nSipHashK0(k0), nSipHashK1(k1), nP(P), nM(M), vEncoded(encoded)
+{
+    size_t nPos = ReadFilterSize(vEncoded, nN);
+    nF = static_cast<uint64_t>(nN) * nM;
+
+    // Check that the encoding holds exactly N elements
+    BitStreamReader reader(vEncoded, nPos);
+    for (uint32_t i = 0; i < nN; i++)
+        GolombRiceDecode(reader, nP);
+    if (!reader.AtEnd())
+        throw std::ios_base::failure("encoded filter has data past its elements");
+}
+
+GCSFilter::GCSFilter(uint64_t k0, uint64_t k1, uint8_t P, uint32_t M, const ElementSet& elements) :
+    nSipHashK0(k0), nSipHashK1(k1), nP(P), nM(M)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("N must be < 2^32");
+    nN = static_cast<uint32_t>(elements.size());
+    nF = static_cast<uint64_t>(nN) * nM;
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); ++it)
+        vHashes.push_back(HashToRange(*it));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nN);
+    vEncoded.assign(ss.begin(), ss.end());
+
+    BitStreamWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        GolombRiceEncode(writer, nP, vHashes[i] - nLast);
+        nLast = vHashes[i];
+    }
+    writer.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(nSipHashK0, nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(hash, nF);
+}
+
+bool GCSFilter::MatchInternal(std::vector<uint64_t>& vQueries) const
+{
+    if (nN == 0 || vQueries.empty())
+        return false;
+    std::sort(vQueries.begin(), vQueries.end());
+
+    // Walk the set and the sorted queries together, decoding each element once
+    uint32_t nDummy;
+    BitStreamReader reader(vEncoded, ReadFilterSize(vEncoded, nDummy));
+    uint64_t nValue = 0;
+    size_t nQuery = 0;
+    for (uint32_t i = 0; i < nN; i++) {
+        nValue += GolombRiceDecode(reader, nP);
+        while (vQueries[nQuery] < nValue) {
+            if (++nQuery == vQueries.size())
+                return false;
+        }
+        if (vQueries[nQuery] == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    std::vector<uint64_t> vQueries(1, HashToRange(element));
+    return MatchInternal(vQueries);
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vQueries;
+    vQueries.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); ++it)
+        vQueries.push_back(HashToRange(*it));
+    return MatchInternal(vQueries);
+}
+
+static GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo)
+{
+    GCSFilter::ElementSet elements;
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        for (size_t j = 0; j < block.vtx[i].vout.size(); j++) {
+            const CScript& script = block.vtx[i].vout[j].scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    for (size_t i = 0; i < blockUndo.vtxundo.size(); i++) {
+        for (size_t j = 0; j < blockUndo.vtxundo[i].vprevout.size(); j++) {
+            const CScript& script = blockUndo.vtxundo[i].vprevout[j].txout.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    return elements;
+}
+
+BlockFilter::BlockFilter(uint8_t filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& encoded) :
+    filterType(filterTypeIn), blockHash(blockHashIn)
+{
+    if (filterType != BLOCK_FILTER_BASIC)
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(ReadLE64(blockHash.begin()), ReadLE64(blockHash.begin() + 8),
+                       BASIC_FILTER_P, BASIC_FILTER_M, encoded);
+}
+
+BlockFilter::BlockFilter(uint8_t filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo) :
+    filterType(filterTypeIn), blockHash(block.GetHash())
+{
+    if (filterType != BLOCK_FILTER_BASIC)
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(ReadLE64(blockHash.begin()), ReadLE64(blockHash.begin() + 8),
+                       BASIC_FILTER_P, BASIC_FILTER_M, BasicFilterElements(block, blockUndo));
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& encoded = GetEncodedFilter();
+    return Hash(encoded.begin(), encoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    uint256 filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
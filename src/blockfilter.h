@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlockUndo;
+
+/** Golomb-Rice parameter and false positive rate inverse of the basic filter (BIP 158) */
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+/** Most filters a peer can ask for with one getcfilters (BIP 157) */
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+/** Most filter hashes a peer can ask for with one getcfheaders (BIP 157) */
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+/** Blocks between two of the filter headers sent in a cfcheckpt */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * Golomb-coded set (BIP 158): a compact probabilistic set of elements, each
+ * hashed to an integer below N * M. The integers are sorted and stored as
+ * Golomb-Rice coded differences, so that matching decodes the set once.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    uint32_t nN;
+    uint64_t nF;
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchInternal(std::vector<uint64_t>& vQueries) const;
+
+public:
+    /** Constructs an empty filter */
+    GCSFilter(uint64_t k0 = 0, uint64_t k1 = 0, uint8_t P = 0, uint32_t M = 0);
+    /** Reconstructs a filter from its encoding; throws std::ios_base::failure if it is malformed */
+    GCSFilter(uint64_t k0, uint64_t k1, uint8_t P, uint32_t M, const std::vector<unsigned char>& encoded);
+    /** Builds a filter holding the elements */
+    GCSFilter(uint64_t k0, uint64_t k1, uint8_t P, uint32_t M, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    /** Whether the element may be in the set; false positives happen with probability 1 / M */
+    bool Match(const Element& element) const;
+    /** Whether any of the elements may be in the set, faster than matching them one by one */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType {
+    BLOCK_FILTER_BASIC = 0,
+};
+
+/**
+ * Filter of a block for light clients. The basic filter holds the output
+ * scripts of the block and the scripts of the outputs it spends, keyed by
+ * the block hash.
+ */
+class BlockFilter
+{
+private:
+    uint8_t filterType;
+    uint256 blockHash;
+    GCSFilter filter;
+
+public:
+    BlockFilter() : filterType(BLOCK_FILTER_BASIC) {}
+    /** Reconstructs a filter from its encoding; throws std::invalid_argument on an unknown type */
+    BlockFilter(uint8_t filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& encoded);
+    /** Builds the filter of a block, with the outputs it spends in blockUndo */
+    BlockFilter(uint8_t filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    uint8_t GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Double SHA256 of the encoded filter */
+    uint256 GetHash() const;
+    /** Header committing to this filter and, through the previous header, to those of the blocks before */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
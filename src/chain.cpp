@@ -4,11 +4,34 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "sync.h"
 
 #include <stdexcept>
 
 using namespace std;
 
+/** Guards nSolution of every CBlockIndex against eviction while it is read */
+static CCriticalSection cs_blockIndexSolution;
+
+std::vector<unsigned char> CBlockIndex::GetSolution() const
+{
+    {
+        LOCK(cs_blockIndexSolution);
+        if (!nSolution.empty())
+            return nSolution;
+    }
+    return ReadBlockIndexSolution(this);
+}
+
+void CBlockIndex::EvictSolution()
+{
+    std::vector<unsigned char> vEvicted;
+    {
+        LOCK(cs_blockIndexSolution);
+        vEvicted.swap(nSolution);
+    }
+}
+
 /**
  * CChain implementation
  */
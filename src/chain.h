@@ -186,6 +186,9 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     uint256 nNonce;
+    //! Only kept in memory until the entry is written to the block tree
+    //! database, use GetSolution() to read it: EvictSolution() may release
+    //! it concurrently
     std::vector<unsigned char> nSolution;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
@@ -267,10 +270,17 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
+        block.nSolution      = GetSolution();
         return block;
     }
 
+    //! Equihash solution of the header, read back from the block tree
+    //! database if it is no longer held in memory
+    std::vector<unsigned char> GetSolution() const;
+
+    //! Release the memory held by the solution, once it is safely on disk
+    void EvictSolution();
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -348,6 +358,8 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        if (nSolution.empty())
+            nSolution = pindex->GetSolution();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -411,6 +423,12 @@ public:
     }
 };
 
+/**
+ * Solution of an indexed header whose solution was evicted from memory.
+ * Implemented in main.cpp, which owns the block tree database.
+ */
+std::vector<unsigned char> ReadBlockIndexSolution(const CBlockIndex* pindex);
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
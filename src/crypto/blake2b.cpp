@@ -0,0 +1,262 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ENABLE_BLAKE2B_AVX2
+#include <immintrin.h>
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+const uint8_t SIGMA[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+/** The mixing function, on words a, b, c and d of the working vector. */
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = Rotr(d ^ a, 32);
+    c = c + d;
+    b = Rotr(b ^ c, 24);
+    a = a + b + y;
+    d = Rotr(d ^ a, 16);
+    c = c + d;
+    b = Rotr(b ^ c, 63);
+}
+
+/** Compress a 128-byte block, bytes being the number of bytes hashed up to its end. */
+void Compress(uint64_t* h, const unsigned char* block, uint64_t bytes, bool fLast)
+{
+    uint64_t m[16], v[16];
+    for (int i = 0; i < 16; i++)
+        m[i] = ReadLE64(block + 8 * i);
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    v[12] ^= bytes;
+    if (fLast)
+        v[14] = ~v[14];
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++)
+        h[i] ^= v[i] ^ v[i + 8];
+}
+
+void WriteOutput(const uint64_t* h, unsigned char* out, size_t outlen)
+{
+    unsigned char buf[8 * 8];
+    for (int i = 0; i < 8; i++)
+        WriteLE64(buf + 8 * i, h[i]);
+    memcpy(out, buf, outlen);
+}
+
+#ifdef ENABLE_BLAKE2B_AVX2
+/** Number of blocks compressed at once by the AVX2 implementation, one per 64-bit lane. */
+const size_t LANES = 4;
+
+#define BLAKE2B_AVX2 __attribute__((target("avx2")))
+
+BLAKE2B_AVX2 __m256i inline Rotr32(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+BLAKE2B_AVX2 __m256i inline Rotr24(__m256i x)
+{
+    const __m256i mask = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                          3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+    return _mm256_shuffle_epi8(x, mask);
+}
+BLAKE2B_AVX2 __m256i inline Rotr16(__m256i x)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                          2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    return _mm256_shuffle_epi8(x, mask);
+}
+BLAKE2B_AVX2 __m256i inline Rotr63(__m256i x) { return _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x)); }
+
+BLAKE2B_AVX2 void inline G4(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y)
+{
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), x);
+    d = Rotr32(_mm256_xor_si256(d, a));
+    c = _mm256_add_epi64(c, d);
+    b = Rotr24(_mm256_xor_si256(b, c));
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), y);
+    d = Rotr16(_mm256_xor_si256(d, a));
+    c = _mm256_add_epi64(c, d);
+    b = Rotr63(_mm256_xor_si256(b, c));
+}
+
+/**
+ * Compress the last blocks of four messages sharing the midstate h and the
+ * length bytes, writing each of the hashes to out, outlen bytes apart.
+ */
+BLAKE2B_AVX2 void CompressLast4(const uint64_t* h, const unsigned char* blocks, uint64_t bytes,
+                                unsigned char* out, size_t outlen)
+{
+    __m256i m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = _mm256_set_epi64x(ReadLE64(blocks + 3 * 128 + 8 * i), ReadLE64(blocks + 2 * 128 + 8 * i),
+                                 ReadLE64(blocks + 1 * 128 + 8 * i), ReadLE64(blocks + 8 * i));
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = _mm256_set1_epi64x(h[i]);
+        v[i + 8] = _mm256_set1_epi64x(IV[i]);
+    }
+    v[12] = _mm256_set1_epi64x(IV[4] ^ bytes);
+    v[14] = _mm256_set1_epi64x(~IV[6]);
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G4(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G4(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G4(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G4(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G4(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G4(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G4(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G4(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    uint64_t lanes[8][LANES];
+    for (int i = 0; i < 8; i++) {
+        __m256i x = _mm256_xor_si256(_mm256_set1_epi64x(h[i]), _mm256_xor_si256(v[i], v[i + 8]));
+        _mm256_storeu_si256((__m256i*)lanes[i], x);
+    }
+    for (size_t lane = 0; lane < LANES; lane++) {
+        uint64_t hLane[8];
+        for (int i = 0; i < 8; i++)
+            hLane[i] = lanes[i][lane];
+        WriteOutput(hLane, out + lane * outlen, outlen);
+    }
+}
+
+bool HaveAVX2()
+{
+    static const bool fHaveAVX2 = __builtin_cpu_supports("avx2");
+    return fHaveAVX2;
+}
+#endif // ENABLE_BLAKE2B_AVX2
+
+} // namespace blake2b
+} // namespace
+
+////// BLAKE2b
+
+CBlake2b::CBlake2b(size_t outlenIn, const unsigned char* personal) : bufsize(0), bytes(0), outlen(outlenIn)
+{
+    assert(outlen >= 1 && outlen <= MAX_OUTPUT_SIZE);
+    memcpy(h, blake2b::IV, sizeof(h));
+    // Parameter block: digest length, no key, fanout and depth of 1
+    h[0] ^= 0x01010000ull ^ outlen;
+    if (personal) {
+        h[6] ^= ReadLE64(personal);
+        h[7] ^= ReadLE64(personal + 8);
+    }
+}
+
+CBlake2b& CBlake2b::Write(const unsigned char* data, size_t len)
+{
+    while (len > 0) {
+        // The last block is only compressed on finalization, with the final flag set
+        if (bufsize == BLOCK_SIZE) {
+            bytes += BLOCK_SIZE;
+            blake2b::Compress(h, buf, bytes, false);
+            bufsize = 0;
+        }
+        size_t n = std::min(len, BLOCK_SIZE - bufsize);
+        memcpy(buf + bufsize, data, n);
+        bufsize += n;
+        data += n;
+        len -= n;
+    }
+    return *this;
+}
+
+void CBlake2b::Finalize(unsigned char* hash)
+{
+    bytes += bufsize;
+    memset(buf + bufsize, 0, BLOCK_SIZE - bufsize);
+    blake2b::Compress(h, buf, bytes, true);
+    blake2b::WriteOutput(h, hash, outlen);
+}
+
+void CBlake2b::FinalizeWithIndices(const uint32_t* indices, size_t count, unsigned char* hashes) const
+{
+    if (bufsize + sizeof(uint32_t) > BLOCK_SIZE) {
+        // The indices spill over to another block
+        for (size_t i = 0; i < count; i++) {
+            unsigned char le[sizeof(uint32_t)];
+            WriteLE32(le, indices[i]);
+            CBlake2b(*this).Write(le, sizeof(le)).Finalize(hashes + i * outlen);
+        }
+        return;
+    }
+
+    // All the hashes end with one block, differing only in the index
+    const uint64_t nTotal = bytes + bufsize + sizeof(uint32_t);
+    size_t i = 0;
+#ifdef ENABLE_BLAKE2B_AVX2
+    if (count >= blake2b::LANES && blake2b::HaveAVX2()) {
+        unsigned char blocks[blake2b::LANES * BLOCK_SIZE];
+        for (size_t lane = 0; lane < blake2b::LANES; lane++) {
+            memcpy(blocks + lane * BLOCK_SIZE, buf, bufsize);
+            memset(blocks + lane * BLOCK_SIZE + bufsize, 0, BLOCK_SIZE - bufsize);
+        }
+        for (; i + blake2b::LANES <= count; i += blake2b::LANES) {
+            for (size_t lane = 0; lane < blake2b::LANES; lane++)
+                WriteLE32(blocks + lane * BLOCK_SIZE + bufsize, indices[i + lane]);
+            blake2b::CompressLast4(h, blocks, nTotal, hashes + i * outlen, outlen);
+        }
+    }
+#endif
+    unsigned char block[BLOCK_SIZE];
+    memcpy(block, buf, bufsize);
+    memset(block + bufsize, 0, BLOCK_SIZE - bufsize);
+    for (; i < count; i++) {
+        uint64_t s[8];
+        memcpy(s, h, sizeof(s));
+        WriteLE32(block + bufsize, indices[i]);
+        blake2b::Compress(s, block, nTotal, true);
+        blake2b::WriteOutput(s, hashes + i * outlen, outlen);
+    }
+}
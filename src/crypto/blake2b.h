@@ -0,0 +1,46 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * A hasher class for BLAKE2b, unkeyed and with an optional personalization,
+ * as used by Equihash. Unlike the libsodium state, it exposes the midstate,
+ * so that the hashes of many short suffixes can be computed in parallel.
+ */
+class CBlake2b
+{
+public:
+    static const size_t BLOCK_SIZE = 128;
+    static const size_t MAX_OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    /** Initializes a hasher returning outlen (1 to 64) bytes, personalized if personal is not NULL */
+    CBlake2b(size_t outlen, const unsigned char* personal = NULL);
+    CBlake2b& Write(const unsigned char* data, size_t len);
+    /** Writes the outlen byte hash */
+    void Finalize(unsigned char* hash);
+
+    /**
+     * Writes the hashes of the data written so far followed by each of the
+     * count little endian 32-bit values, outlen bytes each. The state is left
+     * untouched. Several hashes are computed at once on CPUs with AVX2.
+     */
+    void FinalizeWithIndices(const uint32_t* indices, size_t count, unsigned char* hashes) const;
+
+    size_t GetOutputSize() const { return outlen; }
+
+private:
+    uint64_t h[8];
+    unsigned char buf[BLOCK_SIZE];
+    size_t bufsize;
+    uint64_t bytes;
+    size_t outlen;
+};
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
@@ -17,6 +17,7 @@
 #endif
 
 #include "compat/endian.h"
+#include "crypto/blake2b.h"
 #include "crypto/equihash.h"
 #include "util.h"
 
@@ -720,7 +721,7 @@ invalidsolution:
 #endif // ENABLE_MINING
 
 template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln)
 {
     if (soln.size() != SolutionWidth) {
         LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
@@ -767,6 +768,91 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln)
+{
+    if (soln.size() != SolutionWidth) {
+        LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    // The indices are packed big-endian, on CollisionBitLength+1 bits each
+    enum : size_t { IndexCount=1 << K };
+    eh_index indices[IndexCount];
+    const size_t indexBitLen = CollisionBitLength + 1;
+    const uint64_t indexMask = ((uint64_t)1 << indexBitLen) - 1;
+    uint64_t accValue = 0;
+    size_t accBits = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < soln.size(); i++) {
+        accValue = (accValue << 8) | soln[i];
+        accBits += 8;
+        if (accBits >= indexBitLen) {
+            accBits -= indexBitLen;
+            indices[j++] = (accValue >> accBits) & indexMask;
+        }
+    }
+    assert(j == IndexCount);
+
+    // Two leaves are on either side of the collision of their closest common
+    // ancestor, so this is the distinct indices check of every level at once
+    eh_index sorted[IndexCount];
+    std::copy(indices, indices + IndexCount, sorted);
+    std::sort(sorted, sorted + IndexCount);
+    if (std::adjacent_find(sorted, sorted + IndexCount) != sorted + IndexCount) {
+        LogPrint("pow", "Invalid solution: duplicate indices\n");
+        return false;
+    }
+
+    uint32_t personalization[crypto_generichash_blake2b_PERSONALBYTES / sizeof(uint32_t)];
+    memcpy(personalization, "ZcashPoW", 8);
+    personalization[2] = htole32(N);
+    personalization[3] = htole32(K);
+    CBlake2b state(HashOutput, (const unsigned char*)personalization);
+    state.Write(input, inputLen);
+
+    // Hash the indices a batch at a time, and expand them to collision rows
+    enum : size_t { HashBatch=16 };
+    unsigned char rows[IndexCount][HashLength];
+    eh_index hashIndices[HashBatch];
+    unsigned char hashes[HashBatch * HashOutput];
+    for (size_t i = 0; i < IndexCount; i += HashBatch) {
+        size_t count = std::min((size_t)HashBatch, IndexCount - i);
+        for (size_t b = 0; b < count; b++)
+            hashIndices[b] = indices[i + b] / IndicesPerHashOutput;
+        state.FinalizeWithIndices(hashIndices, count, hashes);
+        for (size_t b = 0; b < count; b++) {
+            ExpandArray(hashes + b * HashOutput + (indices[i + b] % IndicesPerHashOutput) * N/8, N/8,
+                        rows[i + b], HashLength, CollisionBitLength);
+        }
+    }
+
+    // Merge the rows pairwise in place, each level XORing away one collision
+    for (size_t level = 0, rowCount = IndexCount; rowCount > 1; level++, rowCount /= 2) {
+        const size_t offset = level * CollisionByteLength;
+        const size_t leaves = (size_t)1 << level;
+        for (size_t i = 0; i < rowCount; i += 2) {
+            if (memcmp(rows[i] + offset, rows[i+1] + offset, CollisionByteLength) != 0) {
+                LogPrint("pow", "Invalid solution: invalid collision length between StepRows\n");
+                return false;
+            }
+            if (indices[(i+1) * leaves] < indices[i * leaves]) {
+                LogPrint("pow", "Invalid solution: Index tree incorrectly ordered\n");
+                return false;
+            }
+            for (size_t b = offset + CollisionByteLength; b < HashLength; b++)
+                rows[i/2][b] = rows[i][b] ^ rows[i+1][b];
+        }
+    }
+
+    for (size_t b = K * CollisionByteLength; b < HashLength; b++) {
+        if (rows[0][b] != 0)
+            return false;
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
 #ifdef ENABLE_MINING
@@ -777,7 +863,8 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
-template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<96,3>::VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
@@ -789,7 +876,8 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
-template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<200,9>::VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
@@ -801,7 +889,8 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
-template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<96,5>::VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
@@ -813,4 +902,5 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
-template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<48,5>::VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
@@ -190,7 +190,13 @@ public:
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
-    bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    bool IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+    /**
+     * Same check as IsValidSolution, given the input I||V rather than a hash
+     * state. Works on fixed size buffers, without heap allocation, and hashes
+     * several indices at once; used to verify block headers.
+     */
+    bool VerifySolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 };
 
 #include "equihash.tcc"
@@ -276,4 +282,20 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
+inline bool EhVerifySolution(unsigned int n, unsigned int k, const unsigned char* input, size_t inputLen,
+                             const std::vector<unsigned char>& soln)
+{
+    if (n == 96 && k == 3) {
+        return Eh96_3.VerifySolution(input, inputLen, soln);
+    } else if (n == 200 && k == 9) {
+        return Eh200_9.VerifySolution(input, inputLen, soln);
+    } else if (n == 96 && k == 5) {
+        return Eh96_5.VerifySolution(input, inputLen, soln);
+    } else if (n == 48 && k == 5) {
+        return Eh48_5.VerifySolution(input, inputLen, soln);
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
 #endif // BITCOIN_EQUIHASH_H
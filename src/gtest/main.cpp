@@ -2,6 +2,7 @@
 #include "crypto/common.h"
 #include "key.h"
 #include "pubkey.h"
+#include "script/sigcache.h"
 #include "zcash/JoinSplit.hpp"
 #include "util.h"
 
@@ -22,6 +23,7 @@ ZCJoinSplit* params;
 int main(int argc, char **argv) {
   assert(init_and_check_sodium() != -1);
   ECC_Start();
+  InitSignatureCache();
 
   libsnark::default_r1cs_ppzksnark_pp::init_public_params();
   libsnark::inhibit_profiling_info = true;
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "arith_uint256.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "zcash/Proof.hpp"
@@ -40,6 +41,43 @@ TEST(CheckBlock, VersionTooLow) {
     EXPECT_FALSE(CheckBlock(block, state, verifier, false, false));
 }
 
+TEST(CheckBlock, HeaderCheck) {
+    SelectParams(CBaseChainParams::MAIN);
+
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    CBlockHeader badSolution = header;
+    badSolution.nNonce = ArithToUint256(UintToArith256(badSolution.nNonce) + 1);
+
+    // The outcome of every header is also written to its flag
+    char fValid = false, fBadValid = true;
+    CHeaderCheck check(header, fValid);
+    CHeaderCheck badCheck(badSolution, fBadValid);
+    EXPECT_TRUE(check());
+    EXPECT_FALSE(badCheck());
+    EXPECT_TRUE(fValid);
+    EXPECT_FALSE(fBadValid);
+
+    // A batch accepts the valid headers before the first invalid one, even
+    // though the queue stops there
+    std::vector<CBlockHeader> headers = {header, header, badSolution, header};
+    std::vector<char> vQueued = {true, true, true, true};
+    std::vector<char> vPowChecked(headers.size(), false);
+    CheckHeaderSolutions(headers, vQueued, vPowChecked);
+    EXPECT_EQ(vPowChecked, std::vector<char>({true, true, false, false}));
+
+    // Headers which are not queued are left unchecked
+    vQueued = {false, true, true, true};
+    vPowChecked.assign(headers.size(), false);
+    CheckHeaderSolutions(headers, vQueued, vPowChecked);
+    EXPECT_EQ(vPowChecked, std::vector<char>({false, true, false, false}));
+
+    headers[2] = header;
+    vQueued = {true, true, true, true};
+    vPowChecked.assign(headers.size(), false);
+    CheckHeaderSolutions(headers, vQueued, vPowChecked);
+    EXPECT_EQ(vPowChecked, std::vector<char>({true, true, true, true}));
+}
+
 
 // Test that a tx with negative version is still rejected
 // by CheckBlock under consensus rules.
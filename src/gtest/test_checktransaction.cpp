@@ -381,6 +381,20 @@ TEST(checktransaction_tests, bad_txns_invalid_joinsplit_signature) {
     CheckTransactionWithoutProofVerification(tx, state);
 }
 
+TEST(checktransaction_tests, deferred_proof_checks) {
+    // The proofs of this transaction are not valid, but CheckTransaction
+    // must leave them to the caller when given a check vector.
+    CMutableTransaction mtx = GetValidTransaction();
+    CTransaction tx(mtx);
+
+    CValidationState state;
+    auto verifier = libzcash::ProofVerifier::Strict();
+    std::vector<CProofCheck> vChecks;
+    EXPECT_TRUE(CheckTransaction(tx, state, verifier, &vChecks));
+    EXPECT_TRUE(state.IsValid());
+    EXPECT_EQ(vChecks.size(), tx.vjoinsplit.size());
+}
+
 TEST(checktransaction_tests, non_canonical_ed25519_signature) {
     CMutableTransaction mtx = GetValidTransaction();
 
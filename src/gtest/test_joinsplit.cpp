@@ -539,6 +539,64 @@ TEST(joinsplit, full_api_test)
     test_full_api(params);
 }
 
+TEST(joinsplit, batch_verification)
+{
+    uint256 joinSplitPubKey = random_uint256();
+    uint256 rt = ZCIncrementalMerkleTree().root();
+
+    std::vector<JSDescription> jsdescs;
+    for (int i = 0; i < 3; i++) {
+        jsdescs.push_back(JSDescription(false, *params, joinSplitPubKey, rt,
+                                        {JSInput(), JSInput()},
+                                        {JSOutput(), JSOutput()},
+                                        0, 0));
+    }
+
+    {
+        auto verifier = libzcash::ProofVerifier::Batch();
+        for (auto& jsdesc : jsdescs) {
+            ASSERT_TRUE(jsdesc.Verify(*params, verifier, joinSplitPubKey));
+        }
+        ASSERT_TRUE(verifier.verify_batch());
+        // The batch is emptied by verification
+        ASSERT_TRUE(verifier.verify_batch());
+    }
+
+    // A proof for another statement passes the per-proof checks,
+    // but must make the whole batch fail and be identified.
+    jsdescs[1].vpub_old = 1;
+    {
+        auto verifier = libzcash::ProofVerifier::Batch();
+        for (auto& jsdesc : jsdescs) {
+            ASSERT_TRUE(jsdesc.Verify(*params, verifier, joinSplitPubKey));
+        }
+        size_t invalid_index = 0;
+        ASSERT_FALSE(verifier.verify_batch(&invalid_index));
+        ASSERT_EQ(invalid_index, 1);
+    }
+}
+
+TEST(joinsplit, cached_proving_key)
+{
+    uint256 joinSplitPubKey = random_uint256();
+    uint256 rt = ZCIncrementalMerkleTree().root();
+
+    ASSERT_FALSE(params->hasProvingKey());
+    params->loadProvingKey();
+    ASSERT_TRUE(params->hasProvingKey());
+
+    // Proofs made with the proving key in memory verify like those streamed from disk
+    JSDescription jsdesc(false, *params, joinSplitPubKey, rt,
+                         {JSInput(), JSInput()},
+                         {JSOutput(), JSOutput()},
+                         0, 0);
+    auto verifier = libzcash::ProofVerifier::Strict();
+    ASSERT_TRUE(jsdesc.Verify(*params, verifier, joinSplitPubKey));
+
+    params->unloadProvingKey();
+    ASSERT_FALSE(params->hasProvingKey());
+}
+
 TEST(joinsplit, note_plaintexts)
 {
     uint252 a_sk = uint252(uint256S("f6da8716682d600f74fc16bd0187faad6a26b4aa4c24d5c055b216d94516840e"));
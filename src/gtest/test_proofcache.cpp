@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+
+#include "primitives/transaction.h"
+#include "proofcache.h"
+#include "random.h"
+
+TEST(proofcache, cached_proofs) {
+    JSDescription phgr = JSDescription::getNewInstance(false);
+    phgr.randomSeed = GetRandHash();
+    JSDescription groth = JSDescription::getNewInstance(true);
+    groth.randomSeed = phgr.randomSeed;
+    uint256 joinSplitPubKey = GetRandHash();
+
+    size_t nEntries;
+    uint64_t nHits, nMisses;
+    GetProofCacheStats(nEntries, nHits, nMisses);
+
+    EXPECT_FALSE(IsProofCached(phgr, joinSplitPubKey));
+    CacheValidProof(phgr, joinSplitPubKey);
+    EXPECT_TRUE(IsProofCached(phgr, joinSplitPubKey));
+
+    // The key covers the signing key and the proof system
+    EXPECT_FALSE(IsProofCached(phgr, GetRandHash()));
+    EXPECT_FALSE(IsProofCached(groth, joinSplitPubKey));
+
+    // As well as every field of the description
+    phgr.vpub_old = 1;
+    EXPECT_FALSE(IsProofCached(phgr, joinSplitPubKey));
+
+    size_t nEntriesAfter;
+    uint64_t nHitsAfter, nMissesAfter;
+    GetProofCacheStats(nEntriesAfter, nHitsAfter, nMissesAfter);
+    EXPECT_EQ(nEntries + 1, nEntriesAfter);
+    EXPECT_EQ(nHits + 1, nHitsAfter);
+    EXPECT_EQ(nMisses + 4, nMissesAfter);
+}
@@ -7,17 +7,25 @@
 
 #include "sodium.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockfilter.h"
+#include "blockfilemap.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "deprecation.h"
 #include "init.h"
+#include "memusage.h"
 #include "merkleblock.h"
 #include "metrics.h"
 #include "pow.h"
+#include "proofcache.h"
+#include "spentindex.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -70,10 +78,15 @@ bool fExperimentalMode = false;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+bool fBlockFilterIndex = false;
+bool fPeerBloomFilters = DEFAULT_PEERBLOOMFILTERS;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fCheckBlockReads = DEFAULT_CHECKBLOCKREADS;
 bool fCheckpointsEnabled = true;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 //true in case we still have not reached the highest known block from server startup
@@ -81,6 +94,7 @@ bool fIsStartupSyncing = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
+CBlockFileMap blockFileMap(DEFAULT_MAX_BLOCKFILE_MAPS);
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying and mining) */
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
@@ -227,12 +241,16 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, set while rebuilding a compact block.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
+    /** Peers asked to announce new blocks with "cmpctblock", oldest first. Protected by cs_main. */
+    std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
@@ -281,6 +299,8 @@ struct CNodeState {
     uint256 hashLastUnknownBlock;
     //! The last full block we both have.
     CBlockIndex *pindexLastCommonBlock;
+    //! The best header we have sent our peer.
+    CBlockIndex *pindexBestHeaderSent;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
     //! Since when we're stalling block download progress (in microseconds), or 0.
@@ -298,6 +318,7 @@ struct CNodeState {
         pindexBestKnownBlock = NULL;
         hashLastUnknownBlock.SetNull();
         pindexLastCommonBlock = NULL;
+        pindexBestHeaderSent = NULL;
         fSyncStarted = false;
         nStallingSince = 0;
         nBlocksInFlight = 0;
@@ -365,6 +386,7 @@ void FinalizeNode(NodeId nodeid) {
 
     BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
@@ -438,6 +460,16 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256 &hash) {
     }
 }
 
+// Requires cs_main
+bool PeerHasHeader(CNodeState *state, CBlockIndex *pindex)
+{
+    if (state->pindexBestKnownBlock && pindex == state->pindexBestKnownBlock->GetAncestor(pindex->nHeight))
+        return true;
+    if (state->pindexBestHeaderSent && pindex == state->pindexBestHeaderSent->GetAncestor(pindex->nHeight))
+        return true;
+    return false;
+}
+
 /** Find the last common ancestor two blocks have.
  *  Both pa and pb must be non-NULL. */
 CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
@@ -598,6 +630,72 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
+namespace {
+    /** Header solutions recently read back from the block tree database, most recently used first. */
+    typedef std::list<std::pair<uint256, std::vector<unsigned char> > > SolutionList;
+    CCriticalSection cs_solutionCache;
+    SolutionList listSolutionCache;
+    std::map<uint256, SolutionList::iterator> mapSolutionCache;
+    uint64_t nSolutionCacheHits = 0;
+    uint64_t nSolutionCacheMisses = 0;
+} // anon namespace
+
+std::vector<unsigned char> ReadBlockIndexSolution(const CBlockIndex* pindex)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_solutionCache);
+        std::map<uint256, SolutionList::iterator>::iterator it = mapSolutionCache.find(hash);
+        if (it != mapSolutionCache.end()) {
+            listSolutionCache.splice(listSolutionCache.begin(), listSolutionCache, it->second);
+            nSolutionCacheHits++;
+            return it->second->second;
+        }
+        nSolutionCacheMisses++;
+    }
+
+    std::vector<unsigned char> nSolution;
+    if (!pblocktree || !pblocktree->ReadBlockSolution(hash, nSolution))
+        throw std::runtime_error(strprintf("%s: cannot read the solution of block %s", __func__, hash.ToString()));
+
+    LOCK(cs_solutionCache);
+    if (!mapSolutionCache.count(hash)) {
+        listSolutionCache.push_front(std::make_pair(hash, nSolution));
+        mapSolutionCache[hash] = listSolutionCache.begin();
+        while (listSolutionCache.size() > BLOCK_SOLUTION_CACHE_SIZE) {
+            mapSolutionCache.erase(listSolutionCache.back().first);
+            listSolutionCache.pop_back();
+        }
+    }
+    return nSolution;
+}
+
+BlockIndexMemoryStats GetBlockIndexMemoryStats()
+{
+    AssertLockHeld(cs_main);
+    BlockIndexMemoryStats stats;
+    stats.nEntries = mapBlockIndex.size();
+    stats.nUsage = memusage::DynamicUsage(mapBlockIndex) + stats.nEntries * memusage::MallocUsage(sizeof(CBlockIndex));
+    BOOST_FOREACH(const BlockMap::value_type& item, mapBlockIndex) {
+        if (!item.second->nSolution.empty()) {
+            stats.nResidentSolutions++;
+            stats.nSolutionBytes += memusage::DynamicUsage(item.second->nSolution);
+        }
+    }
+    stats.nUsage += stats.nSolutionBytes;
+
+    LOCK(cs_solutionCache);
+    stats.nCachedSolutions = listSolutionCache.size();
+    BOOST_FOREACH(const SolutionList::value_type& item, listSolutionCache) {
+        stats.nCacheBytes += memusage::MallocUsage(sizeof(SolutionList::value_type) + 2 * sizeof(void*)) +
+                             memusage::DynamicUsage(item.second);
+    }
+    stats.nCacheBytes += memusage::DynamicUsage(mapSolutionCache);
+    stats.nCacheHits = nSolutionCacheHits;
+    stats.nCacheMisses = nSolutionCacheMisses;
+    return stats;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -984,8 +1082,68 @@ bool ContextualCheckTransaction(
 }
 
 
+bool CProofCheck::operator()() {
+    // PHGR proofs are only collected by the batch verifier; remember which
+    // JoinSplits went into the batch so that a failure can be attributed.
+    auto verifier = libzcash::ProofVerifier::Batch();
+    std::vector<size_t> vBatched;
+    for (size_t i = 0; i < vJoinSplits.size(); i++) {
+        const CTransaction *ptxTo = vJoinSplits[i].first;
+        unsigned int nJoinSplit = vJoinSplits[i].second;
+        const JSDescription &joinsplit = ptxTo->vjoinsplit[nJoinSplit];
+        if (!joinsplit.Verify(*pzcashParams, verifier, ptxTo->joinSplitPubKey))
+            return ::error("CProofCheck(): %s:%d joinsplit does not verify", ptxTo->GetHash().ToString(), nJoinSplit);
+        if (boost::get<libzcash::PHGRProof>(&joinsplit.proof))
+            vBatched.push_back(i);
+    }
+
+    size_t nInvalid = 0;
+    if (!verifier.verify_batch(&nInvalid)) {
+        const CTransaction *ptxTo = vJoinSplits[vBatched[nInvalid]].first;
+        return ::error("CProofCheck(): %s:%d joinsplit does not verify", ptxTo->GetHash().ToString(), vJoinSplits[vBatched[nInvalid]].second);
+    }
+    return true;
+}
+
+bool CValidationCheck::operator()() {
+    bool fOk = true;
+    switch (nType) {
+    case CHECK_SCRIPT:
+        fOk = scriptCheck();
+        break;
+    case CHECK_PROOF:
+        fOk = proofCheck();
+        break;
+    default:
+        break;
+    }
+    if (!fOk && pfFailed)
+        *pfFailed = true;
+    return fOk;
+}
+
+static CCheckQueue<CValidationCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("horizen-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/** Move checks of one kind to the check queue behind control */
+template <typename T>
+static void AddChecks(CCheckQueueControl<CValidationCheck>& control, std::vector<T>& vChecks,
+                      std::atomic<bool> *pfFailed = NULL)
+{
+    std::vector<CValidationCheck> vQueued;
+    vQueued.reserve(vChecks.size());
+    BOOST_FOREACH(T& check, vChecks)
+        vQueued.emplace_back(check, pfFailed);
+    control.Add(vQueued);
+}
+
 bool CheckTransaction(const CTransaction& tx, CValidationState &state,
-                      libzcash::ProofVerifier& verifier)
+                      libzcash::ProofVerifier& verifier,
+                      std::vector<CProofCheck> *pvChecks)
 {
     // Don't count coinbase transactions because mining skews the count
     if (!tx.IsCoinBase()) {
@@ -996,8 +1154,13 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state,
     }
 
     // Ensure that zk-SNARKs verify
-    BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
-        if (!joinsplit.Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
+    for (unsigned int i = 0; i < tx.vjoinsplit.size(); i++) {
+        if (pvChecks) {
+            // Deferred checks are those of the mempool and of block connection;
+            // a proof verified for one need not be verified again for the other.
+            if (!IsProofCached(tx.vjoinsplit[i], tx.joinSplitPubKey))
+                pvChecks->push_back(CProofCheck(tx, i));
+        } else if (!tx.vjoinsplit[i].Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
             return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
                                 REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
         }
@@ -1213,8 +1376,17 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee)
+                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool fOverrideMempoolLimit)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1234,9 +1406,28 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
 
     auto verifier = libzcash::ProofVerifier::Strict();
-    if (!CheckTransaction(tx, state, verifier))
+    std::vector<CProofCheck> vProofChecks;
+    if (!CheckTransaction(tx, state, verifier, &vProofChecks))
         return error("AcceptToMemoryPool: CheckTransaction failed");
 
+    // Verify the JoinSplit proofs of this transaction not known to be valid, in parallel if possible
+    if (!vProofChecks.empty()) {
+        CCheckQueueControl<CValidationCheck> control(nScriptCheckThreads ? &scriptcheckqueue : NULL);
+        bool fProofsOk = true;
+        if (nScriptCheckThreads) {
+            AddChecks(control, vProofChecks);
+            fProofsOk = control.Wait();
+        } else {
+            BOOST_FOREACH(CProofCheck &check, vProofChecks)
+                fProofsOk = fProofsOk && check();
+        }
+        if (!fProofsOk)
+            return state.DoS(100, error("AcceptToMemoryPool: joinsplit does not verify"),
+                             REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+        BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit)
+            CacheValidProof(joinsplit, tx.joinSplitPubKey);
+    }
+
 
     // DoS level set to 10 to be more forgiving.
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
@@ -1378,6 +1569,14 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                                 REJECT_INSUFFICIENTFEE, "insufficient fee");
         }
 
+        // A full mempool raises the fee any transaction, shielded or not, has to pay
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (mempoolRejectFee > 0 && nFees < mempoolRejectFee) {
+            return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d",
+                                      hash.ToString(), nFees, mempoolRejectFee),
+                             REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1412,6 +1611,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                          hash.ToString(),
                          nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+            return state.DoS(0, error("AcceptToMemoryPool: %s: %s", hash.ToString(), errString),
+                             REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!ContextualCheckInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
@@ -1434,12 +1645,76 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry, !IsInitialBlockDownload());
+        pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
+
+        // Add memory address and spent indexes, the inputs are still cached in view
+        if (fAddressIndex)
+            pool.addAddressIndex(entry, view);
+        if (fSpentIndex)
+            pool.addSpentIndex(entry, view);
+
+        // trim mempool and check if tx was trimmed
+        if (!fOverrideMempoolLimit) {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.exists(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     return true;
 }
 
+bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    if (mempool.getSpentIndex(key, value))
+        return true;
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetAddressIndex(uint8_t type, const uint160 &hashBytes,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressIndex(type, hashBytes, vect, nStart, nEnd))
+        return error("%s: unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetAddressUnspent(uint8_t type, const uint160 &hashBytes,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressUnspentIndex(type, hashBytes, vect))
+        return error("%s: unable to get unspent outputs for address", __func__);
+
+    return true;
+}
+
+bool GetBlockFilter(const uint256 &hash, std::vector<unsigned char> &encoded)
+{
+    if (!fBlockFilterIndex)
+        return error("%s: block filter index not enabled", __func__);
+
+    return pblocktree->ReadBlockFilter(hash, encoded);
+}
+
+bool GetBlockFilterHeader(const uint256 &hash, uint256 &filterHash, uint256 &header)
+{
+    if (!fBlockFilterIndex)
+        return error("%s: block filter index not enabled", __func__);
+
+    return pblocktree->ReadBlockFilterHeader(hash, filterHash, header);
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1455,18 +1730,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
+            if (!ReadTransactionFromDisk(txOut, hashBlock, postx))
+                return false;
             if (txOut.GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
             return true;
@@ -1532,31 +1797,114 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::M
     return true;
 }
 
+/**
+ * Find the block stored at pos in its memory-mapped block file. On success,
+ * [pbegin, pend) holds the serialized block and stays valid for as long as
+ * mapping is held. Returns false if the file cannot be mapped.
+ */
+static bool GetMappedBlock(const CDiskBlockPos& pos, std::shared_ptr<const CMappedFile>& mapping, const char*& pbegin, const char*& pend)
+{
+    // Every block is preceded by the message start and its size
+    if (pos.IsNull() || pos.nPos < 8)
+        return false;
+
+    mapping = blockFileMap.Get(pos.nFile);
+    for (int nTry = 0; nTry < 2; nTry++) {
+        if (!mapping)
+            mapping = blockFileMap.Map(pos.nFile, GetBlockPosFilename(pos, "blk"));
+        if (!mapping)
+            return false;
+        if (pos.nPos <= mapping->size()) {
+            uint32_t nSize = ReadLE32((const unsigned char*)mapping->data() + pos.nPos - 4);
+            if ((uint64_t)pos.nPos + nSize <= mapping->size()) {
+                pbegin = mapping->data() + pos.nPos;
+                pend = pbegin + nSize;
+                return true;
+            }
+        }
+        // The file grew since it was mapped
+        blockFileMap.Forget(pos.nFile);
+        mapping.reset();
+    }
+    return false;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedFile> mapping;
+    const char* pbegin;
+    const char* pend;
+    if (GetMappedBlock(pos, mapping, pbegin, pend)) {
+        CSpanReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        try {
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
+    // The block was fully validated before it was written, so its own
+    // commitments are enough to catch on-disk corruption: the merkle root
+    // covers the transactions and the proof of work the header
+    bool mutated;
+    if (block.BuildMerkleTree(&mutated) != block.hashMerkleRoot || mutated)
+        return error("ReadBlockFromDisk: hashMerkleRoot mismatch at %s", pos.ToString());
+
     // Check the header
-    if (!(CheckEquihashSolution(&block, Params()) &&
-          CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())))
+    if (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus()) ||
+        (fCheckBlockReads && !CheckEquihashSolution(&block, Params())))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
 }
 
+bool ReadTransactionFromDisk(CTransaction& txOut, uint256& hashBlock, const CDiskTxPos& postx)
+{
+    CBlockHeader header;
+    std::shared_ptr<const CMappedFile> mapping;
+    const char* pbegin;
+    const char* pend;
+    if (GetMappedBlock(postx, mapping, pbegin, pend)) {
+        CSpanReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        try {
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> txOut;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: OpenBlockFile failed", __func__);
+        try {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txOut;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2115,6 +2463,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
@@ -2139,6 +2491,20 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         outs->Clear();
         }
 
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut &out = tx.vout[k];
+                uint160 hashBytes;
+                uint8_t addressType;
+                if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, addressType))
+                    continue;
+                addressIndex.push_back(std::make_pair(
+                    CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(std::make_pair(
+                    CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // unspend nullifiers
         BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
             BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
@@ -2156,6 +2522,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
+
+                uint160 hashBytes;
+                uint8_t addressType = ADDRESS_INDEX_NONE;
+                if (fAddressIndex && GetAddressIndexKey(undo.txout.scriptPubKey, hashBytes, addressType)) {
+                    // The undo data only has the height of the last output spent of a transaction
+                    const CCoins* coins = view.AccessCoins(out.hash);
+                    addressIndex.push_back(std::make_pair(
+                        CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), undo.txout.nValue * -1));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n),
+                        CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins ? coins->nHeight : undo.nHeight)));
+                }
+                if (fSpentIndex)
+                    spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
             }
         }
     }
@@ -2171,6 +2550,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
+    // Only blocks actually disconnected from the chain, not the ones checked by
+    // VerifyDB, are removed from the indexes
+    if (fAddressIndex) {
+        if (!pblocktree->EraseAddressIndex(addressIndex))
+            return AbortNode(state, "Failed to delete address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return AbortNode(state, "Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return AbortNode(state, "Failed to write spent index");
+
     return fClean;
 }
 
@@ -2199,13 +2591,6 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
-void ThreadScriptCheck() {
-    RenameThread("horizen-scriptch");
-    scriptcheckqueue.Thread();
-}
-
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2319,6 +2704,20 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/** Stores the compact filter of a connected block, with its header chained to the one of the previous block */
+static bool WriteBlockFilterIndex(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, CValidationState& state)
+{
+    BlockFilter filter(BLOCK_FILTER_BASIC, block, blockundo);
+
+    uint256 prevFilterHash, prevHeader;
+    if (pindex->pprev != NULL && !pblocktree->ReadBlockFilterHeader(pindex->pprev->GetBlockHash(), prevFilterHash, prevHeader))
+        return AbortNode(state, "Failed to read the block filter header of the previous block");
+
+    if (!pblocktree->WriteBlockFilter(pindex->GetBlockHash(), filter.GetEncodedFilter(), filter.GetHash(), filter.ComputeHeader(prevHeader)))
+        return AbortNode(state, "Failed to write block filter index");
+    return true;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, const CChain& chain, bool fJustCheck)
 {
     const CChainParams& chainparams = Params();
@@ -2336,10 +2735,29 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     auto verifier = libzcash::ProofVerifier::Strict();
     auto disabledVerifier = libzcash::ProofVerifier::Disabled();
 
-    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
-    if (!CheckBlock(block, state, fExpensiveChecks ? verifier : disabledVerifier, !fJustCheck, !fJustCheck))
+    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in.
+    // The proofs are collected rather than verified inline, and checked in one batch per proof
+    // checking thread, which work on them while the transactions are connected below.
+    // The script checks of the transactions go to the same queue.
+    CCheckQueueControl<CValidationCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    std::vector<CProofCheck> vProofChecks;
+    if (!CheckBlock(block, state, fExpensiveChecks ? verifier : disabledVerifier, !fJustCheck, !fJustCheck,
+                    fExpensiveChecks ? &vProofChecks : NULL))
         return false;
 
+    std::vector<CProofCheck> vProofBatches(std::min(vProofChecks.size(), (size_t)std::max(nScriptCheckThreads, 1)));
+    for (size_t i = 0; i < vProofChecks.size(); i++)
+        vProofBatches[i % vProofBatches.size()].Append(vProofChecks[i]);
+    std::atomic<bool> fProofsFailed(false);
+    if (nScriptCheckThreads) {
+        AddChecks(control, vProofBatches, &fProofsFailed);
+    } else {
+        BOOST_FOREACH(CProofCheck &check, vProofBatches)
+            if (!check())
+                return state.DoS(100, error("ConnectBlock(): joinsplit does not verify"),
+                                 REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+    }
+
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == NULL ? uint256() : pindex->pprev->GetBlockHash();
     assert(hashPrevBlock == view.GetBestBlock());
@@ -2354,6 +2772,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             pindex->hashAnchor = tree.root();
             // The genesis block contained no JoinSplits
             pindex->hashAnchorEnd = pindex->hashAnchor;
+            if (fBlockFilterIndex && !WriteBlockFilterIndex(block, CBlockUndo(), pindex, state))
+                return false;
         }
         return true;
     }
@@ -2378,8 +2798,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
-
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
     int nInputs = 0;
@@ -2388,6 +2806,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
 
     // Construct the incremental merkle tree at the current
     // block position,
@@ -2441,7 +2862,45 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             std::vector<CScriptCheck> vChecks;
             if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
                 return false;
-            control.Add(vChecks);
+            AddChecks(control, vChecks);
+
+            // Index the outputs spent before they are removed from the view
+            if (fAddressIndex || fSpentIndex) {
+                const uint256 hash = tx.GetHash();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const CTxIn &input = tx.vin[j];
+                    const CTxOut &prevout = view.GetOutputFor(input);
+                    uint160 hashBytes;
+                    uint8_t addressType = ADDRESS_INDEX_NONE;
+                    GetAddressIndexKey(prevout.scriptPubKey, hashBytes, addressType);
+
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(std::make_pair(
+                            CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(
+                            CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex) {
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n),
+                            CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
+                    }
+                }
+            }
+        }
+
+        if (fAddressIndex) {
+            const uint256 hash = tx.GetHash();
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+                uint160 hashBytes;
+                uint8_t addressType;
+                if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, addressType))
+                    continue;
+                addressIndex.push_back(std::make_pair(
+                    CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k),
+                    CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
         }
 
         CTxUndo undoDummy;
@@ -2478,10 +2937,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                block.vtx[0].GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
-    if (!control.Wait())
+    if (!control.Wait()) {
+        if (fProofsFailed)
+            return state.DoS(100, error("ConnectBlock(): joinsplit does not verify"),
+                             REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
         return state.DoS(100, false);
+    }
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
+    size_t nProofCacheEntries;
+    uint64_t nProofCacheHits, nProofCacheMisses;
+    GetProofCacheStats(nProofCacheEntries, nProofCacheHits, nProofCacheMisses);
+    LogPrint("bench", "    - Verify %u joinsplit proofs [proof cache: %u entries, %u hits, %u misses]\n", (unsigned)vProofChecks.size(), nProofCacheEntries, nProofCacheHits, nProofCacheMisses);
 
     if (fJustCheck)
         return true;
@@ -2509,6 +2976,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(addressIndex))
+            return AbortNode(state, "Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return AbortNode(state, "Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return AbortNode(state, "Failed to write spent index");
+
+    if (fBlockFilterIndex && !WriteBlockFilterIndex(block, blockundo, pindex, state))
+        return false;
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2596,14 +3077,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 setDirtyFileInfo.erase(it++);
             }
             std::vector<const CBlockIndex*> vBlocks;
+            std::vector<CBlockIndex*> vWritten;
             vBlocks.reserve(setDirtyBlockIndex.size());
+            vWritten.reserve(setDirtyBlockIndex.size());
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                 vBlocks.push_back(*it);
+                vWritten.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Files to write to block index database");
             }
+            // The solutions can be read back from the database from now on
+            BOOST_FOREACH(CBlockIndex* pindex, vWritten)
+                pindex->EvictSolution();
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -2734,13 +3221,23 @@ bool static DisconnectTip(CValidationState &state) {
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     // Resurrect mempool transactions from the disconnected block.
+    std::vector<uint256> vHashUpdate;
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
         // ignore validation errors in resurrected transactions
         list<CTransaction> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, false, true)) {
             mempool.remove(tx, removed, true);
+        } else if (mempool.exists(tx.GetHash())) {
+            vHashUpdate.push_back(tx.GetHash());
+        }
     }
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in this
+    // block that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
     if (anchorBeforeDisconnect != anchorAfterDisconnect) {
         // The anchor may not change between block disconnects,
         // in which case we don't want to evict from the mempool yet!
@@ -2921,9 +3418,11 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
     // Disconnect active blocks which are no longer in the best chain.
+    bool fBlocksDisconnected = false;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
         if (!DisconnectTip(state))
             return false;
+        fBlocksDisconnected = true;
     }
 
     // Build list of new blocks to connect.
@@ -2969,6 +3468,11 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     }
     }
 
+    if (fBlocksDisconnected) {
+        // resurrected transactions skipped the size limit
+        LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    }
+
     // Callbacks/notifications for a new best chain.
     if (fInvalidFound)
         CheckForkWarningConditionsOnNewFork(vpindexToConnect.back());
@@ -2989,6 +3493,9 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock) {
     const CChainParams& chainParams = Params();
     do {
         boost::this_thread::interruption_point();
+        // Don't let the notifications of the asynchronous subscribers pile up
+        // while connecting blocks faster than they are delivered
+        LimitValidationInterfaceQueue();
 
         bool fInitialDownload;
         {
@@ -3017,12 +3524,35 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock) {
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
+                // Peers in high-bandwidth mode get the new tip as a compact block right
+                // away, which saves them the inv/getdata round trip
+                boost::scoped_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+                if ((nLocalServices & NODE_COMPACT_BLOCKS) && pblock && pblock->GetHash() == hashNewTip)
+                    pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 {
                     if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
                     {
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                        CInv inv(MSG_BLOCK, hashNewTip);
+                        if (pcmpctblock && pnode->fPreferHeaderAndIDs) {
+                            bool fKnown;
+                            {
+                                LOCK(pnode->cs_inventory);
+                                fKnown = pnode->setInventoryKnown.count(inv);
+                            }
+                            if (!fKnown) {
+                                LogPrint("cmpctblock", "%s: sending cmpctblock %s to peer=%d\n", __func__, hashNewTip.ToString(), pnode->id);
+                                pnode->PushMessage("cmpctblock", *pcmpctblock);
+                                pnode->AddInventoryKnown(inv);
+                            }
+                        }
+                        else
+                        {
+                            // Announced with "headers" or "inv" by SendMessages
+                            pnode->PushBlockHash(hashNewTip);
+                        }
                     }
                     else
                     {
@@ -3473,9 +4003,54 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
+bool CHeaderCheck::operator()() {
+    *pfValid = CheckEquihashSolution(pheader, Params()) &&
+               CheckProofOfWork(pheader->GetHash(), pheader->nBits, Params().GetConsensus());
+    return *pfValid;
+}
+
+// Only used by the headers message handler, so that header checks neither wait
+// for block connection nor need cs_main
+static CCheckQueue<CHeaderCheck> headercheckqueue(16);
+
+void ThreadHeaderCheck() {
+    RenameThread("horizen-headerch");
+    headercheckqueue.Thread();
+}
+
+void CheckHeaderSolutions(const std::vector<CBlockHeader>& headers,
+                          const std::vector<char>& vQueued, std::vector<char>& vPowChecked)
+{
+    // The queue hands out its last checks first, so queue the headers backwards
+    std::vector<CHeaderCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (size_t n = headers.size(); n-- > 0; ) {
+        if (vQueued[n])
+            vChecks.push_back(CHeaderCheck(headers[n], vPowChecked[n]));
+    }
+    if (vChecks.empty())
+        return;
+
+    CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        // The queue stops at the first failure it meets, so some of the headers
+        // may not have been checked. Check those before the first invalid one
+        // here, the ones following it are rejected by AcceptBlockHeader anyway.
+        size_t n = 0;
+        for (; n < headers.size(); n++) {
+            if (vQueued[n] && !vPowChecked[n] && !CHeaderCheck(headers[n], vPowChecked[n])())
+                break;
+        }
+        for (; n < headers.size(); n++)
+            vPowChecked[n] = false;
+    }
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
-                bool fCheckPOW, bool fCheckMerkleRoot)
+                bool fCheckPOW, bool fCheckMerkleRoot,
+                std::vector<CProofCheck> *pvProofChecks)
 {
     // These are checks that are independent of context.
 
@@ -3520,7 +4095,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
 
     // Check transactions
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state, verifier))
+        if (!CheckTransaction(tx, state, verifier, pvProofChecks))
             return error("CheckBlock(): CheckTransaction failed");
 
     unsigned int nSigOps = 0;
@@ -3662,7 +4237,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips)
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips, bool fCheckPOW)
 {
     dump_global_tips(10);
 
@@ -3686,7 +4261,7 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
         return true;
     }
 
-    if (!CheckBlockHeader(block, state))
+    if (!CheckBlockHeader(block, state, fCheckPOW))
         return false;
 
     // Get prev block index
@@ -3907,6 +4482,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Forget(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4132,6 +4708,14 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("blockfilterindex", fBlockFilterIndex);
+    LogPrintf("%s: block filter index %s\n", __func__, fBlockFilterIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -4316,6 +4900,12 @@ bool InitBlockIndex() {
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", false);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", false);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", false);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", false);
+    pblocktree->WriteFlag("blockfilterindex", fBlockFilterIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4768,7 +5358,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -4821,6 +5411,17 @@ void static ProcessGetData(CNode* pfrom)
                         LogPrint("forks", "%s():%d - Pushing block [%s]\n", __func__, __LINE__, block.GetHash().ToString() );
                         pfrom->PushMessage("block", block);
                     }
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        // A peer that fell behind is unlikely to still have the transactions
+                        // of older blocks in its mempool, send those in full
+                        if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                            LogPrint("cmpctblock", "%s: pushing cmpctblock %s to peer=%d\n", __func__, inv.hash.ToString(), pfrom->id);
+                            pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                        } else {
+                            pfrom->PushMessage("block", block);
+                        }
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
@@ -4894,7 +5495,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -4913,6 +5514,100 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/**
+ * Ask a peer that just gave us a new tip through a compact block to announce the
+ * next ones with "cmpctblock" as well, keeping at most MAX_COMPACT_BLOCKS_HB_PEERS
+ * such peers. Requires cs_main.
+ */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    if (!(nLocalServices & NODE_COMPACT_BLOCKS) || !pfrom->fSupportsCompactBlocks)
+        return;
+
+    NodeId nodeid = pfrom->GetId();
+    std::list<NodeId>::iterator it = std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), nodeid);
+    if (it != lNodesAnnouncingHeaderAndIDs.end()) {
+        lNodesAnnouncingHeaderAndIDs.erase(it);
+        lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+        return;
+    }
+
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_COMPACT_BLOCKS_HB_PEERS) {
+        // Let the longest serving peer go back to announcing with "inv"
+        NodeId nodeidOldest = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeidOldest) {
+                pnode->PushMessage("sendcmpct", false, COMPACT_BLOCKS_ENCODING_VERSION);
+                break;
+            }
+        }
+    }
+    LogPrint("cmpctblock", "%s: peer=%d set as high-bandwidth compact block source\n", __func__, nodeid);
+    pfrom->PushMessage("sendcmpct", true, COMPACT_BLOCKS_ENCODING_VERSION);
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+}
+
+/** Process a block rebuilt from a "cmpctblock", possibly completed by a "blocktxn" */
+static void ProcessReconstructedBlock(CNode* pfrom, const std::string& strCommand, CBlock& block)
+{
+    CValidationState state;
+    // The block was either requested or pushed by a high-bandwidth peer, so treat it as requested
+    ProcessNewBlock(state, pfrom, &block, true, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+        return;
+    }
+
+    LOCK(cs_main);
+    if (chainActive.Tip()->GetBlockHash() == block.GetHash())
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+}
+
+/**
+ * Checks a request for the compact filters of the blocks from nStartHeight up
+ * to stopHash (BIP 157), disconnecting the peer if it is not one we serve.
+ * The stop block must be validated, its ancestors then have filters.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t filterType, uint32_t nStartHeight, const uint256& stopHash,
+                                      uint32_t nMaxHeightRange, const CBlockIndex*& pindexStop)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fBlockFilterIndex || filterType != BLOCK_FILTER_BASIC) {
+        LogPrint("net", "peer=%d requested unsupported block filter type %d, disconnecting\n", pfrom->id, filterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(stopHash);
+    if (mi == mapBlockIndex.end() || !mi->second->IsValid(BLOCK_VALID_SCRIPTS)) {
+        LogPrint("net", "peer=%d requested block filters up to unknown block %s, disconnecting\n", pfrom->id, stopHash.ToString());
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    pindexStop = mi->second;
+
+    uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight || nStopHeight - nStartHeight >= nMaxHeightRange) {
+        LogPrint("net", "peer=%d requested block filters from height %u to %u, disconnecting\n", pfrom->id, nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    return true;
+}
+
+// Headers received and time spent accepting them, for the headers/s sync rate
+static uint64_t nHeadersAccepted = 0;
+static int64_t nTimeHeaders = 0;
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -4923,7 +5618,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         return true;
     }
 
-
+    if (!fPeerBloomFilters && (strCommand == "filterload" || strCommand == "filteradd" || strCommand == "filterclear"))
+    {
+        // Light clients are expected to use the compact block filters instead
+        LogPrint("net", "peer=%d sent %s while bloom filters are disabled, disconnecting\n", pfrom->id, SanitizeString(strCommand));
+        pfrom->fDisconnect = true;
+        return false;
+    }
 
 
     if (strCommand == "version")
@@ -5064,6 +5765,54 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION && (pfrom->nServices & NODE_COMPACT_BLOCKS) &&
+            (nLocalServices & NODE_COMPACT_BLOCKS)) {
+            // Tell the peer we understand compact blocks, but keep being announced
+            // new blocks with "inv" until it proves to be a fast block source
+            pfrom->PushMessage("sendcmpct", false, COMPACT_BLOCKS_ENCODING_VERSION);
+        }
+
+        if (pfrom->nVersion >= SENDHEADERS_VERSION) {
+            // Tell our peer we prefer to receive headers rather than inv's
+            // We send this to non-NODE NETWORK peers as well, because even
+            // non-NODE NETWORK peers can announce blocks (such as pruning
+            // nodes)
+            pfrom->PushMessage("sendheaders");
+        }
+    }
+
+
+    else if (strCommand == "sendheaders")
+    {
+        pfrom->fPreferHeaders = true;
+    }
+
+
+    else if (strCommand == "feefilter")
+    {
+        CAmount newFeeFilter = 0;
+        vRecv >> newFeeFilter;
+        if (MoneyRange(newFeeFilter)) {
+            {
+                LOCK(pfrom->cs_feeFilter);
+                pfrom->minFeeFilter = newFeeFilter;
+            }
+            LogPrint("net", "received: feefilter of %s from peer=%d\n", CFeeRate(newFeeFilter).ToString(), pfrom->id);
+        }
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == COMPACT_BLOCKS_ENCODING_VERSION && (nLocalServices & NODE_COMPACT_BLOCKS)) {
+            pfrom->fSupportsCompactBlocks = true;
+            pfrom->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+            LogPrint("cmpctblock", "peer=%d announces compact blocks, high-bandwidth=%d\n", pfrom->id, fAnnounceUsingCMPCTBLOCK);
+        }
     }
 
 
@@ -5193,7 +5942,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // Peers that understand compact blocks can usually send just the
+                        // short IDs of the transactions we already have in the mempool
+                        if (pfrom->fSupportsCompactBlocks)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -5335,6 +6089,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
             LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
             pfrom->PushMessage("headers", vHeaders);
+            // pindex can be NULL either if we sent chainActive.Tip() OR
+            // if our peer has chainActive.Tip() (and thus we are sending an empty
+            // headers message). In both cases it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            State(pfrom->GetId())->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
         }
         else
         {
@@ -5633,6 +6392,30 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        int64_t nTimeStart = GetTimeMicros();
+
+        // The Equihash solution and proof of work of a header do not depend on the
+        // chain, so check those of the new headers on the -par threads without holding
+        // cs_main. Only the headers which passed skip the checks in AcceptBlockHeader;
+        // the others are checked again there, to reject them with the usual penalty.
+        // A peer must not be able to make us check a whole batch for free, so this is
+        // only done for a continuous sequence building on a known block.
+        std::vector<char> vPowChecked(nCount, false);
+        if (nScriptCheckThreads && nCount > 1) {
+            std::vector<char> vQueued(nCount, false);
+            {
+                LOCK(cs_main);
+                bool fConnected = mapBlockIndex.count(headers[0].hashPrevBlock);
+                for (unsigned int n = 1; fConnected && n < nCount; n++)
+                    fConnected = headers[n].hashPrevBlock == headers[n - 1].GetHash();
+                for (unsigned int n = 0; fConnected && n < nCount; n++) {
+                    vQueued[n] = !mapBlockIndex.count(headers[n].GetHash());
+                }
+            }
+            CheckHeaderSolutions(headers, vQueued, vPowChecked);
+        }
+        int64_t nTimeChecked = GetTimeMicros();
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -5641,8 +6424,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
         CBlockIndex *pindexLast = NULL;
-        int cnt = 0;
-        BOOST_FOREACH(const CBlockHeader& header, headers) {
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -5650,9 +6433,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("non-continuous headers sequence");
             }
             
-            bool lookForwardTips = (++cnt == MAX_HEADERS_RESULTS);
+            bool lookForwardTips = (n + 1 == MAX_HEADERS_RESULTS);
              
-            if (!AcceptBlockHeader(header, state, &pindexLast, lookForwardTips)) {
+            if (!AcceptBlockHeader(header, state, &pindexLast, lookForwardTips, !vPowChecked[n])) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -5662,9 +6445,52 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        int64_t nTimeAccepted = GetTimeMicros();
+        nHeadersAccepted += nCount;
+        nTimeHeaders += nTimeAccepted - nTimeStart;
+        LogPrint("bench", "- Accept %u headers: %.2fms (%.0f headers/s), checking solutions: %.2fms [%u headers, %.0f headers/s]\n",
+            nCount, 0.001 * (nTimeAccepted - nTimeStart), 1000000.0 * nCount / std::max(nTimeAccepted - nTimeStart, (int64_t)1),
+            0.001 * (nTimeChecked - nTimeStart), nHeadersAccepted, 1000000.0 * nHeadersAccepted / std::max(nTimeHeaders, (int64_t)1));
+
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
+        // A short headers message extending our tip is a block announcement: fetch
+        // the blocks right away instead of waiting for the download logic in SendMessages
+        if (pindexLast && nCount <= MAX_BLOCKS_TO_ANNOUNCE && !IsInitialBlockDownload() &&
+            pindexLast->IsValid(BLOCK_VALID_TREE) && chainActive.Tip()->nChainWork <= pindexLast->nChainWork) {
+            CNodeState *nodestate = State(pfrom->GetId());
+            vector<CBlockIndex*> vToFetch;
+            CBlockIndex *pindexWalk = pindexLast;
+            // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) && !mapBlocksInFlight.count(pindexWalk->GetBlockHash()))
+                    vToFetch.push_back(pindexWalk);
+                pindexWalk = pindexWalk->pprev;
+            }
+            // If pindexWalk still isn't on our main chain, we're looking at a
+            // very large reorg at a time we think we're close to caught up to
+            // the main chain -- this shouldn't really happen. Leave it to the
+            // regular block download.
+            if (pindexWalk && chainActive.Contains(pindexWalk)) {
+                vector<CInv> vGetData;
+                // Download as much as possible, from earliest to latest.
+                BOOST_REVERSE_FOREACH(CBlockIndex *pindex, vToFetch) {
+                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                        break;
+                    // A block extending our tip can be sent as a compact block
+                    if (pfrom->fSupportsCompactBlocks && pindex->pprev == chainActive.Tip())
+                        vGetData.push_back(CInv(MSG_CMPCT_BLOCK, pindex->GetBlockHash()));
+                    else
+                        vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
+                    LogPrint("net", "Requesting block %s from peer=%d\n", pindex->GetBlockHash().ToString(), pfrom->id);
+                }
+                if (!vGetData.empty())
+                    pfrom->PushMessage("getdata", vGetData);
+            }
+        }
+
         if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
@@ -5716,6 +6542,271 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        const uint256 hash = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hash);
+        LogPrint("cmpctblock", "%s():%d - received cmpctblock %s (%u txs) peer=%d\n", __func__, __LINE__,
+            hash.ToString(), cmpctblock.BlockTxCount(), pfrom->id);
+
+        pfrom->AddInventoryKnown(inv);
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect to anything we know, get the headers first
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("invalid header received in cmpctblock");
+                }
+            }
+            if (pindex == NULL)
+                return true;
+
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            // Nothing to do if we already have the block
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fInFlightFromPeer = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+
+            // Only a block extending our tip is rebuilt from the mempool, anything
+            // else is left to the regular block download
+            if (pindex->pprev != chainActive.Tip() || !(nLocalServices & NODE_COMPACT_BLOCKS)) {
+                if (fInFlightFromPeer)
+                    pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+                return true;
+            }
+
+            if (itInFlight != mapBlocksInFlight.end() && !fInFlightFromPeer) {
+                // The block is already on its way from another peer, only take it from
+                // this one if it can be rebuilt without a round trip
+                PartiallyDownloadedBlock tempBlock(&mempool);
+                if (tempBlock.InitData(cmpctblock) != READ_STATUS_OK)
+                    return true;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!tempBlock.IsTxAvailable(i))
+                        return true;
+                }
+                fBlockReconstructed = tempBlock.FillBlock(block, std::vector<CTransaction>()) == READ_STATUS_OK;
+            } else {
+                if (!fInFlightFromPeer) {
+                    // Unsolicited announcement from a high-bandwidth peer
+                    if (State(pfrom->GetId())->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                        return true;
+                    MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+                    itInFlight = mapBlocksInFlight.find(hash);
+                }
+
+                std::shared_ptr<PartiallyDownloadedBlock>& partialBlock = itInFlight->second.second->partialBlock;
+                partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                ReadStatus status = partialBlock->InitData(cmpctblock);
+                if (status == READ_STATUS_INVALID) {
+                    MarkBlockAsReceived(hash);
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("invalid cmpctblock %s from peer=%d", hash.ToString(), pfrom->id);
+                } else if (status == READ_STATUS_FAILED) {
+                    // Short ID collision, ask for the full block
+                    partialBlock.reset();
+                    pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+                    return true;
+                }
+
+                BlockTransactionsRequest req;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock->IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty()) {
+                    if (partialBlock->FillBlock(block, std::vector<CTransaction>()) == READ_STATUS_OK) {
+                        fBlockReconstructed = true;
+                    } else {
+                        partialBlock.reset();
+                        pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+                    }
+                } else {
+                    LogPrint("cmpctblock", "%s():%d - requesting %u missing txs of block %s from peer=%d\n", __func__, __LINE__,
+                        req.indexes.size(), hash.ToString(), pfrom->id);
+                    req.blockhash = hash;
+                    pfrom->PushMessage("getblocktxn", req);
+                }
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer=%d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // The peer is far behind, let it have the full block through the usual getdata path
+            LogPrint("net", "peer=%d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer=%d sent us a getblocktxn with out-of-bounds tx indexes", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "getcfilters")
+    {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> filterType >> nStartHeight >> stopHash;
+
+        LOCK(cs_main);
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, filterType, nStartHeight, stopHash, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<unsigned char> encoded;
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++) {
+            const uint256 hash = pindexStop->GetAncestor(nHeight)->GetBlockHash();
+            if (!GetBlockFilter(hash, encoded))
+                return error("%s: block filter of %s not found", __func__, hash.ToString());
+            pfrom->PushMessage("cfilter", filterType, hash, encoded);
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders")
+    {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> filterType >> nStartHeight >> stopHash;
+
+        LOCK(cs_main);
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, filterType, nStartHeight, stopHash, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        // The header before the first requested one lets the peer check the chain of filter hashes
+        uint256 filterHash, header, prevHeader;
+        if (nStartHeight > 0) {
+            const uint256 hash = pindexStop->GetAncestor(nStartHeight - 1)->GetBlockHash();
+            if (!GetBlockFilterHeader(hash, filterHash, prevHeader))
+                return error("%s: block filter header of %s not found", __func__, hash.ToString());
+        }
+
+        std::vector<uint256> vFilterHashes;
+        vFilterHashes.reserve(pindexStop->nHeight - nStartHeight + 1);
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++) {
+            const uint256 hash = pindexStop->GetAncestor(nHeight)->GetBlockHash();
+            if (!GetBlockFilterHeader(hash, filterHash, header))
+                return error("%s: block filter header of %s not found", __func__, hash.ToString());
+            vFilterHashes.push_back(filterHash);
+        }
+        pfrom->PushMessage("cfheaders", filterType, stopHash, prevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == "getcfcheckpt")
+    {
+        uint8_t filterType;
+        uint256 stopHash;
+        vRecv >> filterType >> stopHash;
+
+        LOCK(cs_main);
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, filterType, 0, stopHash, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        uint256 filterHash, header;
+        std::vector<uint256> vHeaders;
+        vHeaders.reserve(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        for (int nHeight = CFCHECKPT_INTERVAL; nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL) {
+            const uint256 hash = pindexStop->GetAncestor(nHeight)->GetBlockHash();
+            if (!GetBlockFilterHeader(hash, filterHash, header))
+                return error("%s: block filter header of %s not found", __func__, hash.ToString());
+            vHeaders.push_back(header);
+        }
+        pfrom->PushMessage("cfcheckpt", filterType, stopHash, vHeaders);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                it->second.first != pfrom->GetId()) {
+                LogPrint("net", "peer=%d sent us block transactions for a block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = it->second.second->partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer=%d sent us block transactions not matching the cmpctblock", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Short ID collision with a mempool transaction, ask for the full block
+                it->second.second->partialBlock.reset();
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+                return true;
+            }
+        }
+
+        ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -6082,6 +7173,19 @@ bool ProcessMessages(CNode* pfrom)
 }
 
 
+/**
+ * The lowest fee rate, per 1000 bytes, a transaction must pay to get into our mempool:
+ * the rate raised by a full mempool, or the relay fee if free transactions are not
+ * accepted at all.
+ */
+static CAmount GetFeeFilterRate()
+{
+    CAmount nFeeFilter = mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
+    if (GetArg("-limitfreerelay", 15) <= 0)
+        nFeeFilter = std::max(nFeeFilter, ::minRelayTxFee.GetFeePerK());
+    return nFeeFilter;
+}
+
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6226,11 +7330,102 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             GetMainSignals().Broadcast(nTimeBestReceived);
         }
 
+        //
+        // Try sending block announcements via headers
+        //
+        {
+            // If we have less than MAX_BLOCKS_TO_ANNOUNCE in our
+            // list of block hashes we're relaying, and our peer wants
+            // headers announcements, then find the first header
+            // not yet known to our peer but would connect, and send.
+            // If no header would connect, or if we have too many
+            // blocks, or if the peer doesn't want headers, just
+            // add all to the inv queue.
+            LOCK(pto->cs_inventory);
+            vector<CBlock> vHeaders;
+            bool fRevertToInv = (!pto->fPreferHeaders || pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+            CBlockIndex *pBestIndex = NULL; // last header queued for delivery
+            ProcessBlockAvailability(pto->id); // ensure pindexBestKnownBlock is up-to-date
+
+            if (!fRevertToInv) {
+                bool fFoundStartingHeader = false;
+                // Try to find first header that our peer doesn't have, and
+                // then send all headers past that one.  If we come across any
+                // headers that aren't on chainActive, give up.
+                BOOST_FOREACH(const uint256 &hash, pto->vBlockHashesToAnnounce) {
+                    BlockMap::iterator mi = mapBlockIndex.find(hash);
+                    assert(mi != mapBlockIndex.end());
+                    CBlockIndex *pindex = mi->second;
+                    if (chainActive[pindex->nHeight] != pindex) {
+                        // Bail out if we reorged away from this block
+                        fRevertToInv = true;
+                        break;
+                    }
+                    if (pBestIndex != NULL && pindex->pprev != pBestIndex) {
+                        // This means that the list of blocks to announce don't
+                        // connect to each other.
+                        // This shouldn't really be possible to hit during
+                        // regular operation (because reorgs should take us to
+                        // a chain that has some block not on the prior chain,
+                        // which should be caught by the prior check), but one
+                        // way this could happen is by using invalidateblock /
+                        // reconsiderblock repeatedly on the tip, causing it to
+                        // be added multiple times to vBlockHashesToAnnounce.
+                        // Robustly deal with this rare situation by reverting
+                        // to an inv.
+                        fRevertToInv = true;
+                        break;
+                    }
+                    pBestIndex = pindex;
+                    if (fFoundStartingHeader) {
+                        // add this to the headers message
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else if (PeerHasHeader(&state, pindex) || pto->setInventoryKnown.count(CInv(MSG_BLOCK, hash))) {
+                        continue; // keep looking for the first new block
+                    } else if (pindex->pprev == NULL || PeerHasHeader(&state, pindex->pprev)) {
+                        // Peer doesn't have this header but they do have the prior one.
+                        // Start sending headers.
+                        fFoundStartingHeader = true;
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else {
+                        // Peer doesn't have this header or the prior one -- nothing will
+                        // connect, so bail out.
+                        fRevertToInv = true;
+                        break;
+                    }
+                }
+            }
+            if (fRevertToInv) {
+                // If falling back to using an inv, just try to inv the tip.
+                // The last entry in vBlockHashesToAnnounce was our tip at some point
+                // in the past.
+                if (!pto->vBlockHashesToAnnounce.empty()) {
+                    const uint256 &hashToAnnounce = pto->vBlockHashesToAnnounce.back();
+                    CInv inv(MSG_BLOCK, hashToAnnounce);
+                    if (!pto->setInventoryKnown.count(inv))
+                        pto->vInventoryToSend.push_back(inv);
+                }
+            } else if (!vHeaders.empty()) {
+                LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
+                    vHeaders.size(), vHeaders.front().GetHash().ToString(), vHeaders.back().GetHash().ToString(), pto->id);
+                pto->PushMessage("headers", vHeaders);
+                BOOST_FOREACH(const CBlock& header, vHeaders)
+                    pto->setInventoryKnown.insert(CInv(MSG_BLOCK, header.GetHash()));
+                state.pindexBestHeaderSent = pBestIndex;
+            }
+            pto->vBlockHashesToAnnounce.clear();
+        }
+
         //
         // Message: inventory
         //
         vector<CInv> vInv;
         vector<CInv> vInvWait;
+        CAmount filterrate = 0;
+        {
+            LOCK(pto->cs_feeFilter);
+            filterrate = pto->minFeeFilter;
+        }
         {
             LOCK(pto->cs_inventory);
             vInv.reserve(pto->vInventoryToSend.size());
@@ -6240,6 +7435,13 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 if (pto->setInventoryKnown.count(inv))
                     continue;
 
+                // Don't announce transactions the peer told us it would not accept
+                if (inv.type == MSG_TX && filterrate) {
+                    CFeeRate feeRate;
+                    if (mempool.lookupFeeRate(inv.hash, feeRate) && feeRate.GetFeePerK() < filterrate)
+                        continue;
+                }
+
                 // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
@@ -6357,6 +7559,26 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
 
+        //
+        // Message: feefilter
+        //
+        if (pto->nVersion >= FEEFILTER_VERSION && GetBoolArg("-feefilter", DEFAULT_FEEFILTER) && !pto->fWhitelisted) {
+            CAmount currentFilter = GetFeeFilterRate();
+            int64_t timeNow = GetTimeMicros();
+            if (timeNow > pto->nextSendTimeFeeFilter) {
+                if (currentFilter != pto->lastSentFeeFilter) {
+                    pto->PushMessage("feefilter", currentFilter);
+                    pto->lastSentFeeFilter = currentFilter;
+                }
+                pto->nextSendTimeFeeFilter = timeNow + GetRand(2 * AVG_FEEFILTER_BROADCAST_INTERVAL * 1000000);
+            }
+            // If the fee filter has changed substantially and it's still more than MAX_FEEFILTER_CHANGE_DELAY
+            // until scheduled broadcast, then move the broadcast to within MAX_FEEFILTER_CHANGE_DELAY.
+            else if (timeNow + MAX_FEEFILTER_CHANGE_DELAY * 1000000 < pto->nextSendTimeFeeFilter &&
+                     (currentFilter < 3 * pto->lastSentFeeFilter / 4 || currentFilter > 4 * pto->lastSentFeeFilter / 3)) {
+                pto->nextSendTimeFeeFilter = timeNow + GetRand(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
+            }
+        }
     }
     return true;
 }
@@ -22,6 +22,7 @@
 #include "versionbits.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
 #include <set>
@@ -37,8 +38,10 @@ class CCoins;
 class CCoinsViewCache;
 class CCoinsView;
 class CBlock;
+class CBlockFileMap;
 class CBlockLocator;
 class CBlockTreeDB;
+class CProofCheck;
 class CScriptCheck;
 class CValidationState;
 
@@ -51,6 +54,14 @@ static const unsigned int DEFAULT_BLOCK_MIN_SIZE = 0;
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = DEFAULT_BLOCK_MAX_SIZE / 2;
 /** Default for -blockmaxcomplexity, which control the maximum comlexity of the block during template creation **/
 static const unsigned int DEFAULT_BLOCK_MAX_COMPLEXITY_SIZE = 0;
+/** Default for -checkblockreads */
+static const bool DEFAULT_CHECKBLOCKREADS = false;
+/** Default for -compactblocks, relaying new blocks as short transaction IDs */
+static const bool DEFAULT_COMPACTBLOCKS = true;
+/** Default for -feefilter, telling peers not to announce transactions we would not accept */
+static const bool DEFAULT_FEEFILTER = true;
+/** Default for -peerbloomfilters, letting peers set bloom filters on their connection */
+static const bool DEFAULT_PEERBLOOMFILTERS = true;
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
 /** Minimum alert priority for enabling safe mode. */
@@ -63,6 +74,18 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+/** Default for -limitdescendantcount, max number of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -80,6 +103,14 @@ static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
+/** Maximum number of headers to announce when relaying blocks with headers message.*/
+static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
+/** Average delay between feefilter broadcasts in seconds. */
+static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
+/** Maximum feefilter broadcast delay after significant change. */
+static const unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Number of header solutions read back from the block tree database that are kept cached */
+static const unsigned int BLOCK_SOLUTION_CACHE_SIZE = 10000;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
@@ -122,8 +153,18 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Whether the transparent outputs and spends of every address are indexed (-addressindex) */
+extern bool fAddressIndex;
+/** Whether the input spending every transparent output is indexed (-spentindex) */
+extern bool fSpentIndex;
+/** Whether the compact filter (BIP 158) of every connected block is stored (-blockfilterindex) */
+extern bool fBlockFilterIndex;
+/** Whether peers may set bloom filters (BIP 37) on their connection (-peerbloomfilters) */
+extern bool fPeerBloomFilters;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+/** Whether the Equihash solution of every block read back from disk is verified again */
+extern bool fCheckBlockReads;
 extern bool fCheckpointsEnabled;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
@@ -167,6 +208,8 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Block files kept memory-mapped for block and transaction reads. */
+extern CBlockFileMap blockFileMap;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
@@ -198,6 +241,23 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @return True if state.IsValid()
  */
 bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp);
+/** Memory held by the block index and by the cache of header solutions */
+struct BlockIndexMemoryStats {
+    size_t nEntries;
+    // solutions still held by entries not yet written to the block tree database
+    size_t nResidentSolutions;
+    size_t nSolutionBytes;
+    // estimated total, including the resident solutions
+    size_t nUsage;
+    size_t nCachedSolutions;
+    size_t nCacheBytes;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+
+    BlockIndexMemoryStats() : nEntries(0), nResidentSolutions(0), nSolutionBytes(0), nUsage(0),
+                              nCachedSolutions(0), nCacheBytes(0), nCacheHits(0), nCacheMisses(0) {}
+};
+BlockIndexMemoryStats GetBlockIndexMemoryStats();
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -223,8 +283,10 @@ bool ProcessMessages(CNode* pfrom);
  * @param[in]   fSendTrickle    When true send the trickled data, otherwise trickle the data until true.
  */
 bool SendMessages(CNode* pto, bool fSendTrickle);
-/** Run an instance of the script checking thread */
+/** Run an instance of the script and JoinSplit proof checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block header checking thread */
+void ThreadHeaderCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -233,6 +295,18 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
+/** Retrieve the input spending an output (from memory pool, or from the spent index) */
+bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
+/** Retrieve the outputs received and spent by an address in the active chain, between two heights if not zero */
+bool GetAddressIndex(uint8_t type, const uint160 &hashBytes,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nStart = 0, int nEnd = 0);
+/** Retrieve the unspent outputs of an address in the active chain */
+bool GetAddressUnspent(uint8_t type, const uint160 &hashBytes,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+/** Retrieve the compact filter of a block from the block filter index */
+bool GetBlockFilter(const uint256 &hash, std::vector<unsigned char> &encoded);
+/** Retrieve the hash and the header of the compact filter of a block from the block filter index */
+bool GetBlockFilterHeader(const uint256 &hash, uint256 &filterHash, uint256 &header);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState &state, CBlock *pblock = NULL);
 /** Find an alternative chain tip and propagate to the network */
@@ -284,7 +358,7 @@ void PruneAndFlush();
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool fOverrideMempoolLimit=false);
 
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
@@ -379,8 +453,12 @@ bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state,
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier);
+/**
+ * Context-independent validity checks. If pvChecks is not NULL, JoinSplit proof checks
+ * are pushed onto it instead of being performed inline with verifier.
+ */
+bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier,
+                      std::vector<CProofCheck> *pvChecks = NULL);
 bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state);
 
 /** Check for standard transaction types
@@ -439,11 +517,107 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of one or more JoinSplit proofs.
+ * More than one proof is verified as a single batch.
+ * Note that this stores references to the spending transactions
+ */
+class CProofCheck
+{
+private:
+    std::vector<std::pair<const CTransaction*, unsigned int> > vJoinSplits;
+
+public:
+    CProofCheck() {}
+    CProofCheck(const CTransaction& txToIn, unsigned int nJoinSplitIn) {
+        vJoinSplits.push_back(std::make_pair(&txToIn, nJoinSplitIn));
+    }
+
+    bool operator()();
+
+    /** Move the proofs of another check into this one's batch */
+    void Append(CProofCheck &check) {
+        vJoinSplits.insert(vJoinSplits.end(), check.vJoinSplits.begin(), check.vJoinSplits.end());
+        check.vJoinSplits.clear();
+    }
+
+    void swap(CProofCheck &check) {
+        vJoinSplits.swap(check.vJoinSplits);
+    }
+};
+
+/**
+ * Closure representing the context-free checks of a block header, its
+ * Equihash solution and proof of work. The outcome is also written to
+ * *pfValid, so that the headers of a batch which passed can be accepted
+ * after the queue stopped on an invalid one.
+ * Note that this stores a reference to the header
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pheader;
+    char *pfValid;
+
+public:
+    CHeaderCheck(): pheader(NULL), pfValid(NULL) {}
+    CHeaderCheck(const CBlockHeader& headerIn, char& fValidIn) :
+        pheader(&headerIn), pfValid(&fValidIn) {}
+
+    bool operator()();
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+/**
+ * Check the Equihash solution and proof of work of the headers flagged in
+ * vQueued on the header check threads. vPowChecked[n] is set for the headers
+ * which passed and come before the first invalid one.
+ */
+void CheckHeaderSolutions(const std::vector<CBlockHeader>& headers,
+                          const std::vector<char>& vQueued, std::vector<char>& vPowChecked);
+
+/**
+ * Closure representing either a script or a proof check, so that the scripts
+ * and proofs of a block are verified by the same queue and -par threads.
+ * The check passed to the constructor is swapped into this one. If given,
+ * *pfFailed is set when it fails, to tell which kind of check failed the queue.
+ */
+class CValidationCheck
+{
+private:
+    enum { CHECK_NONE, CHECK_SCRIPT, CHECK_PROOF } nType;
+    CScriptCheck scriptCheck;
+    CProofCheck proofCheck;
+    std::atomic<bool> *pfFailed;
+
+public:
+    CValidationCheck(): nType(CHECK_NONE), pfFailed(NULL) {}
+    explicit CValidationCheck(CScriptCheck &check, std::atomic<bool> *pfFailedIn = NULL):
+        nType(CHECK_SCRIPT), pfFailed(pfFailedIn) { scriptCheck.swap(check); }
+    explicit CValidationCheck(CProofCheck &check, std::atomic<bool> *pfFailedIn = NULL):
+        nType(CHECK_PROOF), pfFailed(pfFailedIn) { proofCheck.swap(check); }
+
+    bool operator()();
+
+    void swap(CValidationCheck &check) {
+        std::swap(nType, check.nType);
+        scriptCheck.swap(check.scriptCheck);
+        proofCheck.swap(check.proofCheck);
+        std::swap(pfFailed, check.pfFailed);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the transaction at postx and the hash of the block containing it */
+bool ReadTransactionFromDisk(CTransaction& txOut, uint256& hashBlock, const CDiskTxPos& postx);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -461,7 +635,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
-                bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+                bool fCheckPOW = true, bool fCheckMerkleRoot = true,
+                std::vector<CProofCheck> *pvProofChecks = NULL);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
@@ -478,7 +653,7 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
  * If dbp is non-NULL, the file is known to already reside on disk
  */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex **pindex, bool fRequested, CDiskBlockPos* dbp, BlockSet* sForkTips = NULL);
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false);
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false, bool fCheckPOW = true);
 
 
 
@@ -38,6 +38,7 @@
 #ifdef ENABLE_MINING
 #include <functional>
 #endif
+#include <limits>
 #include <mutex>
 
 using namespace std;
@@ -99,7 +100,193 @@ public:
     }
 };
 
-void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
+// Stop looking for packages once this many in a row did not fit and the block
+// is within BLOCK_FULL_MARGIN bytes of its maximum size.
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+static const unsigned int BLOCK_FULL_MARGIN = 4000;
+
+// Transactions whose scripts passed ContextualCheckInputs() while building a
+// template on top of hashTemplateCheckedTip. Script checks only depend on the
+// spent outputs and on the active chain, so repeated getblocktemplate calls
+// on the same tip need not run them again. Guarded by cs_main.
+static std::set<uint256> setTemplateCheckedTx;
+static uint256 hashTemplateCheckedTip;
+
+// A parent always has fewer in-mempool ancestors than its children, so sorting
+// a package by ancestor count gives a valid order for the block.
+struct CompareTxIterByAncestorCount
+{
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+/**
+ * Fill the rest of the block by walking the mempool's ancestor score index,
+ * adding each transaction together with those of its ancestors that are not
+ * in the block yet. inBlock holds the mempool entries already in the block,
+ * those of the priority area. The index is kept up to date by the mempool on
+ * every add and remove, so this costs time proportional to the block rather
+ * than to the mempool.
+ */
+static void AddPackagesByAncestorScore(CBlockTemplate* pblocktemplate, CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
+                                       unsigned int nBlockMaxSize, unsigned int nBlockMinSize, unsigned int nBlockMaxComplexitySize,
+                                       bool fPrintPriority, CTxMemPool::setEntries& inBlock, uint64_t& nBlockSize, uint64_t& nBlockTx,
+                                       int& nBlockSigOps, int& nBlockComplexity, CAmount& nFees)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    CBlock *pblock = &pblocktemplate->block;
+    // The checks only hold for the tip they were done on. Transactions which
+    // left the mempool are forgotten too once the set outgrows it.
+    const uint256& hashTip = chainActive.Tip()->GetBlockHash();
+    if (hashTemplateCheckedTip != hashTip || setTemplateCheckedTx.size() > 2 * mempool.mapTx.size())
+    {
+        setTemplateCheckedTx.clear();
+        hashTemplateCheckedTip = hashTip;
+    }
+
+    CTxMemPool::setEntries failedTx;
+    int nConsecutiveFailed = 0;
+
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    for (; mi != mempool.mapTx.get<ancestor_score>().end(); ++mi)
+    {
+        CTxMemPool::txiter iter = mempool.mapTx.project<0>(mi);
+        if (inBlock.count(iter) || failedTx.count(iter))
+            continue;
+
+        // Everything after this package pays less, so once past the minimum
+        // block size there is nothing left worth including
+        if (CFeeRate(iter->GetModFeesWithAncestors(), iter->GetSizeWithAncestors()) < ::minRelayTxFee &&
+            nBlockSize >= nBlockMinSize)
+            break;
+
+        CTxMemPool::setEntries setAncestors;
+        std::string dummy;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        mempool.CalculateMemPoolAncestors(*iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        std::vector<CTxMemPool::txiter> vPackage;
+        uint64_t nPackageSize = iter->GetTxSize();
+        int nPackageComplexity = iter->GetTx().vin.size() * iter->GetTx().vin.size();
+        bool fFailedAncestor = false;
+        BOOST_FOREACH(CTxMemPool::txiter it, setAncestors)
+        {
+            if (failedTx.count(it))
+            {
+                fFailedAncestor = true;
+                break;
+            }
+            if (inBlock.count(it))
+                continue;
+            vPackage.push_back(it);
+            nPackageSize += it->GetTxSize();
+            nPackageComplexity += it->GetTx().vin.size() * it->GetTx().vin.size();
+        }
+        if (fFailedAncestor)
+        {
+            failedTx.insert(iter);
+            continue;
+        }
+        vPackage.push_back(iter);
+
+        if (nBlockSize + nPackageSize >= nBlockMaxSize ||
+            (nBlockMaxComplexitySize > 0 && nBlockComplexity + nPackageComplexity >= nBlockMaxComplexitySize))
+        {
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize + BLOCK_FULL_MARGIN > nBlockMaxSize)
+                break;
+            continue;
+        }
+
+        std::sort(vPackage.begin(), vPackage.end(), CompareTxIterByAncestorCount());
+
+        // Connect the package on a scratch view, so that a member failing
+        // halfway leaves the block and its view untouched
+        CCoinsViewCache viewPackage(&view);
+        std::vector<CAmount> vPackageFees;
+        std::vector<int64_t> vPackageSigOps;
+        int nPackageSigOps = 0;
+        bool fOutOfSigOps = false;
+        CTxMemPool::txiter itFailed = mempool.mapTx.end();
+        BOOST_FOREACH(CTxMemPool::txiter it, vPackage)
+        {
+            const CTransaction& tx = it->GetTx();
+            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff) || !viewPackage.HaveInputs(tx))
+            {
+                itFailed = it;
+                break;
+            }
+
+            unsigned int nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, viewPackage);
+            nPackageSigOps += nTxSigOps;
+            if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+            {
+                fOutOfSigOps = true;
+                break;
+            }
+
+            // Note that flags: we don't want to set mempool/IsStandard()
+            // policy here, but we still have to ensure that the block we
+            // create only contains transactions that are valid in new blocks.
+            CValidationState state;
+            if (!setTemplateCheckedTx.count(tx.GetHash()))
+            {
+                if (!ContextualCheckInputs(tx, state, viewPackage, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
+                {
+                    itFailed = it;
+                    break;
+                }
+                setTemplateCheckedTx.insert(tx.GetHash());
+            }
+
+            vPackageFees.push_back(viewPackage.GetValueIn(tx) - tx.GetValueOut());
+            vPackageSigOps.push_back(nTxSigOps);
+            UpdateCoins(tx, state, viewPackage, nHeight);
+        }
+
+        if (itFailed != mempool.mapTx.end())
+        {
+            // Neither the failing transaction nor anything spending it can be mined
+            failedTx.insert(itFailed);
+            failedTx.insert(iter);
+            continue;
+        }
+        if (fOutOfSigOps)
+        {
+            ++nConsecutiveFailed;
+            continue;
+        }
+
+        viewPackage.Flush();
+        nConsecutiveFailed = 0;
+        for (size_t i = 0; i < vPackage.size(); i++)
+        {
+            const CTransaction& tx = vPackage[i]->GetTx();
+            pblock->vtx.push_back(tx);
+            pblocktemplate->vTxFees.push_back(vPackageFees[i]);
+            pblocktemplate->vTxSigOps.push_back(vPackageSigOps[i]);
+            inBlock.insert(vPackage[i]);
+            nBlockSize += vPackage[i]->GetTxSize();
+            ++nBlockTx;
+            nBlockSigOps += vPackageSigOps[i];
+            nFees += vPackageFees[i];
+
+            if (fPrintPriority)
+            {
+                LogPrintf("fee %d feeRate %s txid %s\n",
+                    vPackageFees[i], CFeeRate(vPackageFees[i], vPackage[i]->GetTxSize()).ToString(), tx.GetHash().ToString());
+            }
+        }
+        nBlockComplexity += nPackageComplexity;
+    }
+}
+
+void UpdateTime(CBlockHeader* pblock,const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
    auto medianTimePast = pindexPrev->GetMedianTimePast();
    auto nTime = std::max(medianTimePast + 1, GetTime());
@@ -114,10 +301,10 @@ void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams,
 void GetBlockTxPriorityData(const CBlock *pblock, int nHeight, int64_t nMedianTimePast, const CCoinsViewCache& view,
                                vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
 {
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
          mi != mempool.mapTx.end(); ++mi)
     {
-        const CTransaction& tx = mi->second.GetTx();
+        const CTransaction& tx = mi->GetTx();
 
         int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
                 ? nMedianTimePast
@@ -147,14 +334,14 @@ void GetBlockTxPriorityData(const CBlock *pblock, int nHeight, int64_t nMedianTi
                 }
                 mapDependers[txin.prevout.hash].push_back(porphan);
                 porphan->setDependsOn.insert(txin.prevout.hash);
-                nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+                nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
             }
         }
 
         if (!porphan)
         {
-            dPriority = mi->second.GetPriority(nHeight);
-            nFee = mi->second.GetFee();
+            dPriority = mi->GetPriority(nHeight);
+            nFee = mi->GetFee();
             mempool.ApplyDeltas(hash, dPriority, nFee);
             nTotalIn = tx.GetValueOut() - nFee;
         }
@@ -206,17 +393,17 @@ void GetBlockTxPriorityData(const CBlock *pblock, int nHeight, int64_t nMedianTi
             porphan->feeRate = feeRate;
         }
         else
-            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->GetTx()));
     }
 }
 
 void GetBlockTxPriorityDataOld(const CBlock *pblock, int nHeight, int64_t nMedianTimePast, const CCoinsViewCache& view,
                                vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
 {
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
          mi != mempool.mapTx.end(); ++mi)
     {
-        const CTransaction& tx = mi->second.GetTx();
+        const CTransaction& tx = mi->GetTx();
 
         int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
                 ? nMedianTimePast
@@ -256,7 +443,7 @@ void GetBlockTxPriorityDataOld(const CBlock *pblock, int nHeight, int64_t nMedia
                 }
                 mapDependers[txin.prevout.hash].push_back(porphan);
                 porphan->setDependsOn.insert(txin.prevout.hash);
-                nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+                nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
                 continue;
             }
             const CCoins* coins = view.AccessCoins(txin.prevout.hash);
@@ -288,7 +475,7 @@ void GetBlockTxPriorityDataOld(const CBlock *pblock, int nHeight, int64_t nMedia
             porphan->feeRate = feeRate;
         }
         else
-            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->GetTx()));
     }
 }
 
@@ -359,21 +546,29 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         map<uint256, vector<COrphan*> > mapDependers;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        bool fDeprecatedGetBlockTemplate = GetBoolArg("-deprecatedgetblocktemplate", false);
-        if (fDeprecatedGetBlockTemplate)
-            GetBlockTxPriorityDataOld(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
-        else
-            GetBlockTxPriorityData(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
-
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
         int nBlockSigOps = 100;
         bool fSortedByFee = (nBlockPrioritySize <= 0);
 
+        // This vector will be sorted into a priority queue:
+        vector<TxPriority> vecPriority;
+        bool fDeprecatedGetBlockTemplate = GetBoolArg("-deprecatedgetblocktemplate", false);
+        // Only the priority area is filled by the priority queue below; the
+        // fee ordered rest of the block is taken from the mempool's ancestor
+        // score index, which needs no walk of the whole mempool
+        bool fAddPackages = !fDeprecatedGetBlockTemplate;
+        CTxMemPool::setEntries inBlock;
+        if (!fSortedByFee || fDeprecatedGetBlockTemplate)
+        {
+            vecPriority.reserve(mempool.mapTx.size());
+            if (fDeprecatedGetBlockTemplate)
+                GetBlockTxPriorityDataOld(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
+            else
+                GetBlockTxPriorityData(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
+        }
+
         TxPriorityCompare comparer(fSortedByFee);
         std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
@@ -410,6 +605,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             if (!fSortedByFee &&
                 ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
             {
+                if (fAddPackages)
+                    break;
                 fSortedByFee = true;
                 comparer = TxPriorityCompare(fSortedByFee);
                 std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
@@ -447,6 +644,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             nBlockSigOps += nTxSigOps;
             nFees += nTxFees;
             nBlockComplexity += nTxComplexity;
+            if (fAddPackages)
+                inBlock.insert(mempool.mapTx.find(hash));
 
             if (fPrintPriority)
             {
@@ -472,6 +671,16 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             }
         }
 
+        if (fAddPackages)
+        {
+            int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                    ? nMedianTimePast
+                    : pblock->GetBlockTime();
+            AddPackagesByAncestorScore(pblocktemplate.get(), view, nHeight, nLockTimeCutoff, nBlockMaxSize, nBlockMinSize,
+                                       nBlockMaxComplexitySize, fPrintPriority, inBlock, nBlockSize, nBlockTx, nBlockSigOps,
+                                       nBlockComplexity, nFees);
+        }
+
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
         LogPrintf("CreateNewBlock(): total size %u\n", nBlockSize);
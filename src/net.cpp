@@ -27,6 +27,9 @@
 #else
 #include <fcntl.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
@@ -91,6 +94,16 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
+SocketEventsMode nSocketEventsMode = SOCKETEVENTS_SELECT;
+#ifdef HAVE_SYS_EPOLL_H
+static SOCKET hEpollSocket = INVALID_SOCKET;
+//! Tags the epoll events of listening sockets; peer events carry the node id
+static const uint64_t EPOLL_LISTEN_SOCKET = 1ULL << 63;
+//! Nodes added to vNodes and not registered with epoll yet, guarded by cs_vNodes
+static std::vector<CNode*> vNodesEpollPending;
+//! Nodes registered with epoll by id; only used by the socket handler thread
+static std::map<NodeId, CNode*> mapNodesEpoll;
+#endif
 bool fAddressesInitialized = false;
 TLSManager tlsmanager = TLSManager();
 vector<CNode*> vNodes;
@@ -339,6 +352,46 @@ bool IsReachable(const CNetAddr& addr)
     return IsReachable(net);
 }
 
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+/** Hand a node just added to vNodes to the socket events loop. cs_vNodes must be held. */
+static void AddSocketEventsNode(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (nSocketEventsMode == SOCKETEVENTS_EPOLL)
+        vNodesEpollPending.push_back(pnode);
+#endif
+}
+
+/** Forget a node removed from vNodes. Called by the socket handler thread with cs_vNodes held. */
+static void RemoveSocketEventsNode(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    // closing the socket removes it from the epoll set
+    vNodesEpollPending.erase(remove(vNodesEpollPending.begin(), vNodesEpollPending.end(), pnode), vNodesEpollPending.end());
+    mapNodesEpoll.erase(pnode->id);
+#endif
+}
+
+/** check whether the socket handler can wait on this socket with the active backend */
+static bool IsUsableSocket(SOCKET hSocket)
+{
+    return nSocketEventsMode != SOCKETEVENTS_SELECT || IsSelectableSocket(hSocket);
+}
+
 void AddressCurrentlyConnected(const CService& addr)
 {
     addrman.Connected(addr);
@@ -417,7 +470,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsUsableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -444,26 +497,14 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
                 unsigned long err_code = 0;
                 if (bUseTLS)
                 {
-                    ssl = tlsmanager.connect(hSocket, addrConnect, err_code);
+                    // the handshake itself is driven by ThreadSocketHandler
+                    ssl = tlsmanager.startHandshake(hSocket, CLIENT_CONTEXT, err_code);
                     if (!ssl)
                     {
-                        if (err_code == TLSManager::SELECT_TIMEDOUT)
-                        {
-                            // can fail for timeout in select on fd, that is not a ssl error and we should not
-                            // consider this node as non TLS
-                            LogPrint("tls", "%s():%d - Connection to %s timedout\n",
-                                __func__, __LINE__, addrConnect.ToStringIP());
-                        }
-                        else
-                        {
-                            // Further reconnection will be made in non-TLS (unencrypted) mode
-                            vNonTLSNodesOutbound.push_back(NODE_ADDR(addrConnect.ToStringIP(), GetTimeMillis()));
-                            LogPrint("tls", "%s():%d - err_code %x, adding connection to %s vNonTLSNodesOutbound list (sz=%d)\n",
-                                __func__, __LINE__, err_code, addrConnect.ToStringIP(), vNonTLSNodesOutbound.size());
-                        }
                         CloseSocket(hSocket);
                         return NULL;
                     }
+                    tlsmanager.setClientSession(ssl, addrConnect.ToStringIPPort());
                 }
                 else
                 {
@@ -481,7 +522,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
         else
         {
             unsigned long err_code = 0;
-            ssl = tlsmanager.connect(hSocket, addrConnect, err_code);
+            ssl = tlsmanager.startHandshake(hSocket, CLIENT_CONTEXT, err_code);
             if(!ssl)
             {
                 LogPrint("tls", "%s():%d - err_code %x, connection to %s failed)\n",
@@ -489,20 +530,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
                 CloseSocket(hSocket);
                 return NULL;
             }
-        }
-        
-        // certificate validation is disabled by default    
-        if (CNode::GetTlsValidate())
-        {
-            if (ssl && !ValidatePeerCertificate(ssl))
-            {
-                LogPrintf ("TLS: ERROR: Wrong server certificate from %s. Connection will be closed.\n", addrConnect.ToString());
-        
-                SSL_shutdown(ssl);
-                CloseSocket(hSocket);
-                SSL_free(ssl);
-                return NULL;
-            }
+            tlsmanager.setClientSession(ssl, addrConnect.ToStringIPPort());
         }
 #endif  // USE_TLS
 
@@ -513,6 +541,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            AddSocketEventsNode(pnode);
         }
 
         pnode->nTimeConnected = GetTime();
@@ -549,8 +578,14 @@ void CNode::CloseSocketDisconnect()
 
             if (ssl)
             {
-                unsigned long err_code = 0;
-                tlsmanager.waitFor(SSL_SHUTDOWN, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000), err_code);
+                // Send close_notify without waiting for the peer's reply, so that a
+                // slow peer can't stall the calling thread. An unfinished handshake
+                // has nothing to shut down.
+                if (eTLSHandshake == TLS_HANDSHAKE_DONE)
+                {
+                    unsigned long err_code = 0;
+                    tlsmanager.waitFor(SSL_SHUTDOWN, hSocket, ssl, 0, err_code);
+                }
                 SSL_free(ssl);
                 ssl = NULL;
             }
@@ -695,6 +730,12 @@ void CNode::copyStats(CNodeStats &stats)
     X(nSendBytes);
     X(nRecvBytes);
     X(fWhitelisted);
+    X(fSupportsCompactBlocks);
+    X(fPreferHeaderAndIDs);
+    {
+        LOCK(cs_feeFilter);
+        X(minFeeFilter);
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -837,6 +878,10 @@ void SocketSendData(CNode *pnode)
                 LogPrint("net", "Send: connection with %s is already closed\n", pnode->addr.ToString());
                 break;
             }
+
+            // keep the data queued until the TLS handshake has completed
+            if (pnode->eTLSHandshake != TLS_HANDSHAKE_DONE)
+                break;
     
             bIsSSL = (pnode->ssl != NULL);
             
@@ -1099,7 +1144,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsUsableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1153,22 +1198,10 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         unsigned long err_code = 0;
         if (bUseTLS)
         {
-            ssl = tlsmanager.accept( hSocket, addr, err_code);
+            // the handshake itself is driven by ThreadSocketHandler
+            ssl = tlsmanager.startHandshake(hSocket, SERVER_CONTEXT, err_code);
             if(!ssl)
             {
-                if (err_code == TLSManager::SELECT_TIMEDOUT)
-                {
-                    // can fail also for timeout in select on fd, that is not a ssl error and we should not
-                    // consider this node as non TLS
-                    LogPrint("tls", "%s():%d - Connection from %s timedout\n", __func__, __LINE__, addr.ToStringIP());
-                }
-                else
-                {
-                    // Further reconnection will be made in non-TLS (unencrypted) mode
-                    vNonTLSNodesInbound.push_back(NODE_ADDR(addr.ToStringIP(), GetTimeMillis()));
-                    LogPrint("tls", "%s():%d - err_code %x, adding connection from %s vNonTLSNodesInbound list (sz=%d)\n",
-                        __func__, __LINE__, err_code, addr.ToStringIP(), vNonTLSNodesInbound.size());
-                }
                 CloseSocket(hSocket);
                 return;
             }
@@ -1189,7 +1222,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     else
     {
         unsigned long err_code = 0;
-        ssl = tlsmanager.accept( hSocket, addr, err_code);
+        ssl = tlsmanager.startHandshake(hSocket, SERVER_CONTEXT, err_code);
         if(!ssl)
         {
             LogPrint("tls", "%s():%d - err_code %x, failure accepting connection from %s\n",
@@ -1198,20 +1231,6 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
             return;
         }
     }
-    
-    // certificate validation is disabled by default    
-    if (CNode::GetTlsValidate())
-    {
-        if (ssl && !ValidatePeerCertificate(ssl))
-        {
-            LogPrintf ("TLS: ERROR: Wrong client certificate from %s. Connection will be closed.\n", addr.ToString());
-        
-            SSL_shutdown(ssl);
-            CloseSocket(hSocket);
-            SSL_free(ssl);
-            return;
-        }
-    }
 #endif // USE_TLS
 
     CNode* pnode = new CNode(hSocket, addr, "", true, ssl);
@@ -1221,6 +1240,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        AddSocketEventsNode(pnode);
     }
 }
 
@@ -1238,9 +1258,373 @@ void ThreadNonTLSPoolsCleaner()
 #endif // USE_TLS 
 
 
+static TLSHandshakeStats tlsHandshakeStats;
+static CCriticalSection cs_tlsHandshakeStats;
+
+TLSHandshakeStats GetTLSHandshakeStats()
+{
+    LOCK(cs_tlsHandshakeStats);
+    return tlsHandshakeStats;
+}
+
+#if defined(USE_TLS)
+/**
+ * Step the non-blocking TLS handshake of pnode if its socket is ready, and
+ * handle completion, failure and timeout as the blocking handshake used to:
+ * failed peers go to the non-TLS pools (when falling back is enabled), and
+ * peers that time out don't.
+ */
+static void AdvanceTLSHandshake(CNode* pnode, bool fReady)
+{
+    unsigned long err_code = 0;
+    int ret = 0;
+    bool fInvalidCertificate = false;
+    {
+        LOCK(pnode->cs_hSocket);
+
+        if (pnode->hSocket == INVALID_SOCKET || pnode->ssl == NULL)
+            return;
+
+        if (fReady) {
+            bool fWantWrite = false;
+            int64_t nStart = GetTimeMicros();
+            ret = tlsmanager.continueHandshake(pnode->ssl, fWantWrite, err_code);
+            pnode->nTLSHandshakeWork += GetTimeMicros() - nStart;
+            if (ret == 0) {
+                pnode->eTLSHandshake = fWantWrite ? TLS_HANDSHAKE_WANT_WRITE : TLS_HANDSHAKE_WANT_READ;
+                // wait for the next edge in that direction
+                if (fWantWrite)
+                    pnode->fSocketSendReady = false;
+                else
+                    pnode->fSocketRecvReady = false;
+            } else if (ret == 1) {
+                pnode->eTLSHandshake = TLS_HANDSHAKE_DONE;
+                bool fResumed = SSL_session_reused(pnode->ssl);
+                LogPrintf("TLS: connection %s %s has been established (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s%s\n",
+                    pnode->fInbound ? "from" : "to", pnode->addr.ToString(),
+                    SSL_get_version(pnode->ssl), SSL_version(pnode->ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(pnode->ssl),
+                    fResumed ? " (resumed)" : "");
+
+                {
+                    LOCK(cs_tlsHandshakeStats);
+                    int64_t nTime = GetTimeMicros() - pnode->nTLSHandshakeStart;
+                    if (fResumed) {
+                        tlsHandshakeStats.nResumed++;
+                        tlsHandshakeStats.nResumedTime += nTime;
+                        tlsHandshakeStats.nResumedWork += pnode->nTLSHandshakeWork;
+                    } else {
+                        tlsHandshakeStats.nFull++;
+                        tlsHandshakeStats.nFullTime += nTime;
+                        tlsHandshakeStats.nFullWork += pnode->nTLSHandshakeWork;
+                    }
+                }
+
+                // certificate validation is disabled by default
+                if (CNode::GetTlsValidate() && !ValidatePeerCertificate(pnode->ssl))
+                {
+                    LogPrintf ("TLS: ERROR: Wrong %s certificate from %s. Connection will be closed.\n",
+                        pnode->fInbound ? "client" : "server", pnode->addr.ToString());
+                    fInvalidCertificate = true;
+                }
+            }
+        }
+
+        if (ret == 0 && GetTimeMicros() - pnode->nTLSHandshakeStart > DEFAULT_CONNECT_TIMEOUT * 1000) {
+            err_code = TLSManager::SELECT_TIMEDOUT;
+            ret = -1;
+        }
+
+        if (ret == -1) {
+            // nothing to shut down on a connection that never got established
+            SSL_free(pnode->ssl);
+            pnode->ssl = NULL;
+        }
+    }
+
+    if (ret == 1) {
+        if (fInvalidCertificate) {
+            pnode->CloseSocketDisconnect();
+            return;
+        }
+
+        // flush whatever was queued while the handshake was running
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && pnode->fSocketSendReady)
+            SocketSendData(pnode);
+        return;
+    }
+
+    if (ret == -1) {
+        {
+            LOCK(cs_tlsHandshakeStats);
+            tlsHandshakeStats.nFailed++;
+        }
+        // don't offer a session the peer could be choking on next time
+        if (!pnode->fInbound)
+            tlsmanager.forgetClientSession(pnode->addr.ToStringIPPort());
+
+        if (err_code == TLSManager::SELECT_TIMEDOUT)
+        {
+            // a timeout is not a ssl error and we should not consider this node as non TLS
+            LogPrint("tls", "%s():%d - TLS handshake with %s timedout\n", __func__, __LINE__, pnode->addr.ToStringIP());
+        }
+        else if (CNode::GetTlsFallbackNonTls())
+        {
+            // Further reconnection will be made in non-TLS (unencrypted) mode
+            std::vector<NODE_ADDR>& vPool = pnode->fInbound ? vNonTLSNodesInbound : vNonTLSNodesOutbound;
+            CCriticalSection& csPool = pnode->fInbound ? cs_vNonTLSNodesInbound : cs_vNonTLSNodesOutbound;
+            LOCK(csPool);
+            vPool.push_back(NODE_ADDR(pnode->addr.ToStringIP(), GetTimeMillis()));
+            LogPrint("tls", "%s():%d - err_code %x, adding %s to the %s non-TLS list (sz=%d)\n",
+                __func__, __LINE__, err_code, pnode->addr.ToStringIP(), pnode->fInbound ? "inbound" : "outbound", vPool.size());
+        }
+        else
+        {
+            LogPrint("tls", "%s():%d - err_code %x, TLS handshake with %s failed\n",
+                __func__, __LINE__, err_code, pnode->addr.ToStringIP());
+        }
+        pnode->CloseSocketDisconnect();
+    }
+}
+#endif // USE_TLS
+
+/**
+ * Decide which directions of pnode the socket handler should service:
+ * * If there is data to send, only wait for sending data. As this only
+ *   happens when optimistic write failed, we choose to first drain the
+ *   write buffer in this case before receiving more. This avoids
+ *   needlessly queueing received data, if the remote peer is not themselves
+ *   receiving data. This means properly utilizing TCP flow control signalling.
+ * * Otherwise, if there is no (complete) message in the receive buffer,
+ *   or there is space left in the buffer, wait for receiving data.
+ * * (if neither of the above applies, there is certainly one message
+ *   in the receiver buffer ready to be processed).
+ * Together, that means that at least one of the following is always possible,
+ * so we don't deadlock:
+ * * We send some data.
+ * * We wait for data to be received (and disconnect after timeout).
+ * * We process a message in the buffer (message handler thread).
+ */
+static void GetSocketInterest(CNode* pnode, bool& fWantRecv, bool& fWantSend)
+{
+    // A pending TLS handshake only cares about the direction OpenSSL asked for
+    fWantRecv = pnode->eTLSHandshake == TLS_HANDSHAKE_WANT_READ;
+    fWantSend = pnode->eTLSHandshake == TLS_HANDSHAKE_WANT_WRITE;
+    if (pnode->eTLSHandshake != TLS_HANDSHAKE_DONE)
+        return;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+            fWantRecv = true;
+    }
+}
+
+/**
+ * Wait for socket events with select(). The fd_sets are rebuilt from vNodes
+ * every round, so each node's readiness flags are overwritten with this
+ * round's result.
+ */
+static void SocketEventsSelect(std::vector<bool>& vListenReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            LOCK(pnode->cs_hSocket);
+
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            bool fWantRecv, fWantSend;
+            GetSocketInterest(pnode, fWantRecv, fWantSend);
+            if (fWantSend)
+                FD_SET(pnode->hSocket, &fdsetSend);
+            else if (fWantRecv)
+                FD_SET(pnode->hSocket, &fdsetRecv);
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec/1000);
+    }
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++)
+        vListenReady[i] = FD_ISSET(vhListenSocket[i].socket, &fdsetRecv);
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            LOCK(pnode->cs_hSocket);
+
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            pnode->fSocketRecvReady = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            pnode->fSocketSendReady = FD_ISSET(pnode->hSocket, &fdsetSend);
+        }
+    }
+}
+
+/**
+ * Whether an earlier edge still has work for pnode we are allowed to do, so
+ * that the next epoll_wait must not sleep. Readiness flags set by select()
+ * are consumed every round.
+ */
+static bool HasPendingSocketWork(CNode* pnode)
+{
+    if (nSocketEventsMode != SOCKETEVENTS_EPOLL || !(pnode->fSocketRecvReady || pnode->fSocketSendReady))
+        return false;
+    bool fWantRecv, fWantSend;
+    GetSocketInterest(pnode, fWantRecv, fWantSend);
+    return (fWantRecv && pnode->fSocketRecvReady) || (fWantSend && pnode->fSocketSendReady);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * Wait for socket events with edge-triggered epoll. Peer sockets are
+ * registered once, when their node is added, and an edge sets the node's
+ * readiness flag until TLSManager::threadSocketHandler finds that a read or
+ * write would block. The cost of a round depends on the number of new nodes
+ * and events, not on the number of peers, and descriptors are not limited to
+ * FD_SETSIZE. fPendingWork tells that an earlier edge still has work to do,
+ * so that the wait must not sleep.
+ */
+static void SocketEventsEpoll(std::vector<bool>& vListenReady, bool fPendingWork)
+{
+    std::vector<CNode*> vNodesNew;
+    {
+        LOCK(cs_vNodes);
+        vNodesNew.swap(vNodesEpollPending);
+    }
+
+    // nodes are only deleted by this thread, so the pointers stay valid
+    BOOST_FOREACH(CNode* pnode, vNodesNew)
+    {
+        LOCK(pnode->cs_hSocket);
+
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = pnode->id;
+        if (epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR) {
+            LogPrintf("socket epoll_ctl error for peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+            pnode->fDisconnect = true;
+            continue;
+        }
+        // the current state is reported by the next epoll_wait
+        mapNodesEpoll[pnode->id] = pnode;
+    }
+
+    int nTimeout = fPendingWork ? 0 : 50; // frequency to poll pnode->vSend, in milliseconds
+    std::vector<struct epoll_event> vEvents(vhListenSocket.size() + mapNodesEpoll.size() + 1);
+    int nEvents = epoll_wait(hEpollSocket, &vEvents[0], vEvents.size(), nTimeout);
+    boost::this_thread::interruption_point();
+
+    if (nEvents == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        MilliSleep(nTimeout);
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        const struct epoll_event& event = vEvents[i];
+        if (event.data.u64 & EPOLL_LISTEN_SOCKET) {
+            size_t nListen = event.data.u64 & ~EPOLL_LISTEN_SOCKET;
+            if (nListen < vListenReady.size())
+                vListenReady[nListen] = true;
+            continue;
+        }
+
+        std::map<NodeId, CNode*>::iterator it = mapNodesEpoll.find((NodeId)event.data.u64);
+        if (it == mapNodesEpoll.end())
+            continue;
+        if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            it->second->fSocketRecvReady = true;
+        if (event.events & EPOLLOUT)
+            it->second->fSocketSendReady = true;
+    }
+}
+
+static bool InitSocketEventsEpoll()
+{
+    hEpollSocket = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpollSocket == INVALID_SOCKET) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        // level-triggered: at most one connection is accepted per round
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = EPOLL_LISTEN_SOCKET | i;
+        if (epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) == SOCKET_ERROR) {
+            LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+            CloseSocket(hEpollSocket);
+            return false;
+        }
+    }
+    return true;
+}
+#endif // HAVE_SYS_EPOLL_H
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fPendingWork = false;
     while (true)
     {
         //
@@ -1257,6 +1641,7 @@ void ThreadSocketHandler()
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    RemoveSocketEventsNode(pnode);
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1309,97 +1694,22 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                LOCK(pnode->cs_hSocket);
-                
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
+        std::vector<bool> vListenReady(vhListenSocket.size(), false);
+#ifdef HAVE_SYS_EPOLL_H
+        if (nSocketEventsMode == SOCKETEVENTS_EPOLL)
+            SocketEventsEpoll(vListenReady, fPendingWork);
+        else
+#endif
+            SocketEventsSelect(vListenReady);
 
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        for (size_t i = 0; i < vhListenSocket.size(); i++)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (vhListenSocket[i].socket != INVALID_SOCKET && vListenReady[i])
             {
-                AcceptConnection(hListenSocket);
+                AcceptConnection(vhListenSocket[i]);
             }
         }
 
@@ -1413,13 +1723,33 @@ void ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+        fPendingWork = false;
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
 
-            if (tlsmanager.threadSocketHandler(pnode,fdsetRecv,fdsetSend,fdsetError)==-1){
+            bool fRecv = pnode->fSocketRecvReady;
+            bool fSend = pnode->fSocketSendReady;
+            if (nSocketEventsMode == SOCKETEVENTS_EPOLL) {
+                // Readiness persists across rounds, so apply flow control here
+                bool fWantRecv, fWantSend;
+                GetSocketInterest(pnode, fWantRecv, fWantSend);
+                fRecv = fRecv && fWantRecv;
+                fSend = fSend && fWantSend;
+            }
+
+#if defined(USE_TLS)
+            if (pnode->eTLSHandshake != TLS_HANDSHAKE_DONE) {
+                AdvanceTLSHandshake(pnode, fRecv || fSend);
+                fPendingWork = fPendingWork || HasPendingSocketWork(pnode);
+                continue;
+            }
+#endif // USE_TLS
+
+            if (tlsmanager.threadSocketHandler(pnode, fRecv, fSend) == -1) {
                 continue;
             }
+            fPendingWork = fPendingWork || HasPendingSocketWork(pnode);
 
             //
             // Inactivity checking
@@ -1863,7 +2193,7 @@ bool BindListenPort(const CService &addrBind, string& strError, bool fWhiteliste
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!IsUsableSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -2038,6 +2368,14 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("TLS is not used!\n");
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (nSocketEventsMode == SOCKETEVENTS_EPOLL && !InitSocketEventsEpoll())
+    {
+        LogPrintf("%s: falling back to select() for socket events\n", __func__);
+        nSocketEventsMode = SOCKETEVENTS_SELECT;
+    }
+#endif
+
     //
     // Start threads
     //
@@ -2096,6 +2434,10 @@ void CNode::NetCleanup()
         if (hListenSocket.socket != INVALID_SOCKET)
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollSocket != INVALID_SOCKET)
+        CloseSocket(hEpollSocket);
+#endif
 
     // clean up some globals (to help leak detection)
     BOOST_FOREACH(CNode *pnode, vNodes)
@@ -2104,6 +2446,10 @@ void CNode::NetCleanup()
         delete pnode;
     vNodes.clear();
     vNodesDisconnected.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    vNodesEpollPending.clear();
+    mapNodesEpoll.clear();
+#endif
     vhListenSocket.clear();
     delete semOutbound;
     semOutbound = NULL;
@@ -2324,8 +2670,14 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     setInventoryKnown(SendBufferSize() / 1000)
 {
     ssl = sslIn;
+    // an ssl passed in has not done its handshake yet; the client speaks first
+    eTLSHandshake = ssl == NULL ? TLS_HANDSHAKE_DONE : (fInboundIn ? TLS_HANDSHAKE_WANT_READ : TLS_HANDSHAKE_WANT_WRITE);
+    nTLSHandshakeStart = GetTimeMicros();
+    nTLSHandshakeWork = 0;
     nServices = 0;
     hSocket = hSocketIn;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2352,6 +2704,12 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fGetAddr = false;
     fRelayTxes = false;
     fSentAddr = false;
+    fSupportsCompactBlocks = false;
+    fPreferHeaderAndIDs = false;
+    fPreferHeaders = false;
+    minFeeFilter = 0;
+    lastSentFeeFilter = 0;
+    nextSendTimeFeeFilter = 0;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_NET_H
 #define BITCOIN_NET_H
 
+#include "amount.h"
 #include "bloom.h"
 #include "compat.h"
 #include "hash.h"
@@ -63,6 +64,26 @@ static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 
+/** Readiness notification backends usable by the socket handler thread */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+#ifdef HAVE_SYS_EPOLL_H
+static const char * const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char * const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** Parse a -socketevents value, returning false if the mode is unknown or not compiled in */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+
+/** Progress of the non-blocking TLS handshake on CNode::ssl */
+enum TLSHandshakeState {
+    TLS_HANDSHAKE_DONE,       //!< no TLS, or the handshake has completed
+    TLS_HANDSHAKE_WANT_READ,  //!< waiting for the socket to become readable
+    TLS_HANDSHAKE_WANT_WRITE, //!< waiting for the socket to become writable
+};
+
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
@@ -156,6 +177,7 @@ extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 /** Maximum number of connections to simultaneously allow (aka connection slots) */
 extern int nMaxConnections;
+extern SocketEventsMode nSocketEventsMode;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -182,6 +204,23 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Counters of the TLS handshakes done since startup */
+struct TLSHandshakeStats {
+    uint64_t nFull;
+    uint64_t nResumed;
+    uint64_t nFailed;
+    // summed over the completed handshakes, in microseconds
+    int64_t nFullTime;
+    int64_t nResumedTime;
+    // time spent inside OpenSSL, which is what resumption saves
+    int64_t nFullWork;
+    int64_t nResumedWork;
+
+    TLSHandshakeStats() : nFull(0), nResumed(0), nFailed(0), nFullTime(0), nResumedTime(0), nFullWork(0), nResumedWork(0) {}
+};
+
+TLSHandshakeStats GetTLSHandshakeStats();
+
 class CNodeStats
 {
 public:
@@ -201,6 +240,9 @@ public:
     uint64_t nSendBytes;
     uint64_t nRecvBytes;
     bool fWhitelisted;
+    bool fSupportsCompactBlocks;
+    bool fPreferHeaderAndIDs;
+    CAmount minFeeFilter;
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
@@ -257,11 +299,20 @@ class CNode
 public:
     // OpenSSL
     SSL *ssl;
+    // Advanced by the socket handler thread; nothing is sent or received on
+    // ssl until the handshake is done. Written under cs_hSocket.
+    TLSHandshakeState eTLSHandshake;
+    int64_t nTLSHandshakeStart;
+    int64_t nTLSHandshakeWork;
 
     // socket
     uint64_t nServices;
     SOCKET hSocket;
     CCriticalSection cs_hSocket;
+    // Readiness of hSocket as last seen by the socket handler thread. With
+    // edge-triggered epoll these stay set until a recv/send would block.
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -302,6 +353,12 @@ public:
     //    until it has initialized its bloom filter.
     bool fRelayTxes;
     bool fSentAddr;
+    // Whether the peer announced, with "sendcmpct", that it understands compact blocks
+    bool fSupportsCompactBlocks;
+    // Whether the peer asked us to announce new blocks with "cmpctblock" rather than "inv"
+    bool fPreferHeaderAndIDs;
+    // Whether the peer asked us, with "sendheaders", to announce new blocks with "headers"
+    bool fPreferHeaders;
     CSemaphoreGrant grantOutbound;
     CCriticalSection cs_filter;
     CBloomFilter* pfilter;
@@ -346,6 +403,15 @@ public:
     CCriticalSection cs_inventory;
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
+    // Blocks to announce, with "headers" or "inv", the next time SendMessages runs. Protected by cs_inventory.
+    std::vector<uint256> vBlockHashesToAnnounce;
+
+    // Transactions paying less than this fee rate (per 1000 bytes) are not announced to the peer
+    CAmount minFeeFilter;
+    CCriticalSection cs_feeFilter;
+    // The fee filter we last sent to the peer, and when we will consider sending it again
+    CAmount lastSentFeeFilter;
+    int64_t nextSendTimeFeeFilter;
 
     // Ping time measurement:
     // The pong reply we're expecting, or 0 if no pong expected.
@@ -454,6 +520,12 @@ public:
         }
     }
 
+    void PushBlockHash(const uint256 &hash)
+    {
+        LOCK(cs_inventory);
+        vBlockHashesToAnnounce.push_back(hash);
+    }
+
     void AskFor(const CInv& inv);
 
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
@@ -201,6 +201,13 @@ bool ConnectSocketByName(CService &addr, SOCKET& hSocketRet, const char *pszDest
 std::string NetworkErrorString(int err);
 /** Close socket and set hSocket to INVALID_SOCKET */
 bool CloseSocket(SOCKET& hSocket);
+/**
+ * Wait up to nTimeout milliseconds for hSocket to become readable (or writable
+ * if fWrite). Returns a positive value when ready, 0 on timeout and
+ * SOCKET_ERROR on failure. Unlike select() this works for any descriptor,
+ * including those at or above FD_SETSIZE.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 /** Disable or enable blocking-mode for a socket */
 bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
 /**
@@ -83,10 +83,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
-
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
     // I||V
@@ -95,10 +91,7 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
-    bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    bool isValid = EhVerifySolution(n, k, (unsigned char*)&ss[0], ss.size(), pblock->nSolution);
     if (!isValid)
         return error("CheckEquihashSolution(): invalid solution");
 
@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "proofcache.h"
+
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "streams.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <atomic>
+#include <set>
+
+#include <boost/thread.hpp>
+#include <boost/variant/get.hpp>
+
+namespace {
+
+/**
+ * Valid JoinSplit proof cache, to avoid verifying the proofs of a
+ * shielded transaction twice (once when accepted into memory pool,
+ * and again when its block is connected)
+ */
+class CProofCache
+{
+private:
+    //! Entries are the hash of (proof type, JoinSplit description, joinSplitPubKey)
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_proofcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+public:
+    CProofCache() : nHits(0), nMisses(0) {}
+
+    static uint256 GetEntry(const JSDescription& joinsplit, const uint256& joinSplitPubKey)
+    {
+        // The proof type decides how the description is serialized, and is
+        // committed to as well, as it decides which verifier applies
+        int nTxVersion = boost::get<libzcash::GrothProof>(&joinsplit.proof) ? GROTH_TX_VERSION : PHGR_TX_VERSION;
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << nTxVersion;
+        auto os = WithTxVersion(&ss, nTxVersion);
+        os << joinsplit;
+        ss << joinSplitPubKey;
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+        if (setValid.count(entry)) {
+            nHits++;
+            return true;
+        }
+        nMisses++;
+        return false;
+    }
+
+    void Set(const uint256& entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxproofcachesize", DEFAULT_MAX_PROOF_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize)
+        {
+            // Evict a random entry, so that the cache contents cannot be
+            // predicted by an attacker flooding us with valid proofs.
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(entry);
+    }
+
+    void GetStats(size_t& nEntries, uint64_t& nHitsOut, uint64_t& nMissesOut)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+        nEntries = setValid.size();
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+CProofCache proofCache;
+
+}
+
+bool IsProofCached(const JSDescription& joinsplit, const uint256& joinSplitPubKey)
+{
+    return proofCache.Get(CProofCache::GetEntry(joinsplit, joinSplitPubKey));
+}
+
+void CacheValidProof(const JSDescription& joinsplit, const uint256& joinSplitPubKey)
+{
+    proofCache.Set(CProofCache::GetEntry(joinsplit, joinSplitPubKey));
+}
+
+void GetProofCacheStats(size_t& nEntries, uint64_t& nHits, uint64_t& nMisses)
+{
+    proofCache.GetStats(nEntries, nHits, nMisses);
+}
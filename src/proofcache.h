@@ -0,0 +1,29 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PROOFCACHE_H
+#define BITCOIN_PROOFCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class JSDescription;
+class uint256;
+
+/** Default for -maxproofcachesize, the number of verified JoinSplit proofs remembered */
+static const unsigned int DEFAULT_MAX_PROOF_CACHE_SIZE = 20000;
+
+/**
+ * Whether the proof of this JoinSplit, spent with the given joinSplitPubKey,
+ * was already found valid. Counts as a hit or a miss of the cache.
+ */
+bool IsProofCached(const JSDescription& joinsplit, const uint256& joinSplitPubKey);
+
+/** Remember that the proof of this JoinSplit is valid */
+void CacheValidProof(const JSDescription& joinsplit, const uint256& joinSplitPubKey);
+
+/** Current number of entries and lookup statistics of the proof cache */
+void GetProofCacheStats(size_t& nEntries, uint64_t& nHits, uint64_t& nMisses);
+
+#endif // BITCOIN_PROOFCACHE_H
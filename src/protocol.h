@@ -75,6 +75,12 @@ enum {
     // Bitcoin Core does not support this but a patch set called Bitcoin XT does.
     // See BIP 64 for details on how this is implemented.
     NODE_GETUTXO = (1 << 1),
+    // NODE_COMPACT_BLOCKS means the node relays blocks as header and short transaction IDs
+    // ("cmpctblock") and serves the transactions its peers could not find ("getblocktxn").
+    NODE_COMPACT_BLOCKS = (1 << 5),
+    // NODE_COMPACT_FILTERS means the node serves the compact block filters of BIP 158
+    // ("getcfilters", "getcfheaders" and "getcfcheckpt", see BIP 157).
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -153,6 +159,8 @@ enum {
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // MSG_CMPCT_BLOCK is only used in getdata, to ask for a block as a "cmpctblock".
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -10,10 +10,12 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "proofcache.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 #include "zen/delay.h"
 
 #include <stdint.h>
@@ -112,7 +114,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.pushKV("merkleroot", blockindex->hashMerkleRoot.GetHex());
     result.pushKV("time", (int64_t)blockindex->nTime);
     result.pushKV("nonce", blockindex->nNonce.GetHex());
-    result.pushKV("solution", HexStr(blockindex->nSolution));
+    result.pushKV("solution", HexStr(blockindex->GetSolution()));
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
@@ -228,17 +230,23 @@ UniValue mempoolToJSON(bool fVerbose = false)
     {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx)
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+            const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
             info.pushKV("size", (int)e.GetTxSize());
             info.pushKV("fee", ValueFromAmount(e.GetFee()));
+            info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
             info.pushKV("time", e.GetTime());
             info.pushKV("height", (int)e.GetHeight());
             info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
             info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
+            info.pushKV("descendantcount", e.GetCountWithDescendants());
+            info.pushKV("descendantsize", e.GetSizeWithDescendants());
+            info.pushKV("descendantfees", e.GetModFeesWithDescendants());
+            info.pushKV("ancestorcount", e.GetCountWithAncestors());
+            info.pushKV("ancestorsize", e.GetSizeWithAncestors());
+            info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
             const CTransaction& tx = e.GetTx();
             set<string> setDepends;
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
@@ -289,10 +297,17 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "  \"transactionid\" : {       (json object)\n"
             "    \"size\" : n,             (numeric) transaction size in bytes\n"
             "    \"fee\" : n,              (numeric) transaction fee in " + CURRENCY_UNIT + "\n"
+            "    \"modifiedfee\" : n,      (numeric) transaction fee with fee deltas used for mining priority\n"
             "    \"time\" : n,             (numeric) local time transaction entered pool in seconds since 1 Jan 1970 GMT\n"
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including this one), in zatoshis\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one), in zatoshis\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -393,6 +408,54 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilter \"hash\" ( \"filtertype\" )\n"
+            "\nReturns the compact filter (BIP 158) of a block, and the filter header committing to it.\n"
+            "Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"xxxx\",  (string) the hex encoded filter\n"
+            "  \"header\" : \"hash\"   (string) the filter header, chaining the filters of the block and of its ancestors\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    if (!fBlockFilterIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter index not enabled, restart with -blockfilterindex");
+
+    uint256 hash(uint256S(params[0].get_str()));
+
+    if (params.size() > 1 && params[1].get_str() != "basic")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown filtertype");
+
+    LOCK(cs_main);
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    if (!pblockindex->IsValid(BLOCK_VALID_SCRIPTS))
+        throw JSONRPCError(RPC_MISC_ERROR, "Block has not been connected");
+
+    std::vector<unsigned char> encoded;
+    uint256 filterHash, header;
+    if (!GetBlockFilter(hash, encoded) || !GetBlockFilterHeader(hash, filterHash, header))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Filter not found");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(encoded.begin(), encoded.end())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -882,6 +945,16 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("size", (int64_t) mempool.size());
     ret.pushKV("bytes", (int64_t) mempool.GetTotalTxSize());
     ret.pushKV("usage", (int64_t) mempool.DynamicMemoryUsage());
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.pushKV("maxmempool", (int64_t) maxmempool);
+    ret.pushKV("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK()));
+
+    size_t nProofCacheEntries;
+    uint64_t nProofCacheHits, nProofCacheMisses;
+    GetProofCacheStats(nProofCacheEntries, nProofCacheHits, nProofCacheMisses);
+    ret.pushKV("proofcachesize", (int64_t) nProofCacheEntries);
+    ret.pushKV("proofcachehits", (int64_t) nProofCacheHits);
+    ret.pushKV("proofcachemisses", (int64_t) nProofCacheMisses);
 
     if (Params().NetworkIDString() == "regtest") {
         ret.pushKV("fullyNotified", mempool.IsFullyNotified());
@@ -901,6 +974,11 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"proofcachesize\": xxxxx      (numeric) Number of verified JoinSplit proofs remembered\n"
+            "  \"proofcachehits\": xxxxx      (numeric) Proofs found in the cache since startup\n"
+            "  \"proofcachemisses\": xxxxx    (numeric) Proofs not found in the cache since startup\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -987,6 +1065,22 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue syncwithvalidationinterfacequeue(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "syncwithvalidationinterfacequeue\n"
+            "\nWaits until the asynchronous subscribers (ZMQ, AMQP) have been notified of the blocks\n"
+            "and transactions processed so far, including the current tip.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("syncwithvalidationinterfacequeue", "")
+            + HelpExampleRpc("syncwithvalidationinterfacequeue", "")
+        );
+
+    SyncWithValidationInterfaceQueue();
+    return NullUniValue;
+}
+
 UniValue getblockfinalityindex(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
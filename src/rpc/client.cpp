@@ -81,6 +81,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettxout", 1 },
     { "gettxout", 2 },
     { "gettxoutproof", 0 },
+    { "getaddressbalance", 0 },
+    { "getaddressdeltas", 0 },
+    { "getaddressmempool", 0 },
+    { "getaddresstxids", 0 },
+    { "getaddressutxos", 0 },
+    { "getspentinfo", 0 },
     { "lockunspent", 0 },
     { "lockunspent", 1 },
     { "importprivkey", 2 },
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
@@ -10,6 +11,8 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "spentindex.h"
+#include "txmempool.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -464,3 +467,380 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
 
     return NullUniValue;
 }
+
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "\nReturns an object containing information about memory usage.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockindex\": {                (object) Information about the in-memory block index\n"
+            "    \"entries\": xxxxx,            (numeric) Number of block index entries\n"
+            "    \"residentsolutions\": xxxxx,  (numeric) Equihash solutions not yet written to the block tree database\n"
+            "    \"solutionbytes\": xxxxx,      (numeric) Memory held by those solutions\n"
+            "    \"cachedsolutions\": xxxxx,    (numeric) Solutions read back from the database and kept cached\n"
+            "    \"cachebytes\": xxxxx,         (numeric) Memory held by the solution cache\n"
+            "    \"cachehits\": xxxxx,          (numeric) Solution lookups served by the cache\n"
+            "    \"cachemisses\": xxxxx,        (numeric) Solution lookups that read the database\n"
+            "    \"usage\": xxxxx               (numeric) Estimated memory usage of the block index, in bytes\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleRpc("getmemoryinfo", "")
+        );
+
+    LOCK(cs_main);
+    BlockIndexMemoryStats stats = GetBlockIndexMemoryStats();
+
+    UniValue blockindex(UniValue::VOBJ);
+    blockindex.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    blockindex.push_back(Pair("residentsolutions", (uint64_t)stats.nResidentSolutions));
+    blockindex.push_back(Pair("solutionbytes", (uint64_t)stats.nSolutionBytes));
+    blockindex.push_back(Pair("cachedsolutions", (uint64_t)stats.nCachedSolutions));
+    blockindex.push_back(Pair("cachebytes", (uint64_t)stats.nCacheBytes));
+    blockindex.push_back(Pair("cachehits", stats.nCacheHits));
+    blockindex.push_back(Pair("cachemisses", stats.nCacheMisses));
+    blockindex.push_back(Pair("usage", (uint64_t)(stats.nUsage + stats.nCacheBytes)));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blockindex", blockindex));
+    return obj;
+}
+
+static void GetAddressesFromParams(const UniValue& params, std::vector<std::pair<uint160, uint8_t> >& addresses)
+{
+    std::vector<std::string> vAddresses;
+    if (params[0].isStr()) {
+        vAddresses.push_back(params[0].get_str());
+    } else if (params[0].isObject()) {
+        UniValue values = find_value(params[0].get_obj(), "addresses");
+        if (!values.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (size_t i = 0; i < values.size(); i++)
+            vAddresses.push_back(values[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with addresses");
+    }
+
+    BOOST_FOREACH(const std::string& strAddress, vAddresses) {
+        CBitcoinAddress address(strAddress);
+        uint160 hashBytes;
+        uint8_t type;
+        if (!address.IsValid() || !GetAddressIndexKey(address.Get(), hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+static void GetHeightRangeFromParams(const UniValue& params, int& nStart, int& nEnd)
+{
+    nStart = nEnd = 0;
+    if (!params[0].isObject())
+        return;
+    UniValue startValue = find_value(params[0].get_obj(), "start");
+    UniValue endValue = find_value(params[0].get_obj(), "end");
+    if (startValue.isNum() && endValue.isNum()) {
+        nStart = startValue.get_int();
+        nEnd = endValue.get_int();
+        if (nStart <= 0 || nEnd < nStart)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be greater than zero and in order");
+    }
+}
+
+static std::string GetAddressString(uint8_t type, const uint160& hashBytes)
+{
+    return CBitcoinAddress(GetAddressIndexDestination(type, hashBytes)).ToString();
+}
+
+static const std::string strAddressesHelp =
+    "{\n"
+    "  \"addresses\"\n"
+    "    [\n"
+    "      \"address\"  (string) The base58check encoded address\n"
+    "      ,...\n"
+    "    ]\n"
+    "}\n";
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance\n"
+            "\nReturns the balance of one or more transparent addresses in the active chain (requires -addressindex).\n"
+            "\nArguments:\n"
+            + strAddressesHelp +
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": xxxxx,   (numeric) The current balance in satoshis\n"
+            "  \"received\": xxxxx,  (numeric) The total number of satoshis received, including change\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}")
+        );
+
+    std::vector<std::pair<uint160, uint8_t> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<uint160, uint8_t> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->second, it->first, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ait = addressIndex.begin(); ait != addressIndex.end(); ait++) {
+            if (ait->second > 0)
+                received += ait->second;
+            balance += ait->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos\n"
+            "\nReturns the unspent outputs of one or more transparent addresses in the active chain (requires -addressindex).\n"
+            "\nArguments:\n"
+            + strAddressesHelp +
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"  (string) The address\n"
+            "    \"txid\"  (string) The output txid\n"
+            "    \"outputIndex\"  (number) The output index\n"
+            "    \"script\"  (string) The script hex encoded\n"
+            "    \"satoshis\"  (number) The number of satoshis of the output\n"
+            "    \"height\"  (number) The block height\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}")
+        );
+
+    std::vector<std::pair<uint160, uint8_t> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, uint8_t> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!GetAddressUnspent(it->second, it->first, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", GetAddressString(it->first.type, it->first.hashBytes)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.nIndex));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.nHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getaddressdeltas\n"
+            "\nReturns all changes to the balance of one or more transparent addresses in the active chain (requires -addressindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ],\n"
+            "  \"start\" (number, optional) The start block height\n"
+            "  \"end\" (number, optional) The end block height\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"  (number) The difference of satoshis\n"
+            "    \"txid\"  (string) The related txid\n"
+            "    \"index\"  (number) The related input or output index\n"
+            "    \"blockindex\"  (number) The position of the transaction in its block\n"
+            "    \"height\"  (number) The block height\n"
+            "    \"address\"  (string) The base58check encoded address\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}'")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}")
+        );
+
+    std::vector<std::pair<uint160, uint8_t> > addresses;
+    GetAddressesFromParams(params, addresses);
+    int nStart, nEnd;
+    GetHeightRangeFromParams(params, nStart, nEnd);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<uint160, uint8_t> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->second, it->first, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        std::string strAddress = GetAddressString(it->second, it->first);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ait = addressIndex.begin(); ait != addressIndex.end(); ait++) {
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("satoshis", ait->second));
+            delta.push_back(Pair("txid", ait->first.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)ait->first.nIndex));
+            delta.push_back(Pair("blockindex", (int)ait->first.nTxIndex));
+            delta.push_back(Pair("height", (int)ait->first.nHeight));
+            delta.push_back(Pair("address", strAddress));
+            result.push_back(delta);
+        }
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids\n"
+            "\nReturns the txids of one or more transparent addresses in the active chain, in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ],\n"
+            "  \"start\" (number, optional) The start block height\n"
+            "  \"end\" (number, optional) The end block height\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}")
+        );
+
+    std::vector<std::pair<uint160, uint8_t> > addresses;
+    GetAddressesFromParams(params, addresses);
+    int nStart, nEnd;
+    GetHeightRangeFromParams(params, nStart, nEnd);
+
+    // Order the transactions of all the addresses by height and position in the block
+    std::set<std::pair<std::pair<uint32_t, uint32_t>, uint256> > txids;
+    for (std::vector<std::pair<uint160, uint8_t> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->second, it->first, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ait = addressIndex.begin(); ait != addressIndex.end(); ait++)
+            txids.insert(std::make_pair(std::make_pair(ait->first.nHeight, ait->first.nTxIndex), ait->first.txhash));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::set<std::pair<std::pair<uint32_t, uint32_t>, uint256> >::const_iterator it = txids.begin(); it != txids.end(); it++)
+        result.push_back(it->second.GetHex());
+    return result;
+}
+
+UniValue getaddressmempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressmempool\n"
+            "\nReturns the mempool deltas of one or more transparent addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            + strAddressesHelp +
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"  (string) The base58check encoded address\n"
+            "    \"txid\"  (string) The related txid\n"
+            "    \"index\"  (number) The related input or output index\n"
+            "    \"satoshis\"  (number) The difference of satoshis\n"
+            "    \"timestamp\"  (number) The time the transaction entered the mempool (seconds)\n"
+            "    \"prevtxid\"  (string) The previous txid (if spending)\n"
+            "    \"prevout\"  (number) The previous transaction output index (if spending)\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressmempool", "'{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}'")
+            + HelpExampleRpc("getaddressmempool", "{\"addresses\": [\"znnwwojWQJp1ARgbi1dqYtmnNMfihmg8m1b\"]}")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    std::vector<std::pair<uint160, uint8_t> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > indexes;
+    mempool.getAddressIndex(addresses, indexes);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::const_iterator it = indexes.begin(); it != indexes.end(); it++) {
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("address", GetAddressString(it->first.type, it->first.hashBytes)));
+        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)it->first.nIndex));
+        delta.push_back(Pair("satoshis", it->second.amount));
+        delta.push_back(Pair("timestamp", it->second.nTime));
+        if (it->first.fSpending) {
+            delta.push_back(Pair("prevtxid", it->second.prevhash.GetHex()));
+            delta.push_back(Pair("prevout", (int)it->second.nPrevOut));
+        }
+        result.push_back(delta);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"txid\" (string) The hex string of the txid\n"
+            "  \"index\" (number) The output index\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\"  (string) The transaction id\n"
+            "  \"index\"  (number) The spending input index\n"
+            "  \"height\"  (number) The height of the block of the spending transaction, -1 if in the mempool\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    UniValue txidValue = find_value(params[0].get_obj(), "txid");
+    UniValue indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.nInputIndex));
+    result.push_back(Pair("height", value.nHeight));
+    return result;
+}
@@ -108,7 +108,10 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"compactblocks\": true|false,    (boolean) Whether the peer understands compact blocks\n"
+            "    \"compactblocks_hb\": true|false, (boolean) Whether new blocks are announced to the peer as compact blocks right away\n"
+            "    \"minfeefilter\": n,             (numeric) The minimum fee rate for transactions this peer accepts, in " + CURRENCY_UNIT + "/kB\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -162,6 +165,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             obj.pushKV("inflight", heights);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
+        obj.pushKV("compactblocks", stats.fSupportsCompactBlocks);
+        obj.pushKV("compactblocks_hb", stats.fPreferHeaderAndIDs);
+        obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
 
         ret.push_back(obj);
     }
@@ -417,6 +423,15 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
             "  \"timeoffset\": xxxxx,                   (numeric) the time offset (deprecated; always 0)\n"
             "  \"connections\": xxxxx,                  (numeric) the number of connections\n"
             "  \"tls_cert_verified\": true|flase,       (boolean) true if the certificate of the current node is verified\n"
+            "  \"tls_handshakes\": {                    (object) TLS handshakes since startup\n"
+            "    \"full\": xxx,                         (numeric) handshakes with a full key exchange\n"
+            "    \"resumed\": xxx,                      (numeric) handshakes resuming an earlier session\n"
+            "    \"failed\": xxx,                       (numeric) handshakes that failed or timed out\n"
+            "    \"fullavgtime\": x.xxx,                (numeric) average duration of a full handshake, in ms\n"
+            "    \"resumedavgtime\": x.xxx,             (numeric) average duration of a resumed handshake, in ms\n"
+            "    \"fullavgwork\": x.xxx,                (numeric) average time spent in OpenSSL for a full handshake, in ms\n"
+            "    \"resumedavgwork\": x.xxx              (numeric) average time spent in OpenSSL for a resumed handshake, in ms\n"
+            "  },\n"
             "  \"networks\": [                          (array) information per network\n"
             "  {\n"
             "    \"name\": \"xxx\",                     (string) network (ipv4, ipv6 or onion)\n"
@@ -453,6 +468,16 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
     obj.pushKV("timeoffset",    0);
     obj.pushKV("connections",   (int)vNodes.size());
     obj.pushKV("tls_cert_verified", ValidateCertificate(tls_ctx_server));
+    TLSHandshakeStats tlsStats = GetTLSHandshakeStats();
+    UniValue tlsHandshakes(UniValue::VOBJ);
+    tlsHandshakes.pushKV("full", tlsStats.nFull);
+    tlsHandshakes.pushKV("resumed", tlsStats.nResumed);
+    tlsHandshakes.pushKV("failed", tlsStats.nFailed);
+    tlsHandshakes.pushKV("fullavgtime", tlsStats.nFull ? 0.001 * tlsStats.nFullTime / tlsStats.nFull : 0.0);
+    tlsHandshakes.pushKV("resumedavgtime", tlsStats.nResumed ? 0.001 * tlsStats.nResumedTime / tlsStats.nResumed : 0.0);
+    tlsHandshakes.pushKV("fullavgwork", tlsStats.nFull ? 0.001 * tlsStats.nFullWork / tlsStats.nFull : 0.0);
+    tlsHandshakes.pushKV("resumedavgwork", tlsStats.nResumed ? 0.001 * tlsStats.nResumedWork / tlsStats.nResumed : 0.0);
+    obj.pushKV("tls_handshakes", tlsHandshakes);
     obj.pushKV("networks",      GetNetworksInfo());
     obj.pushKV("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK()));
     UniValue localAddresses(UniValue::VARR);
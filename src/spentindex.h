@@ -0,0 +1,68 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** A transaction output, as looked up in the spent index */
+struct CSpentIndexKey {
+    uint256 txid;
+    uint32_t nOutputIndex;
+
+    CSpentIndexKey() : nOutputIndex(0) {}
+    CSpentIndexKey(const uint256& txidIn, unsigned int nOutputIndexIn) : txid(txidIn), nOutputIndex(nOutputIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(nOutputIndex);
+    }
+
+    friend bool operator<(const CSpentIndexKey& a, const CSpentIndexKey& b) {
+        if (a.txid != b.txid)
+            return a.txid < b.txid;
+        return a.nOutputIndex < b.nOutputIndex;
+    }
+};
+
+/**
+ * The input spending an output, with the value and address of the output.
+ * A null value erases the entry from the index.
+ */
+struct CSpentIndexValue {
+    uint256 txid;
+    uint32_t nInputIndex;
+    int nHeight;
+    CAmount satoshis;
+    uint8_t addressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() : nInputIndex(0), nHeight(0), satoshis(0), addressType(0) {}
+    CSpentIndexValue(const uint256& txidIn, unsigned int nInputIndexIn, int nHeightIn, CAmount satoshisIn,
+                     uint8_t addressTypeIn, const uint160& addressHashIn) :
+        txid(txidIn), nInputIndex(nInputIndexIn), nHeight(nHeightIn), satoshis(satoshisIn),
+        addressType(addressTypeIn), addressHash(addressHashIn) {}
+
+    bool IsNull() const { return txid.IsNull(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(nInputIndex);
+        READWRITE(nHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
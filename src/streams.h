@@ -382,6 +382,55 @@ public:
 
 
 
+/** Minimal stream for deserializing from memory owned by someone else,
+ *  such as a memory-mapped file. Nothing is copied until an object is read.
+ */
+class CSpanReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+    const char* pcur;
+
+    int nType;
+    int nVersion;
+
+public:
+    CSpanReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) :
+        pbegin(pbeginIn), pend(pendIn), pcur(pbeginIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+    size_t size() const          { return pend - pcur; }
+    bool empty() const           { return pcur == pend; }
+    size_t GetPos() const        { return pcur - pbegin; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read: end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore: end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CBlock BuildBlock(size_t nTxs)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nBits = 0x200f0f0f;
+    block.nTime = 1500000000;
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig << OP_TRUE << (int64_t)i;
+        if (i == 0)
+            tx.vin[0].prevout.SetNull();
+        else
+            tx.vin[0].prevout.hash = GetRandHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 42 + i;
+        tx.vout[0].scriptPubKey << OP_TRUE;
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblockRead;
+    stream >> cmpctblockRead;
+    BOOST_CHECK(stream.empty());
+    return cmpctblockRead;
+}
+
+BOOST_AUTO_TEST_CASE(rebuild_from_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock(5);
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 1);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 4);
+
+    CBlock blockRebuilt;
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(blockRebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(rebuild_with_missing_transactions)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock(5);
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0.0, 1));
+    pool.addUnchecked(block.vtx[4].GetHash(), CTxMemPoolEntry(block.vtx[4], 0, 0, 0.0, 1));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+
+    BlockTransactionsRequest req;
+    req.blockhash = block.GetHash();
+    for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+        if (!partialBlock.IsTxAvailable(i))
+            req.indexes.push_back(i);
+    }
+    BOOST_CHECK(req.indexes == std::vector<uint16_t>({1, 3}));
+
+    // The differentially encoded indexes must survive the round trip
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest reqRead;
+    stream >> reqRead;
+    BOOST_CHECK(reqRead.blockhash == req.blockhash);
+    BOOST_CHECK(reqRead.indexes == req.indexes);
+
+    BlockTransactions resp(reqRead);
+    for (size_t i = 0; i < reqRead.indexes.size(); i++)
+        resp.txn[i] = block.vtx[reqRead.indexes[i]];
+
+    CBlock blockRebuilt;
+    // Too few, or the wrong transactions, are caught
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, std::vector<CTransaction>(1, resp.txn[0])) == READ_STATUS_INVALID);
+    std::vector<CTransaction> vSwapped;
+    vSwapped.push_back(resp.txn[1]);
+    vSwapped.push_back(resp.txn[0]);
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, vSwapped) == READ_STATUS_FAILED);
+
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, resp.txn) == READ_STATUS_OK);
+    BOOST_CHECK(blockRebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_compact_block)
+{
+    CTxMemPool pool(CFeeRate(0));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(CBlockHeaderAndShortTxIDs()) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
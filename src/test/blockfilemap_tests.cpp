@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+static boost::filesystem::path WriteTempFile(const std::string& strData)
+{
+    boost::filesystem::path path = GetTempPath() / boost::filesystem::unique_path("blockfilemap-%%%%%%%%.dat");
+    boost::filesystem::ofstream file(path, std::ios::binary);
+    file.write(strData.data(), strData.size());
+    return path;
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(blockfilemap_lru)
+{
+    std::vector<boost::filesystem::path> vPaths;
+    for (int i = 0; i < 3; i++)
+        vPaths.push_back(WriteTempFile(strprintf("file %d", i)));
+
+    CBlockFileMap map(2);
+    std::shared_ptr<const CMappedFile> mapping0 = map.Map(0, vPaths[0]);
+    BOOST_REQUIRE(mapping0);
+    BOOST_CHECK_EQUAL(std::string(mapping0->data(), mapping0->size()), "file 0");
+    BOOST_CHECK(map.Map(1, vPaths[1]));
+    BOOST_CHECK_EQUAL(map.GetMappingCount(), 2);
+
+    // Touch file 0, so that file 1 is the one evicted by file 2
+    BOOST_CHECK(map.Get(0) == mapping0);
+    BOOST_CHECK(map.Map(2, vPaths[2]));
+    BOOST_CHECK_EQUAL(map.GetMappingCount(), 2);
+    BOOST_CHECK(map.Get(0));
+    BOOST_CHECK(!map.Get(1));
+    BOOST_CHECK(map.Get(2));
+
+    // A mapping still held by a reader outlives its eviction
+    map.Forget(0);
+    BOOST_CHECK(!map.Get(0));
+    BOOST_CHECK_EQUAL(std::string(mapping0->data(), mapping0->size()), "file 0");
+
+    // Mapping can be turned off entirely
+    map.SetMaxMappings(0);
+    BOOST_CHECK_EQUAL(map.GetMappingCount(), 0);
+    BOOST_CHECK(!map.Map(1, vPaths[1]));
+
+    BOOST_CHECK(!map.Map(3, GetTempPath() / "blockfilemap-missing.dat"));
+
+    BOOST_FOREACH(const boost::filesystem::path& path, vPaths)
+        boost::filesystem::remove(path);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(spanreader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)42 << std::string("zen");
+    std::vector<char> vch(ss.begin(), ss.end());
+
+    CSpanReader reader(vch.data(), vch.data() + vch.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 42);
+    BOOST_CHECK_EQUAL(str, "zen");
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    CSpanReader reader2(vch.data(), vch.data() + vch.size(), SER_DISK, CLIENT_VERSION);
+    reader2.ignore(sizeof(uint32_t));
+    BOOST_CHECK_EQUAL(reader2.GetPos(), sizeof(uint32_t));
+    BOOST_CHECK_THROW(reader2.ignore(vch.size()), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(read_block_mapped_and_unmapped)
+{
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(1000, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    size_t nMaxMappings = blockFileMap.GetMaxMappings();
+    for (int i = 0; i < 2; i++) {
+        blockFileMap.SetMaxMappings(i == 0 ? DEFAULT_MAX_BLOCKFILE_MAPS : 0);
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, pos));
+        BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+
+        CTransaction tx;
+        uint256 hashBlock;
+        CDiskTxPos postx(pos, GetSizeOfCompactSize(block.vtx.size()));
+        BOOST_CHECK(ReadTransactionFromDisk(tx, hashBlock, postx));
+        BOOST_CHECK(tx.GetHash() == block.vtx[0].GetHash());
+        BOOST_CHECK(hashBlock == block.GetHash());
+    }
+    blockFileMap.Forget(pos.nFile);
+    blockFileMap.SetMaxMappings(nMaxMappings);
+}
+
+BOOST_AUTO_TEST_CASE(read_block_detects_corruption)
+{
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(1001, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pos));
+
+    // Flip the last byte of the block, the lock time of its coinbase
+    {
+        boost::filesystem::fstream file(GetBlockPosFilename(pos, "blk"), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) - 1);
+        char ch = file.get();
+        file.seekp(pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) - 1);
+        file.put(ch ^ 1);
+    }
+    BOOST_CHECK(!ReadBlockFromDisk(blockRead, pos));
+    blockFileMap.Forget(pos.nFile);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "random.h"
+#include "script/script.h"
+#include "undo.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static GCSFilter::Element RandomElement()
+{
+    uint256 hash = GetRandHash();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+static GCSFilter::Element ScriptElement(const CScript& script)
+{
+    return GCSFilter::Element(script.begin(), script.end());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    GCSFilter filter(0, 0, 10, 1 << 10, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    BOOST_FOREACH(const GCSFilter::Element& element, included)
+        BOOST_CHECK(filter.Match(element));
+    BOOST_CHECK(filter.MatchAny(included));
+
+    // With a false positive rate of 1 / 1024, none of the excluded elements should match
+    BOOST_CHECK(!filter.MatchAny(excluded));
+
+    // A filter reconstructed from its encoding matches the same elements
+    GCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_FOREACH(const GCSFilter::Element& element, included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // Trailing or missing data is rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, encoded), std::ios_base::failure);
+    encoded.resize(encoded.size() - 2);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, encoded), std::ios_base::failure);
+
+    // The empty filter matches nothing
+    GCSFilter empty(0, 0, 10, 1 << 10, GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included));
+    BOOST_CHECK(empty.GetEncoded() == std::vector<unsigned char>(1, 0));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included1 = CScript() << std::vector<unsigned char>(33, 1) << OP_CHECKSIG;
+    CScript included2 = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript includedSpent = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUAL;
+    CScript excludedData = CScript() << OP_RETURN << std::vector<unsigned char>(4, 4);
+    CScript excludedUnrelated = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vout.resize(4);
+    tx.vout[0].scriptPubKey = included1;
+    tx.vout[1].scriptPubKey = included2;
+    tx.vout[2].scriptPubKey = excludedData;
+    tx.vout[3].scriptPubKey = CScript();
+
+    CBlock block;
+    block.vtx.push_back(tx);
+
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.push_back(CTxUndo());
+    blockUndo.vtxundo.back().vprevout.push_back(CTxInUndo(CTxOut(100, includedSpent)));
+
+    BlockFilter blockFilter(BLOCK_FILTER_BASIC, block, blockUndo);
+    BOOST_CHECK(blockFilter.GetBlockHash() == block.GetHash());
+
+    const GCSFilter& filter = blockFilter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 3U);
+    BOOST_CHECK(filter.Match(ScriptElement(included1)));
+    BOOST_CHECK(filter.Match(ScriptElement(included2)));
+    BOOST_CHECK(filter.Match(ScriptElement(includedSpent)));
+    BOOST_CHECK(!filter.Match(ScriptElement(excludedData)));
+    BOOST_CHECK(!filter.Match(ScriptElement(excludedUnrelated)));
+
+    // The filter is keyed by the block hash, so that it can be rebuilt from its encoding
+    BlockFilter decoded(BLOCK_FILTER_BASIC, block.GetHash(), blockFilter.GetEncodedFilter());
+    BOOST_CHECK(decoded.GetHash() == blockFilter.GetHash());
+    BOOST_CHECK(decoded.GetFilter().Match(ScriptElement(included1)));
+    BOOST_CHECK(!decoded.GetFilter().Match(ScriptElement(excludedUnrelated)));
+
+    BOOST_CHECK_THROW(BlockFilter(1, block, blockUndo), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_header_test)
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(tx);
+    BlockFilter filter(BLOCK_FILTER_BASIC, block, CBlockUndo());
+
+    // Each header commits to the filter hash and to the previous header
+    uint256 genesisHeader = filter.ComputeHeader(uint256());
+    uint256 nextHeader = filter.ComputeHeader(genesisHeader);
+    BOOST_CHECK(genesisHeader != nextHeader);
+
+    uint256 filterHash = filter.GetHash();
+    uint256 prevHeader;
+    BOOST_CHECK(genesisHeader == Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end()));
+    BOOST_CHECK(nextHeader == Hash(filterHash.begin(), filterHash.end(), genesisHeader.begin(), genesisHeader.end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
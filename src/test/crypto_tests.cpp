@@ -2,12 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/blake2b.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/common.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -248,4 +250,56 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+void TestBLAKE2b(size_t outlen, const unsigned char* personal, const std::string &in, const std::string &hexout) {
+    std::vector<unsigned char> hash(outlen);
+    CBlake2b(outlen, personal).Write((const unsigned char*)in.data(), in.size()).Finalize(&hash[0]);
+    BOOST_CHECK(hash == ParseHex(hexout));
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_testvectors) {
+    TestBLAKE2b(64, NULL, "",
+                "786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419"
+                "d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce");
+    TestBLAKE2b(64, NULL, "abc",
+                "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+                "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
+    std::string in;
+    for (int i = 0; i < 256; i++)
+        in += (char)i;
+    TestBLAKE2b(32, NULL, in, "39a7eb9fedc19aabc83425c6755dd90e6f9d0c804964a1f4aaeea3b9fb599835");
+    unsigned char personal[CBlake2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W'};
+    WriteLE32(personal + 8, 200);
+    WriteLE32(personal + 12, 9);
+    TestBLAKE2b(50, personal, "abc",
+                "52e907446f88b0d5e63e3b2ed93b9cf178cff963d9b89e2a01fe2e42f247b0a5"
+                "8f8f40ccd4471fdadee85d6ab7e69be29285");
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_finalize_with_indices) {
+    // The batched hashes of the indices must match hashing each one on its own,
+    // whether the indices fit in the last block or spill over to another one
+    std::vector<unsigned char> in(300);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = insecure_rand();
+    std::vector<uint32_t> indices(9);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = insecure_rand();
+
+    const size_t lengths[] = {0, 1, 124, 125, 128, 140, 300};
+    BOOST_FOREACH(size_t len, lengths) {
+        CBlake2b state(50);
+        state.Write(&in[0], len);
+        for (size_t count = 0; count <= indices.size(); count++) {
+            std::vector<unsigned char> hashes(count * 50 + 1);
+            state.FinalizeWithIndices(&indices[0], count, &hashes[0]);
+            for (size_t i = 0; i < count; i++) {
+                unsigned char le[4], hash[50];
+                WriteLE32(le, indices[i]);
+                CBlake2b(state).Write(le, 4).Finalize(hash);
+                BOOST_CHECK(memcmp(hash, &hashes[i * 50], 50) == 0);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+/** Test Suite for CuckooCache
+ *
+ *  1) All tests should have a deterministic result (using insecure rand
+ *  with deterministic seeds)
+ *  2) Some test methods are templated to allow for easier testing
+ *  against new versions / comparing
+ *  3) Results should be treated as a regression test, i.e., did the behavior
+ *  change significantly from what was expected. This can be OK, depending on
+ *  the nature of the change, but requires updating the tests to reflect the new
+ *  expected behavior. For example improving the hit rate may cause some tests
+ *  using BOOST_CHECK_CLOSE to fail.
+ *
+ */
+
+namespace {
+
+struct uint256Hasher
+{
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, uint256Hasher> test_cache;
+
+void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Fill a cache of the given number of megabytes with twice as many
+ * entries as it can hold, and return the fraction of the second half that
+ * is still present.
+ */
+double hit_rate_for(size_t megabytes, bool fErase)
+{
+    seed_insecure_rand(true);
+    test_cache set;
+    size_t bytes = megabytes * (1 << 20);
+    uint32_t n_insert = static_cast<uint32_t>(bytes / sizeof(uint256));
+    set.setup_bytes(bytes);
+
+    std::vector<uint256> hashes(2 * n_insert);
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+        insecure_GetRandHash(hashes[i]);
+
+    for (uint32_t i = 0; i < n_insert; ++i) {
+        set.insert(hashes[i]);
+        if (fErase)
+            set.contains(hashes[i], true);
+    }
+    for (uint32_t i = n_insert; i < hashes.size(); ++i)
+        set.insert(hashes[i]);
+
+    uint32_t count = 0;
+    for (uint32_t i = n_insert; i < hashes.size(); ++i)
+        count += set.contains(hashes[i], false);
+    return double(count) / double(n_insert);
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+/* Test that no values not inserted into the cache are read out of it.
+ *
+ * There are no repeats in the first 200000 insecure_GetRandHash calls
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    test_cache cc;
+    cc.setup_bytes(32 << 20);
+    uint256 v;
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+    }
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        BOOST_CHECK(!cc.contains(v, false));
+    }
+}
+
+/* Inserting twice the capacity must still keep most of the recent entries. */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_hit_rate)
+{
+    for (size_t megabytes = 1; megabytes <= 4; megabytes *= 2)
+        BOOST_CHECK(hit_rate_for(megabytes, false) > 0.85);
+}
+
+/* Entries that were looked up with erase=true make room for newer ones, so
+ * the recent entries survive at a higher rate than without erasure.
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_erase)
+{
+    double without_erase = hit_rate_for(1, false);
+    double with_erase = hit_rate_for(1, true);
+    BOOST_CHECK(with_erase > 0.99);
+    BOOST_CHECK(with_erase >= without_erase);
+}
+
+/* Concurrent readers erasing disjoint ranges leave the remaining entries
+ * intact.
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_erase_parallel)
+{
+    seed_insecure_rand(true);
+    test_cache set;
+    set.setup_bytes(1 << 20);
+    const uint32_t n_insert = (1 << 20) / sizeof(uint256) / 2;
+    std::vector<uint256> hashes(n_insert);
+    for (uint32_t i = 0; i < n_insert; ++i) {
+        insecure_GetRandHash(hashes[i]);
+        set.insert(hashes[i]);
+    }
+
+    const uint32_t nThreads = 3;
+    boost::thread_group threads;
+    for (uint32_t t = 0; t < nThreads; ++t) {
+        threads.create_thread([&set, &hashes, t, nThreads, n_insert]() {
+            for (uint32_t i = t; i < n_insert / 2; i += nThreads)
+                set.contains(hashes[i], true);
+        });
+    }
+    threads.join_all();
+
+    for (uint32_t i = 0; i < n_insert; ++i)
+        BOOST_CHECK(set.contains(hashes[i], false));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -99,6 +99,11 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+
+    // The header verifier, hashing I||V itself, must agree
+    std::vector<unsigned char> input(I.begin(), I.end());
+    input.insert(input.end(), V.begin(), V.end());
+    BOOST_CHECK(EhVerifySolution(n, k, input.data(), input.size(), GetMinimalFromIndices(soln, cBitLen)) == expected);
 }
 
 #ifdef ENABLE_MINING
@@ -4,6 +4,7 @@
 
 #include "chainparams.h"
 #include "main.h"
+#include "txdb.h"
 
 #include "test/test_bitcoin.h"
 
@@ -101,4 +102,26 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     BOOST_CHECK(Test());
 }
 
+BOOST_AUTO_TEST_CASE(block_index_solution_eviction)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    const uint256 hash = genesis.GetHash();
+    CBlockIndex index(genesis.GetBlockHeader());
+    index.phashBlock = &hash;
+
+    std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+    std::vector<const CBlockIndex*> vBlocks(1, &index);
+    BOOST_CHECK(pblocktree->WriteBatchSync(vFiles, 0, vBlocks));
+
+    index.EvictSolution();
+    BOOST_CHECK(index.nSolution.empty());
+    BOOST_CHECK(index.GetSolution() == genesis.nSolution);
+    BOOST_CHECK(index.GetBlockHeader().GetHash() == hash);
+
+    LOCK(cs_main);
+    BlockIndexMemoryStats stats = GetBlockIndexMemoryStats();
+    BOOST_CHECK(stats.nCachedSolutions >= 1);
+    BOOST_CHECK(stats.nCacheHits >= 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
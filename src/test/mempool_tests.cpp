@@ -101,4 +101,152 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction MakeSpend(const uint256& prevHash, uint32_t n, int nOutputs, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.hash = prevHash;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(nOutputs);
+    for (int i = 0; i < nOutputs; i++) {
+        tx.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[i].nValue = nValue;
+    }
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorDescendantStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // parent -> child -> grandchild
+    CMutableTransaction txParent = MakeSpend(uint256S("01"), 0, 1, 10 * COIN);
+    CMutableTransaction txChild = MakeSpend(txParent.GetHash(), 0, 1, 9 * COIN);
+    CMutableTransaction txGrandChild = MakeSpend(txChild.GetHash(), 0, 1, 8 * COIN);
+
+    CTxMemPoolEntry parentEntry(txParent, 1000, 0, 0.0, 1);
+    CTxMemPoolEntry childEntry(txChild, 2000, 0, 0.0, 1);
+    CTxMemPoolEntry grandChildEntry(txGrandChild, 3000, 0, 0.0, 1);
+    pool.addUnchecked(txParent.GetHash(), parentEntry);
+    pool.addUnchecked(txChild.GetHash(), childEntry);
+    pool.addUnchecked(txGrandChild.GetHash(), grandChildEntry);
+
+    size_t nSize = parentEntry.GetTxSize() + childEntry.GetTxSize() + grandChildEntry.GetTxSize();
+
+    CTxMemPool::txiter it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), nSize);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1);
+
+    it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), nSize);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 6000);
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 1);
+
+    // Prioritising the child shows up in the packages of both of its relatives
+    pool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 0.0, 500);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 6500);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetModFeesWithAncestors(), 6500);
+
+    // Mining the parent leaves the rest of the chain with one ancestor less
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    it = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 2500);
+    BOOST_CHECK(pool.GetMemPoolParents(it).empty());
+    it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 5500);
+
+    // Adding the parent back, as after a reorg, relinks the chain
+    pool.addUnchecked(txParent.GetHash(), parentEntry);
+    pool.UpdateTransactionsFromBlock(std::vector<uint256>(1, txParent.GetHash()));
+    it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 6500);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetCountWithAncestors(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // A cheap parent with a generous child is worth less than its child alone,
+    // but the child can't be mined without it
+    CMutableTransaction txParent = MakeSpend(uint256S("01"), 0, 1, 10 * COIN);
+    CMutableTransaction txChild = MakeSpend(txParent.GetHash(), 0, 1, 9 * COIN);
+    CMutableTransaction txMiddle = MakeSpend(uint256S("02"), 0, 1, 10 * COIN);
+    CMutableTransaction txLow = MakeSpend(uint256S("03"), 0, 1, 10 * COIN);
+
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 100, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 20000, 0, 0.0, 1));
+    pool.addUnchecked(txMiddle.GetHash(), CTxMemPoolEntry(txMiddle, 5000, 0, 0.0, 1));
+    pool.addUnchecked(txLow.GetHash(), CTxMemPoolEntry(txLow, 1000, 0, 0.0, 1));
+
+    std::vector<uint256> sortedOrder;
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator it = pool.mapTx.get<ancestor_score>().begin();
+    for (; it != pool.mapTx.get<ancestor_score>().end(); ++it)
+        sortedOrder.push_back(it->GetTx().GetHash());
+
+    BOOST_CHECK_EQUAL(sortedOrder.size(), 4);
+    BOOST_CHECK(sortedOrder[0] == txChild.GetHash());
+    BOOST_CHECK(sortedOrder[1] == txMiddle.GetHash());
+    BOOST_CHECK(sortedOrder[2] == txLow.GetHash());
+    BOOST_CHECK(sortedOrder[3] == txParent.GetHash());
+
+    // The parent is only evicted together with its child, whose fee it shares
+    BOOST_CHECK(pool.mapTx.get<descendant_score>().begin()->GetTx().GetHash() == txLow.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction tx1 = MakeSpend(uint256S("01"), 0, 1, 10 * COIN);
+    CMutableTransaction tx2 = MakeSpend(uint256S("02"), 0, 1, 10 * COIN);
+    CMutableTransaction tx3 = MakeSpend(tx2.GetHash(), 0, 1, 9 * COIN);
+    CMutableTransaction tx4 = MakeSpend(uint256S("04"), 0, 1, 10 * COIN);
+
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000, 0, 0.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000, 0, 0.0, 1));
+    pool.TrimToSize(pool.DynamicMemoryUsage()); // should do nothing
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // tx3 pays for its parent, so tx1 and the tx2+tx3 package are close
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, 0, 0.0, 1));
+    size_t nUsage = pool.DynamicMemoryUsage();
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 100, 0, 0.0, 1));
+    pool.TrimToSize(nUsage);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+    BOOST_CHECK(!pool.exists(tx4.GetHash()));
+
+    // The evicted feerate plus the relay fee is now needed to get in
+    CAmount nMinFeePerK = pool.GetMinFee(1).GetFeePerK();
+    BOOST_CHECK_EQUAL(nMinFeePerK, CFeeRate(100, ::GetSerializeSize(CTransaction(tx4), SER_NETWORK, PROTOCOL_VERSION)).GetFeePerK() + 1000);
+
+    // Evicting a package removes all of it
+    pool.TrimToSize(1);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK(pool.GetMinFee(1).GetFeePerK() > nMinFeePerK);
+
+    // The minimum fee only decays once a block has been seen
+    std::vector<CTransaction> vtx;
+    std::list<CTransaction> conflicts;
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+    pool.removeForBlock(vtx, 1, conflicts);
+    SetMockTime(nTime + CTxMemPool::ROLLING_FEE_HALFLIFE * 20);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
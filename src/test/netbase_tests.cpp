@@ -162,4 +162,22 @@ BOOST_AUTO_TEST_CASE(netbase_getgroup)
     BOOST_CHECK(CNetAddr("2001:2001:9999:9999:9999:9999:9999:9999").GetGroup() == boost::assign::list_of((unsigned char)NET_IPV6)(32)(1)(32)(1)); //IPv6
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(netbase_waitforsocket)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SOCKET hSend = fds[0], hRecv = fds[1];
+
+    BOOST_CHECK_EQUAL(WaitForSocket(hRecv, false, 0), 0);
+    BOOST_CHECK(WaitForSocket(hSend, true, 0) > 0);
+    char ch = 0;
+    BOOST_CHECK_EQUAL(send(hSend, &ch, 1, 0), 1);
+    BOOST_CHECK(WaitForSocket(hRecv, false, 1000) > 0);
+
+    CloseSocket(hSend);
+    CloseSocket(hRecv);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
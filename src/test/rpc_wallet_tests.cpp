@@ -1196,6 +1196,10 @@ BOOST_AUTO_TEST_CASE(rpc_z_sendmany_internals)
         std::shared_ptr<AsyncRPCOperation_sendmany> ptr = std::dynamic_pointer_cast<AsyncRPCOperation_sendmany> (operation);
         TEST_FRIEND_AsyncRPCOperation_sendmany proxy(ptr);
 
+        // Let two JoinSplits be in flight at once whatever the number of cores,
+        // proofs are off in test mode
+        proxy.set_joinsplit_threads(2);
+
         // Enable test mode so tx is not sent and proofs are not generated
         static_cast<AsyncRPCOperation_sendmany *>(operation.get())->testmode = true;
 
@@ -1238,6 +1242,26 @@ BOOST_AUTO_TEST_CASE(rpc_z_sendmany_internals)
         } catch (const std::runtime_error & e) {
             BOOST_CHECK( string(e.what()).find("error verifying joinsplit")!= string::npos);
         }
+
+        // Queued JoinSplits are proved by workers, whose errors are reported in order
+        // when the JoinSplits are added to the transaction
+        anchor = ZCIncrementalMerkleTree().root();
+        proxy.queue_joinsplit(info, witnesses, anchor);
+        proxy.queue_joinsplit(info, witnesses, anchor);
+        try {
+            proxy.add_pending_joinsplits(1);
+            BOOST_FAIL("should have failed");
+        } catch (const std::runtime_error & e) {
+            BOOST_CHECK( string(e.what()).find("error verifying joinsplit")!= string::npos);
+        }
+        try {
+            proxy.add_pending_joinsplits();
+            BOOST_FAIL("should have failed");
+        } catch (const std::runtime_error & e) {
+            BOOST_CHECK( string(e.what()).find("error verifying joinsplit")!= string::npos);
+        }
+        BOOST_CHECK(proxy.add_pending_joinsplits().empty());
+        BOOST_CHECK_EQUAL(proxy.getTx().vjoinsplit.size(), 0);
     }
 
 }
@@ -249,6 +249,24 @@ BOOST_AUTO_TEST_CASE(compactsize)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bigendian32)
+{
+    // Keys serialized big endian compare bytewise in numerical order, as database keys do
+    uint32_t values[] = {0, 1, 255, 256, 65535, 65536, 0x01000000, 0xffffffff};
+    std::string strPrev;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        CDataStream ss(SER_DISK, 0);
+        ss << BIGENDIAN32(values[i]);
+        BOOST_CHECK_EQUAL(ss.size(), 4);
+        BOOST_CHECK(i == 0 || strPrev < ss.str());
+        strPrev = ss.str();
+
+        uint32_t n = 0;
+        ss >> BIGENDIAN32(n);
+        BOOST_CHECK_EQUAL(n, values[i]);
+    }
+}
+
 static bool isCanonicalException(const std::ios_base::failure& ex)
 {
     std::ios_base::failure expectedException("non-canonical ReadCompactSize()");
@@ -11,6 +11,7 @@
 #include "key.h"
 #include "main.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -68,6 +69,7 @@ BasicTestingSetup::BasicTestingSetup()
     fPrintToDebugLog = false; // don't want to write to debug.log file
     fCheckBlockIndex = true;
     SelectParams(CBaseChainParams::MAIN);
+    InitSignatureCache();
 }
 BasicTestingSetup::~BasicTestingSetup()
 {
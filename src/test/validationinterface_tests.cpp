@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Zencash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "primitives/block.h"
+#include "random.h"
+#include "utiltime.h"
+#include "validationinterface.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+class CTestSubscriber : public CValidationInterface
+{
+public:
+    /** Held by the test to keep the subscriber from handling notifications */
+    boost::mutex gate;
+    std::vector<uint256> vHashes;
+    boost::thread::id idThread;
+
+protected:
+    void Inventory(const uint256 &hash)
+    {
+        boost::unique_lock<boost::mutex> lock(gate);
+        vHashes.push_back(hash);
+        idThread = boost::this_thread::get_id();
+    }
+
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+    {
+        boost::unique_lock<boost::mutex> lock(gate);
+        vHashes.push_back(tx.GetHash());
+        if (pblock)
+            vHashes.push_back(pblock->GetHash());
+    }
+};
+
+BOOST_AUTO_TEST_CASE(async_subscriber)
+{
+    CTestSubscriber sub;
+    RegisterValidationInterface(&sub, true);
+
+    // Without the queue thread, notifications are delivered right away
+    uint256 hash1 = GetRandHash();
+    GetMainSignals().Inventory(hash1);
+    BOOST_CHECK(sub.vHashes == std::vector<uint256>(1, hash1));
+    BOOST_CHECK(sub.idThread == boost::this_thread::get_id());
+
+    boost::thread queueThread(&ThreadValidationInterfaceQueue);
+    for (int i = 0; i < 1000 && sub.idThread == boost::this_thread::get_id(); i++) {
+        GetMainSignals().Inventory(uint256());
+        SyncWithValidationInterfaceQueue();
+        MilliSleep(1);
+    }
+    BOOST_REQUIRE(sub.idThread != boost::this_thread::get_id());
+
+    // Notifications are queued in order while the subscriber is busy, and
+    // the block they refer to may be gone by the time they are delivered
+    std::vector<uint256> vExpected;
+    {
+        boost::unique_lock<boost::mutex> lock(sub.gate);
+        sub.vHashes.clear();
+
+        CMutableTransaction mtx;
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = 1;
+        CBlock block;
+        block.nNonce = GetRandHash();
+        block.vtx.push_back(mtx);
+        SyncWithWallets(block.vtx[0], &block);
+        GetMainSignals().ChainTip(NULL, &block, ZCIncrementalMerkleTree(), true);
+        vExpected.push_back(block.vtx[0].GetHash());
+        vExpected.push_back(block.GetHash());
+
+        uint256 hash2 = GetRandHash();
+        GetMainSignals().Inventory(hash2);
+        vExpected.push_back(hash2);
+
+        BOOST_CHECK(GetValidationInterfaceQueueSize() > 0);
+        BOOST_CHECK(sub.vHashes.empty());
+    }
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(GetValidationInterfaceQueueSize(), 0U);
+    BOOST_CHECK(sub.vHashes == vExpected);
+
+    // The pending notifications are delivered when the thread is interrupted
+    {
+        boost::unique_lock<boost::mutex> lock(sub.gate);
+        sub.vHashes.clear();
+        GetMainSignals().Inventory(hash1);
+        queueThread.interrupt();
+    }
+    queueThread.join();
+    BOOST_CHECK(sub.vHashes == std::vector<uint256>(1, hash1));
+
+    UnregisterValidationInterface(&sub);
+    GetMainSignals().Inventory(hash1);
+    BOOST_CHECK_EQUAL(sub.vHashes.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
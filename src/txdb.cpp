@@ -5,10 +5,12 @@
 
 #include "txdb.h"
 
+#include "addressindex.h"
 #include "chainparams.h"
 #include "hash.h"
 #include "main.h"
 #include "pow.h"
+#include "spentindex.h"
 #include "uint256.h"
 
 #include <stdint.h>
@@ -22,6 +24,11 @@ static const char DB_NULLIFIER = 's';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_BLOCKFILTER = 'g';
+static const char DB_BLOCKFILTERHEADER = 'h';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -249,6 +256,14 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadBlockSolution(const uint256 &hash, std::vector<unsigned char> &nSolution) {
+    CDiskBlockIndex diskindex;
+    if (!Read(make_pair(DB_BLOCK_INDEX, hash), diskindex))
+        return false;
+    nSolution.swap(diskindex.nSolution);
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
@@ -260,6 +275,146 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint8_t type, const uint160 &hashBytes,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, hashBytes));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSUNSPENTINDEX)
+                break;
+            CAddressUnspentKey key;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != hashBytes)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+/**
+ * Reads the address index entries of an address, in chain order, from
+ * height nStart up to nEnd included when those are not zero.
+ */
+bool CBlockTreeDB::ReadAddressIndex(uint8_t type, const uint160 &hashBytes,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nStart, int nEnd) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0)
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, hashBytes, nStart));
+    else
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, hashBytes));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSINDEX)
+                break;
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != hashBytes)
+                break;
+            if (nEnd > 0 && key.nHeight > (unsigned int)nEnd)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockFilter(const uint256 &hash, std::vector<unsigned char> &encoded) {
+    return Read(make_pair(DB_BLOCKFILTER, hash), encoded);
+}
+
+bool CBlockTreeDB::ReadBlockFilterHeader(const uint256 &hash, uint256 &filterHash, uint256 &header) {
+    std::pair<uint256, uint256> value;
+    if (!Read(make_pair(DB_BLOCKFILTERHEADER, hash), value))
+        return false;
+    filterHash = value.first;
+    header = value.second;
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockFilter(const uint256 &hash, const std::vector<unsigned char> &encoded,
+                                    const uint256 &filterHash, const uint256 &header) {
+    CLevelDBBatch batch;
+    batch.Write(make_pair(DB_BLOCKFILTER, hash), encoded);
+    batch.Write(make_pair(DB_BLOCKFILTERHEADER, hash), make_pair(filterHash, header));
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -307,7 +462,6 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nTime          = diskindex.nTime;
                 pindexNew->nBits          = diskindex.nBits;
                 pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
                 pindexNew->nSproutValue   = diskindex.nSproutValue;
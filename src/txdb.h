@@ -14,9 +14,15 @@
 #include <utility>
 #include <vector>
 
+struct CAddressIndexKey;
+struct CAddressUnspentKey;
+struct CAddressUnspentValue;
 class CBlockFileInfo;
 class CBlockIndex;
 struct CDiskTxPos;
+struct CSpentIndexKey;
+struct CSpentIndexValue;
+class uint160;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -60,11 +66,25 @@ private:
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
+    bool ReadBlockSolution(const uint256 &hash, std::vector<unsigned char> &nSolution);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+    bool ReadAddressUnspentIndex(uint8_t type, const uint160 &hashBytes,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressIndex(uint8_t type, const uint160 &hashBytes,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nStart = 0, int nEnd = 0);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool ReadBlockFilter(const uint256 &hash, std::vector<unsigned char> &encoded);
+    bool ReadBlockFilterHeader(const uint256 &hash, uint256 &filterHash, uint256 &header);
+    bool WriteBlockFilter(const uint256 &hash, const std::vector<unsigned char> &encoded,
+                          const uint256 &filterHash, const uint256 &header);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
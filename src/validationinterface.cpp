@@ -5,49 +5,335 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+#include "consensus/validation.h"
+#include "reverselock.h"
+#include "util.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
 static CMainSignals g_signals;
+/** Signals of the asynchronous subscribers, fired from the validation interface queue thread */
+static CMainSignals g_asyncSignals;
 
 CMainSignals& GetMainSignals()
 {
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.ChainTip.connect(boost::bind(&CValidationInterface::ChainTip, pwalletIn, _1, _2, _3, _4));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
-    g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+/**
+ * Ordered queue of notifications for the asynchronous subscribers, serviced by
+ * a single thread so that they are delivered in the order they were fired.
+ */
+class CValidationInterfaceQueue
+{
+public:
+    typedef boost::function<void(void)> Function;
+
+    CValidationInterfaceQueue() : nQueued(0), nProcessed(0), fRunning(false) {}
+
+    void Push(const Function& f)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fRunning) {
+                queue.push_back(f);
+                nQueued++;
+                condQueued.notify_one();
+                return;
+            }
+        }
+        // Nobody services the queue (not started yet, or shutting down)
+        f();
+    }
+
+    void Service()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = true;
+        try {
+            while (true) {
+                // Interruption point
+                while (queue.empty())
+                    condQueued.wait(lock);
+                ProcessFront(lock);
+            }
+        } catch (const boost::thread_interrupted&) {
+            // The lock is held again when the wait is interrupted
+            while (!queue.empty())
+                ProcessFront(lock);
+            fRunning = false;
+            condProcessed.notify_all();
+            throw;
+        }
+    }
+
+    void Sync()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        uint64_t nTarget = nQueued;
+        while (fRunning && nProcessed < nTarget)
+            condProcessed.wait(lock);
+    }
+
+    void Limit(size_t nMaxSize)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fRunning && queue.size() > nMaxSize)
+            condProcessed.wait(lock);
+    }
+
+    size_t Size() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return queue.size();
+    }
+
+private:
+    /** Delivers the first notification without the lock, so that more can be queued meanwhile */
+    void ProcessFront(boost::unique_lock<boost::mutex>& lock)
+    {
+        Function f = queue.front();
+        queue.pop_front();
+        bool fInterrupted = false;
+        {
+            reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
+            // Nothing can be done about a misbehaving subscriber here; don't let it stop the queue
+            try {
+                f();
+            } catch (const boost::thread_interrupted&) {
+                fInterrupted = true;
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "validationinterface");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "validationinterface");
+            }
+        }
+        nProcessed++;
+        condProcessed.notify_all();
+        if (fInterrupted)
+            throw boost::thread_interrupted();
+    }
+
+    std::deque<Function> queue;
+    mutable boost::mutex mutex;
+    boost::condition_variable condQueued;
+    boost::condition_variable condProcessed;
+    uint64_t nQueued;
+    uint64_t nProcessed;
+    bool fRunning;
+};
+
+static CValidationInterfaceQueue g_queue;
+
+/** Copies of the arguments of the notifications are queued, as the originals may not outlive them */
+typedef boost::shared_ptr<const CBlock> CBlockRef;
+
+static boost::mutex csBlockRef;
+/** The block whose transactions are being synced, shared by their notifications */
+static const CBlock* pblockRefLast = NULL;
+static CBlockRef blockRefLast;
+
+static CBlockRef GetBlockRef(const CBlock* pblock)
+{
+    if (pblock == NULL)
+        return CBlockRef();
+    boost::unique_lock<boost::mutex> lock(csBlockRef);
+    if (pblock != pblockRefLast) {
+        blockRefLast.reset(new CBlock(*pblock));
+        pblockRefLast = pblock;
+    }
+    return blockRefLast;
+}
+
+static void ResetBlockRef()
+{
+    // The block of a ChainTip notification may be a local of the caller, so
+    // its address can't identify a later block
+    boost::unique_lock<boost::mutex> lock(csBlockRef);
+    pblockRefLast = NULL;
+    blockRefLast.reset();
+}
+
+static void FireSyncTransaction(const CTransaction& tx, CBlockRef block)
+{
+    g_asyncSignals.SyncTransaction(tx, block.get());
+}
+
+static void FireChainTip(const CBlockIndex* pindex, CBlockRef block, const ZCIncrementalMerkleTree& tree, bool added)
+{
+    g_asyncSignals.ChainTip(pindex, block.get(), tree, added);
+}
+
+static void FireBlockChecked(CBlockRef block, const CValidationState& state)
+{
+    g_asyncSignals.BlockChecked(*block, state);
+}
+
+static void QueueUpdatedBlockTip(const CBlockIndex* pindex)
+{
+    if (!g_asyncSignals.UpdatedBlockTip.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.UpdatedBlockTip), pindex));
+}
+
+static void QueueSyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (!g_asyncSignals.SyncTransaction.empty())
+        g_queue.Push(boost::bind(&FireSyncTransaction, tx, GetBlockRef(pblock)));
+}
+
+static void QueueEraseTransaction(const uint256& hash)
+{
+    if (!g_asyncSignals.EraseTransaction.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.EraseTransaction), hash));
+}
+
+static void QueueUpdatedTransaction(const uint256& hash)
+{
+    if (!g_asyncSignals.UpdatedTransaction.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.UpdatedTransaction), hash));
+}
+
+static void QueueChainTip(const CBlockIndex* pindex, const CBlock* pblock, const ZCIncrementalMerkleTree& tree, bool added)
+{
+    if (!g_asyncSignals.ChainTip.empty())
+        g_queue.Push(boost::bind(&FireChainTip, pindex, GetBlockRef(pblock), tree, added));
+    ResetBlockRef();
+}
+
+static void QueueSetBestChain(const CBlockLocator& locator)
+{
+    if (!g_asyncSignals.SetBestChain.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.SetBestChain), locator));
+}
+
+static void QueueInventory(const uint256& hash)
+{
+    if (!g_asyncSignals.Inventory.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.Inventory), hash));
+}
+
+static void QueueBroadcast(int64_t nBestBlockTime)
+{
+    if (!g_asyncSignals.Broadcast.empty())
+        g_queue.Push(boost::bind(boost::ref(g_asyncSignals.Broadcast), nBestBlockTime));
+}
+
+static void QueueBlockChecked(const CBlock& block, const CValidationState& state)
+{
+    if (!g_asyncSignals.BlockChecked.empty())
+        g_queue.Push(boost::bind(&FireBlockChecked, CBlockRef(new CBlock(block)), state));
+}
+
+static boost::mutex csAsyncInterfaces;
+static std::set<CValidationInterface*> setAsyncInterfaces;
+static bool fQueueConnected = false;
+
+static void ConnectQueue()
+{
+    // The queue subscribes to every signal once, whatever the number of
+    // asynchronous subscribers
+    if (fQueueConnected)
+        return;
+    g_signals.UpdatedBlockTip.connect(boost::signals2::at_back, &QueueUpdatedBlockTip);
+    g_signals.SyncTransaction.connect(boost::signals2::at_back, &QueueSyncTransaction);
+    g_signals.EraseTransaction.connect(boost::signals2::at_back, &QueueEraseTransaction);
+    g_signals.UpdatedTransaction.connect(boost::signals2::at_back, &QueueUpdatedTransaction);
+    g_signals.ChainTip.connect(boost::signals2::at_back, &QueueChainTip);
+    g_signals.SetBestChain.connect(boost::signals2::at_back, &QueueSetBestChain);
+    g_signals.Inventory.connect(boost::signals2::at_back, &QueueInventory);
+    g_signals.Broadcast.connect(boost::signals2::at_back, &QueueBroadcast);
+    g_signals.BlockChecked.connect(boost::signals2::at_back, &QueueBlockChecked);
+    fQueueConnected = true;
+}
+
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync) {
+    CMainSignals& signals = fAsync ? g_asyncSignals : g_signals;
+    if (fAsync) {
+        boost::unique_lock<boost::mutex> lock(csAsyncInterfaces);
+        ConnectQueue();
+        setAsyncInterfaces.insert(pwalletIn);
+    }
+    signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
+    signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    signals.ChainTip.connect(boost::bind(&CValidationInterface::ChainTip, pwalletIn, _1, _2, _3, _4));
+    signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+    signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+    signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
+    signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
-    g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.ChainTip.disconnect(boost::bind(&CValidationInterface::ChainTip, pwalletIn, _1, _2, _3, _4));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    bool fAsync;
+    {
+        boost::unique_lock<boost::mutex> lock(csAsyncInterfaces);
+        fAsync = setAsyncInterfaces.erase(pwalletIn) > 0;
+    }
+    CMainSignals& signals = fAsync ? g_asyncSignals : g_signals;
+    signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
+    signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+    signals.ChainTip.disconnect(boost::bind(&CValidationInterface::ChainTip, pwalletIn, _1, _2, _3, _4));
+    signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+    signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
+    signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    // A notification being delivered may still refer to the subscriber
+    if (fAsync)
+        g_queue.Sync();
 }
 
 void UnregisterAllValidationInterfaces() {
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.ChainTip.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.UpdatedTransaction.disconnect_all_slots();
-    g_signals.EraseTransaction.disconnect_all_slots();
-    g_signals.SyncTransaction.disconnect_all_slots();
-    g_signals.UpdatedBlockTip.disconnect_all_slots();
+    {
+        boost::unique_lock<boost::mutex> lock(csAsyncInterfaces);
+        setAsyncInterfaces.clear();
+        fQueueConnected = false;
+    }
+    CMainSignals* vSignals[] = {&g_signals, &g_asyncSignals};
+    BOOST_FOREACH(CMainSignals* signals, vSignals) {
+        signals->BlockChecked.disconnect_all_slots();
+        signals->Broadcast.disconnect_all_slots();
+        signals->Inventory.disconnect_all_slots();
+        signals->ChainTip.disconnect_all_slots();
+        signals->SetBestChain.disconnect_all_slots();
+        signals->UpdatedTransaction.disconnect_all_slots();
+        signals->EraseTransaction.disconnect_all_slots();
+        signals->SyncTransaction.disconnect_all_slots();
+        signals->UpdatedBlockTip.disconnect_all_slots();
+    }
+    g_queue.Sync();
 }
 
 void SyncWithWallets(const CTransaction &tx, const CBlock *pblock) {
     g_signals.SyncTransaction(tx, pblock);
 }
+
+void ThreadValidationInterfaceQueue()
+{
+    g_queue.Service();
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    g_queue.Sync();
+}
+
+void LimitValidationInterfaceQueue()
+{
+    g_queue.Limit(MAX_PENDING_VALIDATION_NOTIFICATIONS);
+}
+
+size_t GetValidationInterfaceQueueSize()
+{
+    return g_queue.Size();
+}
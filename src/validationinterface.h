@@ -18,29 +18,49 @@ class CValidationInterface;
 class CValidationState;
 class uint256;
 
+/** Maximum number of notifications waiting for the asynchronous subscribers before block processing stalls */
+static const size_t MAX_PENDING_VALIDATION_NOTIFICATIONS = 10000;
+
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. Asynchronous subscribers are
+ * notified in order from the validation interface queue thread, without cs_main
+ * held, and must not rely on the chain state matching the notification.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync = false);
+/** Unregister a wallet from core, waiting for its queued notifications if it is asynchronous */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
 
+/**
+ * Delivers the notifications queued for the asynchronous subscribers until
+ * interrupted, then delivers those still pending. Notifications queued after
+ * it has returned are delivered synchronously.
+ */
+void ThreadValidationInterfaceQueue();
+/** Waits until the notifications queued so far have been delivered. Must not be called with cs_main held. */
+void SyncWithValidationInterfaceQueue();
+/** Waits while more than MAX_PENDING_VALIDATION_NOTIFICATIONS are queued. Must not be called with cs_main held. */
+void LimitValidationInterfaceQueue();
+/** Returns the number of notifications waiting to be delivered */
+size_t GetValidationInterfaceQueueSize();
+
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void EraseFromWallet(const uint256 &hash) {}
-    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added) {}
+    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree &tree, bool added) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, bool);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
@@ -55,7 +75,7 @@ struct CMainSignals {
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a change to the tip of the active block chain. */
-    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, ZCIncrementalMerkleTree, bool)> ChainTip;
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, const ZCIncrementalMerkleTree &, bool)> ChainTip;
     /** Notifies listeners of a new active block chain. */
     boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
     /** Notifies listeners about an inventory item being seen on the network. */
@@ -110,6 +110,8 @@ AsyncRPCOperation_sendmany::AsyncRPCOperation_sendmany(
 
     // Enable payment disclosure if requested
     paymentDisclosureMode = fExperimentalMode && GetBoolArg("-paymentdisclosure", false);
+
+    joinsplit_threads_ = std::max<int64_t>(1, std::min<int64_t>(GetArg("-joinsplitthreads", DEFAULT_JOINSPLIT_THREADS), GetNumCores()));
 }
 
 AsyncRPCOperation_sendmany::~AsyncRPCOperation_sendmany() {
@@ -153,6 +155,9 @@ void AsyncRPCOperation_sendmany::main() {
         set_error_message("unknown error");
     }
 
+    // Wait for the JoinSplits still being proved when the operation failed
+    pending_joinsplits_.clear();
+
 #ifdef ENABLE_MINING
   #ifdef ENABLE_WALLET
     GenerateBitcoins(GetBoolArg("-gen",false), pwalletMain, GetArg("-genproclimit", 1));
@@ -441,7 +446,12 @@ bool AsyncRPCOperation_sendmany::main_impl() {
         }
 
         // Create joinsplits, where each output represents a zaddr recipient.
-        UniValue obj(UniValue::VOBJ);
+        // They have no inputs, so they are all proved at once.
+        uint256 anchor;
+        {
+            LOCK(cs_main);
+            anchor = pcoinsTip->GetBestAnchor();    // As there are no inputs, ask the wallet for the best anchor
+        }
         while (zOutputsDeque.size() > 0) {
             AsyncJoinSplitInfo info;
             info.vpub_old = 0;
@@ -464,8 +474,9 @@ bool AsyncRPCOperation_sendmany::main_impl() {
                 // Funds are removed from the value pool and enter the private pool
                 info.vpub_old += value;
             }
-            obj = perform_joinsplit(info);
+            queue_joinsplit(info, std::vector<boost::optional<ZCIncrementalWitness>>(), anchor);
         }
+        UniValue obj = add_pending_joinsplits();
         sign_send_raw_transaction(obj);
         return true;
     }
@@ -484,6 +495,9 @@ bool AsyncRPCOperation_sendmany::main_impl() {
      * Send to zaddrs by chaining JoinSplits together and immediately consuming any change
      * Send to taddrs by creating dummy z outputs and accumulating value in a change note
      * which is used to set vpub_new in the last chained joinsplit.
+     *
+     * A JoinSplit consuming change waits for the previous one to be proved, while the
+     * chains which end without change are proved concurrently.
      */
     UniValue obj(UniValue::VOBJ);
     CAmount jsChange = 0;   // this is updated after each joinsplit
@@ -516,7 +530,7 @@ bool AsyncRPCOperation_sendmany::main_impl() {
         }
 
         // If there is no change, the chain has terminated so we can reset the tracked treestate.
-        if (jsChange==0 && tx_.vjoinsplit.size() > 0) {
+        if (jsChange==0) {
             intermediates.clear();
             previousCommitments.clear();
         }
@@ -731,12 +745,17 @@ bool AsyncRPCOperation_sendmany::main_impl() {
                     );
         }
 
-        obj = perform_joinsplit(info, witnesses, jsAnchor);
+        queue_joinsplit(info, witnesses, jsAnchor);
 
+        // The next JoinSplit spends the change, so it needs this one
         if (jsChange > 0) {
+            obj = add_pending_joinsplits();
             changeOutputIndex = find_output(obj, 1);
         }
     }
+    if (!pending_joinsplits_.empty()) {
+        obj = add_pending_joinsplits();
+    }
 
     // Sanity check in case changes to code block above exits loop by invoking 'break'
     assert(zInputsDeque.size() == 0);
@@ -920,6 +939,15 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
         AsyncJoinSplitInfo & info,
         std::vector<boost::optional < ZCIncrementalWitness>> witnesses,
         uint256 anchor)
+{
+    queue_joinsplit(info, witnesses, anchor);
+    return add_pending_joinsplits();
+}
+
+void AsyncRPCOperation_sendmany::queue_joinsplit(
+        AsyncJoinSplitInfo & info,
+        std::vector<boost::optional < ZCIncrementalWitness>> witnesses,
+        uint256 anchor)
 {
     if (anchor.IsNull()) {
         throw std::runtime_error("anchor is null");
@@ -949,51 +977,77 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
         throw runtime_error("unsupported joinsplit input/output counts");
     }
 
-    CMutableTransaction mtx(tx_);
-
     LogPrint("zrpcunsafe", "%s: creating joinsplit at index %d (vpub_old=%s, vpub_new=%s, in[0]=%s, in[1]=%s, out[0]=%s, out[1]=%s)\n",
             getId(),
-            tx_.vjoinsplit.size(),
+            tx_.vjoinsplit.size() + pending_joinsplits_.size(),
             FormatMoney(info.vpub_old), FormatMoney(info.vpub_new),
             FormatMoney(info.vjsin[0].note.value()), FormatMoney(info.vjsin[1].note.value()),
             FormatMoney(info.vjsout[0].value), FormatMoney(info.vjsout[1].value)
             );
 
+    // Wait for a worker
+    if (pending_joinsplits_.size() >= joinsplit_threads_) {
+        add_pending_joinsplits(joinsplit_threads_ - 1);
+    }
+
     // Generate the proof, this can take over a minute.
     std::array<libzcash::JSInput, ZC_NUM_JS_INPUTS> inputs
             {info.vjsin[0], info.vjsin[1]};
     std::array<libzcash::JSOutput, ZC_NUM_JS_OUTPUTS> outputs
             {info.vjsout[0], info.vjsout[1]};
-        #ifdef __APPLE__
-        std::array<uint64_t, ZC_NUM_JS_INPUTS> inputMap;
-        std::array<uint64_t, ZC_NUM_JS_OUTPUTS> outputMap;
-        #else
-        std::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
-        std::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
-        #endif
-
-    uint256 esk; // payment disclosure - secret
-
-    JSDescription jsdesc = JSDescription::Randomized(
-			mtx.nVersion == GROTH_TX_VERSION,
-            *pzcashParams,
-            joinSplitPubKey_,
-            anchor,
-            inputs,
-            outputs,
-            inputMap,
-            outputMap,
-            info.vpub_old,
-            info.vpub_new,
-            !this->testmode,
-            &esk); // parameter expects pointer to esk, so pass in address
-    {
-        auto verifier = libzcash::ProofVerifier::Strict();
-        if (!(jsdesc.Verify(*pzcashParams, verifier, joinSplitPubKey_))) {
-            throw std::runtime_error("error verifying joinsplit");
+    bool makeGrothProof = tx_.nVersion == GROTH_TX_VERSION;
+    bool computeProof = !this->testmode;
+    uint256 joinSplitPubKey = joinSplitPubKey_;
+    CAmount vpub_old = info.vpub_old;
+    CAmount vpub_new = info.vpub_new;
+
+    pending_joinsplits_.push_back(std::async(std::launch::async, [=]() {
+        std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+        AsyncJoinSplitProof proof;
+        std::array<libzcash::JSInput, ZC_NUM_JS_INPUTS> jsInputs(inputs);
+        proof.outputs = outputs;
+        proof.jsdesc = JSDescription::Randomized(
+                makeGrothProof,
+                *pzcashParams,
+                joinSplitPubKey,
+                anchor,
+                jsInputs,
+                proof.outputs,
+                proof.inputMap,
+                proof.outputMap,
+                vpub_old,
+                vpub_new,
+                computeProof,
+                &proof.esk); // parameter expects pointer to esk, so pass in address
+        {
+            auto verifier = libzcash::ProofVerifier::Strict();
+            if (!(proof.jsdesc.Verify(*pzcashParams, verifier, joinSplitPubKey))) {
+                throw std::runtime_error("error verifying joinsplit");
+            }
         }
+
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        proof.seconds = elapsed_seconds.count();
+        return proof;
+    }));
+}
+
+UniValue AsyncRPCOperation_sendmany::add_pending_joinsplits(size_t nPending) {
+    UniValue obj(UniValue::VOBJ);
+    while (pending_joinsplits_.size() > nPending) {
+        std::future<AsyncJoinSplitProof> next = std::move(pending_joinsplits_.front());
+        pending_joinsplits_.pop_front();
+        obj = add_joinsplit(next.get());
     }
+    return obj;
+}
+
+UniValue AsyncRPCOperation_sendmany::add_joinsplit(const AsyncJoinSplitProof & proof) {
+    const JSDescription& jsdesc = proof.jsdesc;
+    const std::array<libzcash::JSOutput, ZC_NUM_JS_OUTPUTS>& outputs = proof.outputs;
 
+    CMutableTransaction mtx(tx_);
     mtx.vjoinsplit.push_back(jsdesc);
 
     // Empty output script.
@@ -1049,10 +1103,10 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     UniValue arrInputMap(UniValue::VARR);
     UniValue arrOutputMap(UniValue::VARR);
     for (size_t i = 0; i < ZC_NUM_JS_INPUTS; i++) {
-        arrInputMap.push_back(inputMap[i]);
+        arrInputMap.push_back(proof.inputMap[i]);
     }
     for (size_t i = 0; i < ZC_NUM_JS_OUTPUTS; i++) {
-        arrOutputMap.push_back(outputMap[i]);
+        arrOutputMap.push_back(proof.outputMap[i]);
     }
 
 
@@ -1064,12 +1118,12 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     size_t js_index = tx_.vjoinsplit.size() - 1;
     uint256 placeholder;
     for (int i = 0; i < ZC_NUM_JS_OUTPUTS; i++) {
-        uint8_t mapped_index = outputMap[i];
+        uint8_t mapped_index = proof.outputMap[i];
         // placeholder for txid will be filled in later when tx has been finalized and signed.
         PaymentDisclosureKey pdKey = {placeholder, js_index, mapped_index};
         JSOutput output = outputs[mapped_index];
         libzcash::PaymentAddress zaddr = output.addr;  // randomized output
-        PaymentDisclosureInfo pdInfo = {PAYMENT_DISCLOSURE_VERSION_EXPERIMENTAL, esk, joinSplitPrivKey, zaddr};
+        PaymentDisclosureInfo pdInfo = {PAYMENT_DISCLOSURE_VERSION_EXPERIMENTAL, proof.esk, joinSplitPrivKey, zaddr};
         paymentDisclosureData_.push_back(PaymentDisclosureKeyInfo(pdKey, pdInfo));
 
         CZCPaymentAddress address(zaddr);
@@ -1077,6 +1131,12 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     }
     // !!! Payment disclosure END
 
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        joinsplit_times_.push_back(proof.seconds);
+    }
+    LogPrint("zrpcunsafe", "%s: added joinsplit at index %d, proved in %.2fs\n", getId(), js_index, proof.seconds);
+
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("encryptednote1", encryptedNote1);
     obj.pushKV("encryptednote2", encryptedNote2);
@@ -1163,6 +1223,16 @@ std::array<unsigned char, ZC_MEMO_SIZE> AsyncRPCOperation_sendmany::get_memo_fro
  */
 UniValue AsyncRPCOperation_sendmany::getStatus() const {
     UniValue v = AsyncRPCOperation::getStatus();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!joinsplit_times_.empty()) {
+            UniValue arrTimes(UniValue::VARR);
+            for (double seconds : joinsplit_times_) {
+                arrTimes.push_back(seconds);
+            }
+            v.pushKV("joinsplit_secs", arrTimes);
+        }
+    }
     if (contextinfo_.isNull()) {
         return v;
     }
@@ -14,6 +14,8 @@
 #include "wallet.h"
 #include "paymentdisclosure.h"
 
+#include <deque>
+#include <future>
 #include <unordered_map>
 #include <tuple>
 
@@ -43,6 +45,22 @@ struct AsyncJoinSplitInfo
     CAmount vpub_new = 0;
 };
 
+// A JoinSplit proved by a worker, waiting to be added to the transaction
+struct AsyncJoinSplitProof
+{
+    JSDescription jsdesc;
+    std::array<JSOutput, ZC_NUM_JS_OUTPUTS> outputs;
+    #ifdef __APPLE__
+    std::array<uint64_t, ZC_NUM_JS_INPUTS> inputMap;
+    std::array<uint64_t, ZC_NUM_JS_OUTPUTS> outputMap;
+    #else
+    std::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
+    std::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
+    #endif
+    uint256 esk;            // payment disclosure - secret
+    double seconds = 0;     // time taken to prove and verify
+};
+
 // A struct to help us track the witness and anchor for a given JSOutPoint
 struct WitnessAnchorData {
 	boost::optional<ZCIncrementalWitness> witness;
@@ -95,6 +113,12 @@ private:
     std::vector<SendManyInputJSOP> z_inputs_;
     
     CTransaction tx_;
+
+    // JoinSplits being proved, oldest first. They do not depend on each other and
+    // are added to tx_ in this order.
+    std::deque<std::future<AsyncJoinSplitProof>> pending_joinsplits_;
+    size_t joinsplit_threads_;
+    std::vector<double> joinsplit_times_;  // seconds per JoinSplit added, guarded by lock_
    
     void add_taddr_change_output_to_tx(CAmount amount, bool sendChangeToSource = false);
     void add_taddr_outputs_to_tx();
@@ -115,6 +139,19 @@ private:
         std::vector<boost::optional < ZCIncrementalWitness>> witnesses,
         uint256 anchor);
 
+    // Start proving a JoinSplit where you have the witnesses and anchor, waiting for
+    // the oldest pending one first if all the workers are busy
+    void queue_joinsplit(
+        AsyncJoinSplitInfo & info,
+        std::vector<boost::optional < ZCIncrementalWitness>> witnesses,
+        uint256 anchor);
+
+    // Add pending JoinSplits to the transaction until at most nPending are left,
+    // returning the perform_joinsplit result of the last one added
+    UniValue add_pending_joinsplits(size_t nPending = 0);
+
+    UniValue add_joinsplit(const AsyncJoinSplitProof & proof);
+
     void sign_send_raw_transaction(UniValue obj);     // throws exception if there was an error
 
     // payment disclosure!
@@ -136,6 +173,11 @@ public:
     void setTx(CTransaction tx) {
         delegate->tx_ = tx;
     }
+
+    // Unlike -joinsplitthreads, not limited to the number of cores
+    void set_joinsplit_threads(size_t nThreads) {
+        delegate->joinsplit_threads_ = nThreads;
+    }
     
     // Delegated methods
     
@@ -179,6 +221,18 @@ public:
         return delegate->perform_joinsplit(info, witnesses, anchor);
     }
 
+    void queue_joinsplit(
+        AsyncJoinSplitInfo & info,
+        std::vector<boost::optional < ZCIncrementalWitness>> witnesses,
+        uint256 anchor)
+    {
+        delegate->queue_joinsplit(info, witnesses, anchor);
+    }
+
+    UniValue add_pending_joinsplits(size_t nPending = 0) {
+        return delegate->add_pending_joinsplits(nPending);
+    }
+
     void sign_send_raw_transaction(UniValue obj) {
         delegate->sign_send_raw_transaction(obj);
     }
@@ -323,6 +323,7 @@ UniValue AsyncRPCOperation_shieldcoinbase::perform_joinsplit(ShieldCoinbaseJSInf
 
     uint256 esk;
 
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
     JSDescription jsdesc = JSDescription::Randomized(
 			mtx.nVersion == GROTH_TX_VERSION,
             *pzcashParams,
@@ -342,6 +343,11 @@ UniValue AsyncRPCOperation_shieldcoinbase::perform_joinsplit(ShieldCoinbaseJSInf
             throw std::runtime_error("error verifying joinsplit");
         }
     }
+    {
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        std::lock_guard<std::mutex> guard(lock_);
+        joinsplit_times_.push_back(elapsed_seconds.count());
+    }
 
     mtx.vjoinsplit.push_back(jsdesc);
 
@@ -418,6 +424,16 @@ UniValue AsyncRPCOperation_shieldcoinbase::perform_joinsplit(ShieldCoinbaseJSInf
  */
 UniValue AsyncRPCOperation_shieldcoinbase::getStatus() const {
     UniValue v = AsyncRPCOperation::getStatus();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!joinsplit_times_.empty()) {
+            UniValue arrTimes(UniValue::VARR);
+            for (double seconds : joinsplit_times_) {
+                arrTimes.push_back(seconds);
+            }
+            v.pushKV("joinsplit_secs", arrTimes);
+        }
+    }
     if (contextinfo_.isNull()) {
         return v;
     }
@@ -70,6 +70,8 @@ private:
 
     CTransaction tx_;
 
+    std::vector<double> joinsplit_times_;  // seconds per JoinSplit created, guarded by lock_
+
     bool main_impl();
 
     // JoinSplit without any input notes to spend
@@ -404,6 +404,41 @@ TEST(wallet_tests, FindMyNotes) {
     EXPECT_EQ(nd, noteMap[jsoutpt]);
 }
 
+TEST(wallet_tests, FindMyNotesInBatch) {
+    CWallet wallet;
+
+    auto sk = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+    // Enough addresses for the batch to be spread over several threads
+    for (size_t i = 0; i < NOTE_DECRYPTION_PARALLEL_THRESHOLD; i++) {
+        wallet.AddSpendingKey(libzcash::SpendingKey::random());
+    }
+
+    auto sk2 = libzcash::SpendingKey::random();
+    std::vector<CTransaction> vtx;
+    vtx.push_back(GetValidReceive(sk, 10, true));
+    vtx.push_back(GetValidReceive(sk2, 10, true));
+    vtx.push_back(CTransaction());
+    vtx.push_back(GetValidReceive(sk, 5, true));
+
+    for (int nThreads : {1, 4}) {
+        auto vNoteData = wallet.FindMyNotes(vtx, nThreads);
+        ASSERT_EQ(vtx.size(), vNoteData.size());
+        for (size_t n = 0; n < vtx.size(); n++) {
+            EXPECT_TRUE(wallet.FindMyNotes(vtx[n]) == vNoteData[n]);
+        }
+        EXPECT_EQ(2, vNoteData[0].size());
+        EXPECT_EQ(0, vNoteData[1].size());
+        EXPECT_EQ(0, vNoteData[2].size());
+        EXPECT_EQ(2, vNoteData[3].size());
+
+        JSOutPoint jsoutpt {vtx[3].GetHash(), 0, 1};
+        CNoteData nd {sk.address(), GetNote(sk, vtx[3], 0, 1).nullifier(sk)};
+        EXPECT_EQ(1, vNoteData[3].count(jsoutpt));
+        EXPECT_EQ(nd, vNoteData[3][jsoutpt]);
+    }
+}
+
 TEST(wallet_tests, FindMyNotesInEncryptedWallet) {
     TestWallet wallet;
     uint256 r {GetRandHash()};
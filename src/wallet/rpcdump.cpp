@@ -98,53 +98,62 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", false")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex* pindexRescan = NULL;
+    CKeyID vchAddress;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
 
-    string strSecret = params[0].get_str();
-    string strLabel = "";
-    if (params.size() > 1)
-        strLabel = params[1].get_str();
+        string strSecret = params[0].get_str();
+        string strLabel = "";
+        if (params.size() > 1)
+            strLabel = params[1].get_str();
 
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    if (params.size() > 2)
-        fRescan = params[2].get_bool();
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        if (params.size() > 2)
+            fRescan = params[2].get_bool();
 
-    CBitcoinSecret vchSecret;
-    bool fGood = vchSecret.SetString(strSecret);
+        CBitcoinSecret vchSecret;
+        bool fGood = vchSecret.SetString(strSecret);
 
-    if (!fGood) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+        if (!fGood) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
 
-    CKey key = vchSecret.GetKey();
-    if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Private key outside allowed range");
+        CKey key = vchSecret.GetKey();
+        if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Private key outside allowed range");
 
-    CPubKey pubkey = key.GetPubKey();
-    assert(key.VerifyPubKey(pubkey));
-    CKeyID vchAddress = pubkey.GetID();
-    {
-        pwalletMain->MarkDirty();
-        pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
+        CPubKey pubkey = key.GetPubKey();
+        assert(key.VerifyPubKey(pubkey));
+        vchAddress = pubkey.GetID();
+        {
+            pwalletMain->MarkDirty();
+            pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
-        // Don't throw error in case a key is already there
-        if (pwalletMain->HaveKey(vchAddress)) {
-            return CBitcoinAddress(vchAddress).ToString();
-        }
+            // Don't throw error in case a key is already there
+            if (pwalletMain->HaveKey(vchAddress)) {
+                return CBitcoinAddress(vchAddress).ToString();
+            }
 
-        pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
+            pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
 
-        if (!pwalletMain->AddKeyPubKey(key, pubkey))
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
 
-        // whenever a key is imported, we need to scan the whole chain
-        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+            // whenever a key is imported, we need to scan the whole chain
+            pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+            if (fRescan) {
+                pindexRescan = chainActive.Genesis();
+            }
         }
     }
 
+    // The rescan releases cs_main and cs_wallet between batches of blocks
+    if (pindexRescan) {
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+    }
+
     return CBitcoinAddress(vchAddress).ToString();
 }
 
@@ -579,72 +588,81 @@ UniValue z_importkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_importkey", "\"mykey\", \"no\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
-
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    bool fIgnoreExistingKey = true;
-    if (params.size() > 1) {
-        auto rescan = params[1].get_str();
-        if (rescan.compare("whenkeyisnew") != 0) {
-            fIgnoreExistingKey = false;
-            if (rescan.compare("yes") == 0) {
-                fRescan = true;
-            } else if (rescan.compare("no") == 0) {
-                fRescan = false;
-            } else {
-                // Handle older API
-                UniValue jVal;
-                if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
-                    !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
-                    throw JSONRPCError(
-                        RPC_INVALID_PARAMETER,
-                        "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+    CBlockIndex* pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        bool fIgnoreExistingKey = true;
+        if (params.size() > 1) {
+            auto rescan = params[1].get_str();
+            if (rescan.compare("whenkeyisnew") != 0) {
+                fIgnoreExistingKey = false;
+                if (rescan.compare("yes") == 0) {
+                    fRescan = true;
+                } else if (rescan.compare("no") == 0) {
+                    fRescan = false;
+                } else {
+                    // Handle older API
+                    UniValue jVal;
+                    if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
+                        !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
+                        throw JSONRPCError(
+                            RPC_INVALID_PARAMETER,
+                            "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+                    }
+                    fRescan = jVal[0].getBool();
                 }
-                fRescan = jVal[0].getBool();
             }
         }
-    }
 
-    // Height to rescan from
-    int nRescanHeight = 0;
-    if (params.size() > 2)
-        nRescanHeight = params[2].get_int();
-    if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-    }
+        // Height to rescan from
+        int nRescanHeight = 0;
+        if (params.size() > 2)
+            nRescanHeight = params[2].get_int();
+        if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
 
-    string strSecret = params[0].get_str();
-    CZCSpendingKey spendingkey(strSecret);
-    auto key = spendingkey.Get();
-    auto addr = key.address();
+        string strSecret = params[0].get_str();
+        CZCSpendingKey spendingkey(strSecret);
+        auto key = spendingkey.Get();
+        auto addr = key.address();
 
-    {
-        // Don't throw error in case a key is already there
-        if (pwalletMain->HaveSpendingKey(addr)) {
-            if (fIgnoreExistingKey) {
-                return NullUniValue;
-            }
-        } else {
-            pwalletMain->MarkDirty();
+        {
+            // Don't throw error in case a key is already there
+            if (pwalletMain->HaveSpendingKey(addr)) {
+                if (fIgnoreExistingKey) {
+                    return NullUniValue;
+                }
+            } else {
+                pwalletMain->MarkDirty();
 
-            if (!pwalletMain-> AddZKey(key))
-                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
+                if (!pwalletMain-> AddZKey(key))
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
 
-            pwalletMain->mapZKeyMetadata[addr].nCreateTime = 1;
-        }
+                pwalletMain->mapZKeyMetadata[addr].nCreateTime = 1;
+            }
 
-        // whenever a key is imported, we need to scan the whole chain
-        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+            // whenever a key is imported, we need to scan the whole chain
+            pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-        // We want to scan for transactions and notes
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+            // We want to scan for transactions and notes
+            if (fRescan) {
+                pindexRescan = chainActive[nRescanHeight];
+            }
         }
     }
 
+    // The rescan releases cs_main and cs_wallet between batches of blocks,
+    // until it comes across the notes of the key
+    if (pindexRescan) {
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+    }
+
     return NullUniValue;
 }
 
@@ -2634,6 +2634,21 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
         os >> samplejoinsplit;
     }
 
+    // "createjoinsplit" makes Groth16 proofs, or PHGR13 proofs with the proving key
+    // read from disk for every proof ("phgr") or kept in memory ("phgr-cached")
+    std::string strProofMode = "groth";
+    bool fProvingKeyLoaded = pzcashParams->hasProvingKey();
+    if (benchmarktype == "createjoinsplit" && params.size() >= 4) {
+        strProofMode = params[3].get_str();
+        if (strProofMode == "phgr-cached") {
+            pzcashParams->loadProvingKey();
+        } else if (strProofMode == "phgr") {
+            pzcashParams->unloadProvingKey();
+        } else if (strProofMode != "groth") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid proof mode");
+        }
+    }
+
     for (int i = 0; i < samplecount; i++) {
         if (benchmarktype == "sleep") {
             sample_times.push_back(benchmark_sleep());
@@ -2644,13 +2659,29 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
                 sample_times.push_back(benchmark_create_joinsplit());
             } else {
                 int nThreads = params[2].get_int();
-                std::vector<double> vals = benchmark_create_joinsplit_threaded(nThreads);
+                std::vector<double> vals = benchmark_create_joinsplit_threaded(nThreads, strProofMode == "groth");
                 // Divide by nThreads^2 to get average seconds per JoinSplit because
                 // we are running one JoinSplit per thread.
                 sample_times.push_back(std::accumulate(vals.begin(), vals.end(), 0.0) / (nThreads*nThreads));
             }
         } else if (benchmarktype == "verifyjoinsplit") {
             sample_times.push_back(benchmark_verify_joinsplit(samplejoinsplit));
+        } else if (benchmarktype == "verifyblockjoinsplits") {
+            int nJoinSplits = params[2].get_int();
+            int nThreads = params.size() < 4 ? 1 : params[3].get_int();
+            sample_times.push_back(benchmark_verify_block_joinsplits(nJoinSplits, nThreads));
+        } else if (benchmarktype == "sigcachelookup") {
+            int nSigs = params[2].get_int();
+            int nThreads = params.size() < 4 ? 1 : params[3].get_int();
+            sample_times.push_back(benchmark_sigcache_lookup(nSigs, nThreads));
+        } else if (benchmarktype == "socketevents") {
+            int nPeers = params[2].get_int();
+            std::string strMode = params.size() < 4 ? DEFAULT_SOCKETEVENTS : params[3].get_str();
+            sample_times.push_back(benchmark_socket_events(nPeers, strMode));
+        } else if (benchmarktype == "tlsaccept") {
+            int nPeers = params[2].get_int();
+            int nSlowPeers = params.size() < 4 ? 0 : params[3].get_int();
+            sample_times.push_back(benchmark_tls_accept(nPeers, nSlowPeers));
 #ifdef ENABLE_MINING
         } else if (benchmarktype == "solveequihash") {
             if (params.size() < 3) {
@@ -2662,15 +2693,24 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             }
 #endif
         } else if (benchmarktype == "verifyequihash") {
-            sample_times.push_back(benchmark_verify_equihash());
+            if (params.size() < 3) {
+                sample_times.push_back(benchmark_verify_equihash());
+            } else {
+                int nVerifications = params[2].get_int();
+                int nThreads = params.size() < 4 ? 1 : params[3].get_int();
+                sample_times.push_back(benchmark_verify_equihash_threaded(nVerifications, nThreads));
+            }
         } else if (benchmarktype == "validatelargetx") {
             sample_times.push_back(benchmark_large_tx());
         } else if (benchmarktype == "trydecryptnotes") {
             int nAddrs = params[2].get_int();
-            sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
+            int nTxs = params.size() < 4 ? 1 : params[3].get_int();
+            int nThreads = params.size() < 5 ? 1 : params[4].get_int();
+            sample_times.push_back(benchmark_try_decrypt_notes(nAddrs, nTxs, nThreads));
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
-            sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
+            int nBlockTxs = params.size() < 4 ? 1 : params[3].get_int();
+            sample_times.push_back(benchmark_increment_note_witnesses(nTxs, nBlockTxs));
         } else if (benchmarktype == "connectblockslow") {
             if (Params().NetworkIDString() != "regtest") {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
@@ -2688,12 +2728,34 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             }
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
-            sample_times.push_back(benchmark_listunspent());
+            int nTxs = params.size() < 3 ? 0 : params[2].get_int();
+            sample_times.push_back(benchmark_listunspent(nTxs));
+        } else if (benchmarktype == "blocktemplate") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            int nTxs = params[2].get_int();
+            std::string strMode = params.size() < 4 ? "package" : params[3].get_str();
+            sample_times.push_back(benchmark_create_block_template(nTxs, strMode));
+        } else if (benchmarktype == "getrawtransaction") {
+            int nLookups = params[2].get_int();
+            std::string strMode = params.size() < 4 ? "mmap" : params[3].get_str();
+            sample_times.push_back(benchmark_getrawtransaction(nLookups, strMode));
+        } else if (benchmarktype == "serveblocks") {
+            int nBlocks = params[2].get_int();
+            std::string strMode = params.size() < 4 ? "trusted" : params[3].get_str();
+            sample_times.push_back(benchmark_serve_blocks(nBlocks, strMode));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
     }
 
+    if (fProvingKeyLoaded) {
+        pzcashParams->loadProvingKey();
+    } else {
+        pzcashParams->unloadProvingKey();
+    }
+
     UniValue results(UniValue::VARR);
     for (auto time : sample_times) {
         UniValue result(UniValue::VOBJ);
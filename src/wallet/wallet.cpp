@@ -23,6 +23,9 @@
 using namespace zen;
 
 #include <assert.h>
+#include <atomic>
+#include <future>
+#include <memory>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -406,9 +409,19 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 }
 
 void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
-                       ZCIncrementalMerkleTree tree, bool added)
+                       const ZCIncrementalMerkleTree &treeIn, bool added)
 {
+    {
+        LOCK(cs_wallet);
+        // The notes of the block have been added by SyncTransaction by now
+        ClearBlockNotes();
+        if (!added) {
+            // Outputs spent in the block are available again
+            fUnspentIndexDirty = true;
+        }
+    }
     if (added) {
+        ZCIncrementalMerkleTree tree(treeIn);
         IncrementNoteWitnesses(pindex, pblock, tree);
     } else {
         DecrementNoteWitnesses(pindex);
@@ -624,6 +637,106 @@ bool CWallet::IsSpent(const uint256& nullifier) const
     return false;
 }
 
+/**
+ * Outpoint is spent in the active chain if a transaction of a block
+ * spends it; only disconnecting that block can make it available again.
+ */
+bool CWallet::IsSpentInChain(const uint256& hash, unsigned int n) const
+{
+    const COutPoint outpoint(hash, n);
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+    {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0)
+            return true;
+    }
+    return false;
+}
+
+bool CWallet::IsSpentInChain(const uint256& nullifier) const
+{
+    pair<TxNullifiers::const_iterator, TxNullifiers::const_iterator> range;
+    range = mapTxNullifiers.equal_range(nullifier);
+
+    for (TxNullifiers::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * A transaction is settled when all of its outputs and notes that are ours
+ * are spent in the active chain, so that it can be left out of the unspent
+ * index. Notes without a nullifier (viewing keys, locked wallet) never are.
+ */
+bool CWallet::IsSettled(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO && !IsSpentInChain(hash, i))
+            return false;
+    }
+    for (const mapNoteData_t::value_type& item : wtx.mapNoteData) {
+        if (!item.second.nullifier || !IsSpentInChain(*item.second.nullifier))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Drops from the unspent index the transactions whose last outputs or notes
+ * of ours are spent by tx, which has just been connected in a block.
+ */
+void CWallet::UpdateUnspentIndex(const CTransaction& tx)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fUnspentIndexDirty)
+        return;
+    std::set<uint256> setSpent;
+    for (const CTxIn& txin : tx.vin) {
+        setSpent.insert(txin.prevout.hash);
+    }
+    for (const JSDescription& jsdesc : tx.vjoinsplit) {
+        for (const uint256& nullifier : jsdesc.nullifiers) {
+            std::map<uint256, JSOutPoint>::const_iterator it = mapNullifiersToNotes.find(nullifier);
+            if (it != mapNullifiersToNotes.end())
+                setSpent.insert(it->second.hash);
+        }
+    }
+    for (const uint256& hash : setSpent) {
+        if (!setUnspentTxs.count(hash))
+            continue;
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end() || IsSettled(mi->second))
+            setUnspentTxs.erase(hash);
+    }
+}
+
+const std::set<uint256>& CWallet::GetUnspentTxs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fUnspentIndexDirty) {
+        setUnspentTxs.clear();
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+            if (!IsSettled(item.second))
+                setUnspentTxs.insert(setUnspentTxs.end(), item.first);
+        }
+        fUnspentIndexDirty = false;
+        LogPrint("wallet", "%s: %u of %u transactions hold unspent outputs or notes\n", __func__, setUnspentTxs.size(), mapWallet.size());
+    }
+    return setUnspentTxs;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -677,6 +790,13 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 {
     {
         LOCK(cs_wallet);
+        // Notes that are behind the current height, found in a single pass
+        // over the wallet so that the per-commitment work below only touches
+        // the notes that actually carry a witness.
+        std::vector<CNoteData*> vNotes;
+        // Witnesses to bring up to date, each with the index of the first
+        // commitment of this block it has not seen yet.
+        std::vector<std::pair<CNoteData*, size_t>> vWitnessed;
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
             for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
                 CNoteData* nd = &(item.second);
@@ -699,6 +819,10 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                     if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
                         nd->witnesses.pop_back();
                     }
+                    vNotes.push_back(nd);
+                    if (nd->witnesses.size() > 0) {
+                        vWitnessed.push_back(std::make_pair(nd, 0));
+                    }
                 }
             }
         }
@@ -713,6 +837,7 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             pblock = &block;
         }
 
+        std::vector<uint256> vCommitments;
         for (const CTransaction& tx : pblock->vtx) {
             auto hash = tx.GetHash();
             bool txIsOurs = mapWallet.count(hash);
@@ -721,20 +846,7 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                 for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                     const uint256& note_commitment = jsdesc.commitments[j];
                     tree.append(note_commitment);
-
-                    // Increment existing witnesses
-                    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                        for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                            CNoteData* nd = &(item.second);
-                            if (nd->witnessHeight < pindex->nHeight &&
-                                    nd->witnesses.size() > 0) {
-                                // Check the validity of the cache
-                                // See earlier comment about validity.
-                                assert(nWitnessCacheSize >= nd->witnesses.size());
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
-                    }
+                    vCommitments.push_back(note_commitment);
 
                     // If this is our note, witness it
                     if (txIsOurs) {
@@ -758,29 +870,61 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                           pindex->nHeight,
                                           tree.witness().root().GetHex());
                                 nd->witnesses.clear();
+                                vWitnessed.erase(std::remove_if(vWitnessed.begin(), vWitnessed.end(),
+                                                                [nd](const std::pair<CNoteData*, size_t>& w) { return w.first == nd; }),
+                                                 vWitnessed.end());
                             }
                             nd->witnesses.push_front(tree.witness());
                             // Set height to one less than pindex so it gets incremented
                             nd->witnessHeight = pindex->nHeight - 1;
                             // Check the validity of the cache
                             assert(nWitnessCacheSize >= nd->witnesses.size());
+                            // The new witness already covers the commitments so far
+                            vWitnessed.push_back(std::make_pair(nd, vCommitments.size()));
                         }
                     }
                 }
             }
         }
 
-        // Update witness heights
-        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                CNoteData* nd = &(item.second);
-                if (nd->witnessHeight < pindex->nHeight) {
-                    nd->witnessHeight = pindex->nHeight;
-                    // Check the validity of the cache
-                    // See earlier comment about validity.
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
+        // Increment existing witnesses with the commitments of the block they
+        // have not seen yet. Each witness is independent of the others, so a
+        // large update is spread over several threads.
+        size_t nAppends = 0;
+        for (const std::pair<CNoteData*, size_t>& w : vWitnessed) {
+            // Check the validity of the cache
+            // See earlier comment about validity.
+            assert(nWitnessCacheSize >= w.first->witnesses.size());
+            nAppends += vCommitments.size() - w.second;
+        }
+        auto appendCommitments = [&vWitnessed, &vCommitments](size_t nBegin, size_t nEnd) {
+            for (size_t n = nBegin; n < nEnd; n++) {
+                ZCIncrementalWitness& witness = vWitnessed[n].first->witnesses.front();
+                for (size_t k = vWitnessed[n].second; k < vCommitments.size(); k++) {
+                    witness.append(vCommitments[k]);
                 }
             }
+        };
+        size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), vWitnessed.size());
+        if (nThreads > 1 && nAppends >= WITNESS_UPDATE_PARALLEL_THRESHOLD) {
+            boost::thread_group threadGroup;
+            size_t nChunk = (vWitnessed.size() + nThreads - 1) / nThreads;
+            for (size_t nBegin = nChunk; nBegin < vWitnessed.size(); nBegin += nChunk) {
+                size_t nEnd = std::min(nBegin + nChunk, vWitnessed.size());
+                threadGroup.create_thread([&appendCommitments, nBegin, nEnd]() { appendCommitments(nBegin, nEnd); });
+            }
+            appendCommitments(0, nChunk);
+            threadGroup.join_all();
+        } else {
+            appendCommitments(0, vWitnessed.size());
+        }
+
+        // Update witness heights
+        for (CNoteData* nd : vNotes) {
+            nd->witnessHeight = pindex->nHeight;
+            // Check the validity of the cache
+            // See earlier comment about validity.
+            assert(nWitnessCacheSize >= nd->witnesses.size());
         }
 
         // For performance reasons, we write out the witness cache in
@@ -952,6 +1096,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        // Outputs and notes may have become ours
+        fUnspentIndexDirty = true;
     }
 }
 
@@ -1017,6 +1163,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
         AddToSpends(hash);
+        setUnspentTxs.insert(hash);
     }
     else
     {
@@ -1026,6 +1173,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         UpdateNullifierNoteMapWithTx(wtx);
+        setUnspentTxs.insert(hash);
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
@@ -1164,13 +1312,25 @@ bool CWallet::UpdatedNoteData(const CWalletTx& wtxIn, CWalletTx& wtx)
  * the fly in CMerkleTx::GetDepthInMainChain().
  */
 bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate)
+{
+    AssertLockHeld(cs_wallet);
+    if (!fUpdate && mapWallet.count(tx.GetHash()) != 0) return false;
+    auto noteData = pblock ? FindMyBlockNotes(*pblock, tx) : FindMyNotes(tx);
+    return AddToWalletIfInvolvingMe(tx, pblock, fUpdate, noteData, IsMine(tx));
+}
+
+/**
+ * As above, with the notes and whether the transaction pays to one of our
+ * keys already known, as they are when a rescan matches its blocks ahead.
+ */
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
+                                       mapNoteData_t noteData, bool fIsMine)
 {
     {
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto noteData = FindMyNotes(tx);
-        if (fExisted || IsMine(tx) || IsFromMe(tx) || noteData.size() > 0)
+        if (fExisted || fIsMine || IsFromMe(tx) || noteData.size() > 0)
         {
             CWalletTx wtx(this,tx);
 
@@ -1199,6 +1359,9 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         return; // Not one of ours
 
     MarkAffectedTransactionsDirty(tx);
+    if (pblock) {
+        UpdateUnspentIndex(tx);
+    }
 }
 
 void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
@@ -1227,6 +1390,7 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        setUnspentTxs.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -1278,41 +1442,179 @@ boost::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
  */
 mapNoteData_t CWallet::FindMyNotes(const CTransaction& tx) const
 {
-    LOCK(cs_SpendingKeyStore);
-    uint256 hash = tx.GetHash();
+    return TrialDecryptNotes(std::vector<const CTransaction*>(1, &tx), 0).front();
+}
 
-    mapNoteData_t noteData;
-    for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
-        auto hSig = tx.vjoinsplit[i].h_sig(*pzcashParams, tx.joinSplitPubKey);
-        for (uint8_t j = 0; j < tx.vjoinsplit[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
-                try {
-                    auto address = item.first;
-                    JSOutPoint jsoutpt {hash, i, j};
-                    auto nullifier = GetNoteNullifier(
-                        tx.vjoinsplit[i],
-                        address,
-                        item.second,
-                        hSig, j);
-                    if (nullifier) {
-                        CNoteData nd {address, *nullifier};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    } else {
-                        CNoteData nd {address};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    }
+/**
+ * Finds the notes of a whole batch of transactions, typically the ones of a
+ * block, returning them in the order of vtx. The JoinSplits of all the
+ * transactions are shared among nThreads worker threads, or one per core if
+ * nThreads is zero.
+ */
+std::vector<mapNoteData_t> CWallet::FindMyNotes(const std::vector<CTransaction>& vtx, int nThreads) const
+{
+    std::vector<const CTransaction*> vptx;
+    vptx.reserve(vtx.size());
+    for (const CTransaction& tx : vtx) {
+        vptx.push_back(&tx);
+    }
+    return TrialDecryptNotes(vptx, nThreads);
+}
+
+namespace {
+
+/** A note found by trial decryption, before its nullifier is derived */
+struct DecryptedNote
+{
+    size_t nTx;
+    JSOutPoint jsoutpt;
+    libzcash::PaymentAddress address;
+    libzcash::Note note;
+};
+
+}
+
+std::vector<mapNoteData_t> CWallet::TrialDecryptNotes(const std::vector<const CTransaction*>& vtx, int nThreads) const
+{
+    // Decrypt with a copy of the decryptors, so that the key store is not
+    // locked meanwhile and the block reading threads of a rescan can decrypt
+    // concurrently
+    NoteDecryptorMap decryptors;
+    {
+        LOCK(cs_SpendingKeyStore);
+        decryptors = mapNoteDecryptors;
+    }
+
+    // Each JoinSplit is a unit of work, as its ciphertexts share the DH
+    // secret computed for each of our addresses
+    std::vector<std::pair<size_t, size_t>> vJoinSplits;
+    for (size_t n = 0; n < vtx.size(); n++) {
+        for (size_t i = 0; i < vtx[n]->vjoinsplit.size(); i++) {
+            vJoinSplits.push_back(std::make_pair(n, i));
+        }
+    }
+
+    std::vector<std::vector<DecryptedNote>> vFound(vJoinSplits.size());
+    std::atomic<size_t> nNext(0);
+    auto decryptJoinSplits = [&]() {
+        for (size_t k = nNext++; k < vJoinSplits.size(); k = nNext++) {
+            const CTransaction& tx = *vtx[vJoinSplits[k].first];
+            size_t i = vJoinSplits[k].second;
+            const JSDescription& jsdesc = tx.vjoinsplit[i];
+            auto hSig = jsdesc.h_sig(*pzcashParams, tx.joinSplitPubKey);
+            std::vector<bool> vDecrypted(jsdesc.ciphertexts.size(), false);
+            size_t nLeft = jsdesc.ciphertexts.size();
+            for (const NoteDecryptorMap::value_type& item : decryptors) {
+                if (nLeft == 0) {
                     break;
-                } catch (const note_decryption_failed &err) {
-                    // Couldn't decrypt with this decryptor
+                }
+                uint256 dhsecret;
+                try {
+                    dhsecret = item.second.dh_secret(jsdesc.ephemeralKey);
                 } catch (const std::exception &exc) {
                     // Unexpected failure
                     LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
                     LogPrintf("%s\n", exc.what());
+                    continue;
+                }
+                for (uint8_t j = 0; j < jsdesc.ciphertexts.size(); j++) {
+                    if (vDecrypted[j]) {
+                        continue;
+                    }
+                    try {
+                        auto note = libzcash::NotePlaintext::decrypt(
+                            item.second,
+                            jsdesc.ciphertexts[j],
+                            jsdesc.ephemeralKey,
+                            dhsecret,
+                            hSig,
+                            (unsigned char) j).note(item.first);
+                        // Check note plaintext against note commitment
+                        if (note.cm() != jsdesc.commitments[j]) {
+                            continue;
+                        }
+                        vFound[k].push_back(DecryptedNote {vJoinSplits[k].first, JSOutPoint {tx.GetHash(), i, j}, item.first, note});
+                        vDecrypted[j] = true;
+                        nLeft--;
+                    } catch (const note_decryption_failed &err) {
+                        // Couldn't decrypt with this decryptor
+                    } catch (const std::exception &exc) {
+                        // Unexpected failure
+                        LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
+                        LogPrintf("%s\n", exc.what());
+                    }
                 }
             }
         }
+    };
+
+    size_t nWorkers = std::min<size_t>(nThreads > 0 ? nThreads : std::max(GetNumCores(), 1), vJoinSplits.size());
+    if (nWorkers > 1 && vJoinSplits.size() * decryptors.size() >= NOTE_DECRYPTION_PARALLEL_THRESHOLD) {
+        boost::thread_group threadGroup;
+        for (size_t n = 1; n < nWorkers; n++) {
+            threadGroup.create_thread(decryptJoinSplits);
+        }
+        decryptJoinSplits();
+        threadGroup.join_all();
+    } else {
+        decryptJoinSplits();
+    }
+
+    std::vector<mapNoteData_t> vNoteData(vtx.size());
+    for (const std::vector<DecryptedNote>& vNotes : vFound) {
+        for (const DecryptedNote& found : vNotes) {
+            // SpendingKeys are only available if:
+            // - We have them (this isn't a viewing key)
+            // - The wallet is unlocked
+            libzcash::SpendingKey key;
+            if (GetSpendingKey(found.address, key)) {
+                CNoteData nd {found.address, found.note.nullifier(key)};
+                vNoteData[found.nTx].insert(std::make_pair(found.jsoutpt, nd));
+            } else {
+                CNoteData nd {found.address};
+                vNoteData[found.nTx].insert(std::make_pair(found.jsoutpt, nd));
+            }
+        }
     }
-    return noteData;
+    return vNoteData;
+}
+
+/**
+ * Finds the notes of a transaction of pblock. The first call for a block
+ * decrypts all of its transactions at once, and the following ones are
+ * answered from the result until the block has been synced (see ChainTip).
+ */
+mapNoteData_t CWallet::FindMyBlockNotes(const CBlock& block, const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+    if (tx.vjoinsplit.empty()) {
+        return mapNoteData_t();
+    }
+
+    uint256 hash = block.GetHash();
+    if (hash != hashBlockNotes) {
+        mapBlockNotes.clear();
+        std::vector<mapNoteData_t> vNoteData = FindMyNotes(block.vtx);
+        for (size_t n = 0; n < block.vtx.size(); n++) {
+            if (!block.vtx[n].vjoinsplit.empty()) {
+                mapBlockNotes[block.vtx[n].GetHash()] = vNoteData[n];
+            }
+        }
+        hashBlockNotes = hash;
+    }
+
+    std::map<uint256, mapNoteData_t>::const_iterator it = mapBlockNotes.find(tx.GetHash());
+    if (it == mapBlockNotes.end()) {
+        return FindMyNotes(tx);
+    }
+    return it->second;
+}
+
+void CWallet::ClearBlockNotes()
+{
+    AssertLockHeld(cs_wallet);
+    hashBlockNotes.SetNull();
+    mapBlockNotes.clear();
 }
 
 bool CWallet::IsFromMe(const uint256& nullifier) const
@@ -1767,10 +2069,36 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+namespace {
+
+/** A block of a rescan batch, read and matched against the wallet ahead of its commit */
+struct RescanBlock
+{
+    CBlockIndex* pindex;
+    uint256 hash;
+    CDiskBlockPos pos;
+    bool fRead;
+    CBlock block;
+    std::vector<mapNoteData_t> vNoteData;
+    std::vector<bool> vIsMine;
+
+    RescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), hash(pindexIn->GetBlockHash()), pos(pindexIn->GetBlockPos()), fRead(false) {}
+};
+
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * The blocks are handled in batches of RESCAN_BATCH_SIZE. While a batch is
+ * committed to the wallet, the next one is read from disk and matched against
+ * the keys of the wallet (transparent scripts and note trial decryption) by
+ * one thread per core, without holding any lock. cs_main and cs_wallet are
+ * released between batches, unless the caller holds them, until the rescan
+ * finds a block with notes of ours: from then on the locks are kept so that
+ * their witnesses reach the tip together with the rest of the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1779,6 +2107,8 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     const CChainParams& chainParams = Params();
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1788,36 +2118,134 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+    }
+
+    // Picks the blocks of the active chain following pindexPrev, or starting
+    // at pindexFirst if there is no previous block
+    auto selectBatch = [](CBlockIndex* pindexFirst, CBlockIndex* pindexPrev, std::vector<RescanBlock>& vBatch) {
+        LOCK(cs_main);
+        vBatch.clear();
+        CBlockIndex* pindexNext = pindexFirst;
+        if (pindexPrev) {
+            // Continue from the fork point if the chain was reorganized meanwhile
+            pindexNext = chainActive.Next(chainActive.FindFork(pindexPrev));
+        }
+        while (pindexNext && vBatch.size() < RESCAN_BATCH_SIZE) {
+            vBatch.push_back(RescanBlock(pindexNext));
+            pindexNext = chainActive.Next(pindexNext);
+        }
+    };
+
+    // Reads the blocks of a batch and matches their transactions, one block
+    // per thread. Whether they spend from the wallet depends on the blocks
+    // before them, so IsFromMe() is left to the commit.
+    auto readBatch = [this](std::vector<RescanBlock>* pvBatch) {
+        std::atomic<size_t> nNext(0);
+        auto readBlocks = [this, pvBatch, &nNext]() {
+            for (size_t n = nNext++; n < pvBatch->size(); n = nNext++) {
+                RescanBlock& rb = (*pvBatch)[n];
+                if (!ReadBlockFromDisk(rb.block, rb.pos) || rb.block.GetHash() != rb.hash) {
+                    // Read again, and matched serially, by the commit
+                    continue;
+                }
+                rb.vNoteData = FindMyNotes(rb.block.vtx, 1);
+                rb.vIsMine.resize(rb.block.vtx.size());
+                for (size_t i = 0; i < rb.block.vtx.size(); i++) {
+                    rb.vIsMine[i] = IsMine(rb.block.vtx[i]);
+                }
+                rb.fRead = true;
+            }
+        };
+        size_t nWorkers = std::min<size_t>(std::max(GetNumCores(), 1), pvBatch->size());
+        boost::thread_group threadGroup;
+        for (size_t n = 1; n < nWorkers; n++) {
+            threadGroup.create_thread(readBlocks);
+        }
+        readBlocks();
+        threadGroup.join_all();
+    };
+
+    // Held from the first block with notes of ours to the end of the rescan
+    std::unique_ptr<CCriticalBlock> lockMain;
+    std::unique_ptr<CCriticalBlock> lockWallet;
+
+    std::vector<RescanBlock> vBatch;
+    selectBatch(pindex, NULL, vBatch);
+    readBatch(&vBatch);
+    while (!vBatch.empty()) {
+        // Prefetch the next batch while this one is committed
+        std::vector<RescanBlock> vNext;
+        selectBatch(NULL, vBatch.back().pindex, vNext);
+        std::future<void> nextRead = std::async(std::launch::async, readBatch, &vNext);
+
+        CBlockIndex* pindexLast = NULL;
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK2(cs_main, cs_wallet);
+            for (RescanBlock& rb : vBatch) {
+                if (!chainActive.Contains(rb.pindex)) {
+                    // Reorganized since the batch was picked
+                    break;
+                }
+                if (rb.pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), rb.pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
-            {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
+                if (rb.fRead) {
+                    for (size_t i = 0; i < rb.block.vtx.size(); i++) {
+                        if (AddToWalletIfInvolvingMe(rb.block.vtx[i], &rb.block, fUpdate, rb.vNoteData[i], rb.vIsMine[i]))
+                            ret++;
+                    }
+                } else {
+                    ReadBlockFromDisk(rb.block, rb.pindex);
+                    BOOST_FOREACH(CTransaction& tx, rb.block.vtx)
+                    {
+                        if (AddToWalletIfInvolvingMe(tx, &rb.block, fUpdate))
+                            ret++;
+                    }
+                    ClearBlockNotes();
+                }
 
-            ZCIncrementalMerkleTree tree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetAnchorAt(pindex->hashAnchor, tree));
-            // Increment note witness caches
-            IncrementNoteWitnesses(pindex, &block, tree);
+                ZCIncrementalMerkleTree tree;
+                // This should never fail: we should always be able to get the tree
+                // state on the path to the tip of our chain
+                assert(pcoinsTip->GetAnchorAt(rb.pindex->hashAnchor, tree));
+                // Increment note witness caches
+                IncrementNoteWitnesses(rb.pindex, &rb.block, tree);
+
+                if (!lockMain) {
+                    for (const CTransaction& tx : rb.block.vtx) {
+                        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(tx.GetHash());
+                        if (mi != mapWallet.end() && !mi->second.mapNoteData.empty()) {
+                            lockMain.reset(new CCriticalBlock(cs_main, "cs_main", __FILE__, __LINE__));
+                            lockWallet.reset(new CCriticalBlock(cs_wallet, "cs_wallet", __FILE__, __LINE__));
+                            break;
+                        }
+                    }
+                }
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                pindexLast = rb.pindex;
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", rb.pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), rb.pindex));
+                }
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        nextRead.get();
+        if (pindexLast != vBatch.back().pindex) {
+            // The prefetched batch followed blocks that left the active chain
+            selectBatch(NULL, pindexLast ? pindexLast : vBatch.front().pindex->pprev, vNext);
+            readBatch(&vNext);
+        }
+        vBatch.swap(vNext);
+    }
+    {
+        LOCK(cs_wallet);
+        // Leave out the history the rescan went through
+        fUnspentIndexDirty = true;
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -2129,9 +2557,9 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -2145,9 +2573,9 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -2160,9 +2588,9 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -2174,9 +2602,9 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2190,9 +2618,9 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2205,9 +2633,9 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& hash : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(hash);
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -2223,10 +2651,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const uint256& wtxid : GetUnspentTxs())
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.at(wtxid);
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -2247,8 +2674,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 isminetype mine = IsMine(pcoin->vout[i]);
                 if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected((*it).first, i)))
+                    !IsLockedCoin(wtxid, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(wtxid, i)))
                 {
                     if (pcoin->IsCoinBase())
                     {
@@ -3673,8 +4100,20 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
 
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
+    // Notes that are not spent can only be in the unspent index
+    std::vector<const CWalletTx*> vwtx;
+    if (ignoreSpent) {
+        for (const uint256& hash : GetUnspentTxs()) {
+            vwtx.push_back(&mapWallet.at(hash));
+        }
+    } else {
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+            vwtx.push_back(&item.second);
+        }
+    }
+
+    for (const CWalletTx* pwtx : vwtx) {
+        const CWalletTx& wtx = *pwtx;
 
         // Filter the transactions before checking for notes
         if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < minDepth) {
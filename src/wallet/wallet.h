@@ -51,6 +51,8 @@ static const CAmount nHighTransactionFeeWarning = 0.01 * COIN;
 static const CAmount DEFAULT_TRANSACTION_MAXFEE = 0.1 * COIN;
 //! -txconfirmtarget default
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 2;
+//! -joinsplitthreads default: every Groth16 proof in flight loads its own copy of the proving parameters
+static const unsigned int DEFAULT_JOINSPLIT_THREADS = 1;
 //! -maxtxfee will warn if called with a higher fee than this amount (in satoshis)
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
@@ -59,6 +61,14 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //  Should be large enough that we can expect not to reorg beyond our cache
 //  unless there is some exceptional network disruption.
 static const unsigned int WITNESS_CACHE_SIZE = COINBASE_MATURITY;
+//! Number of commitment appends in a block above which the wallet witnesses
+//  are brought up to date on several threads
+static const size_t WITNESS_UPDATE_PARALLEL_THRESHOLD = 20000;
+//! Number of trial decryptions (JoinSplits x addresses) in a batch above which
+//  they are spread over several threads
+static const size_t NOTE_DECRYPTION_PARALLEL_THRESHOLD = 64;
+//! Number of blocks read ahead and matched together by a wallet rescan
+static const size_t RESCAN_BATCH_SIZE = 64;
 
 class CBlockIndex;
 class CCoinControl;
@@ -692,6 +702,34 @@ private:
     void AddToSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Notes of the transactions of the block being synced, found by trial
+     * decrypting the whole block at once (see FindMyBlockNotes).
+     */
+    uint256 hashBlockNotes;
+    std::map<uint256, mapNoteData_t> mapBlockNotes;
+
+    std::vector<mapNoteData_t> TrialDecryptNotes(const std::vector<const CTransaction*>& vtx, int nThreads) const;
+    mapNoteData_t FindMyBlockNotes(const CBlock& block, const CTransaction& tx);
+    void ClearBlockNotes();
+
+    /**
+     * Wallet transactions that may still hold outputs or notes of ours not
+     * spent in the active chain. Balances and coin selection only look at
+     * these, which keeps them proportional to the unspent part of the wallet
+     * rather than to its whole history. The index is updated as spends are
+     * synced, and rebuilt from mapWallet when it is marked dirty (blocks
+     * disconnected, keys imported, rescans).
+     */
+    mutable std::set<uint256> setUnspentTxs;
+    mutable bool fUnspentIndexDirty;
+
+    bool IsSpentInChain(const uint256& hash, unsigned int n) const;
+    bool IsSpentInChain(const uint256& nullifier) const;
+    bool IsSettled(const CWalletTx& wtx) const;
+    void UpdateUnspentIndex(const CTransaction& tx);
+    const std::set<uint256>& GetUnspentTxs() const;
+
 public:
     /*
      * Size of the incremental witness cache for the notes in our wallet.
@@ -821,6 +859,7 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        fUnspentIndexDirty = true;
     }
 
     /**
@@ -984,6 +1023,8 @@ public:
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
+                                  mapNoteData_t noteData, bool fIsMine);
     void EraseFromWallet(const uint256 &hash);
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
@@ -1030,6 +1071,7 @@ public:
         const uint256& hSig,
         uint8_t n) const;
     mapNoteData_t FindMyNotes(const CTransaction& tx) const;
+    std::vector<mapNoteData_t> FindMyNotes(const std::vector<CTransaction>& vtx, int nThreads = 0) const;
     bool IsFromMe(const uint256& nullifier) const;
     void GetNoteWitnesses(
          std::vector<JSOutPoint> notes,
@@ -1048,7 +1090,7 @@ public:
     CAmount GetDebit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetCredit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetChange(const CTransaction& tx) const;
-    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree &tree, bool added);
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc);
 
@@ -10,6 +10,12 @@
 #include <boost/format.hpp>
 #include <boost/optional.hpp>
 #include <fstream>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <libsnark/common/default_types/r1cs_ppzksnark_pp.hpp>
 #include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
 #include <libsnark/gadgetlib1/gadgets/hashes/sha256/sha256_gadget.hpp>
@@ -66,6 +72,50 @@ void loadFromFile(const std::string path, T& objIn) {
     objIn = std::move(obj);
 }
 
+#ifndef WIN32
+// Reads straight from a file mapping, without copying the file to a stringstream
+class MappedFileBuf : public std::streambuf {
+public:
+    MappedFileBuf(char* begin, size_t len) {
+        setg(begin, begin, begin + len);
+    }
+};
+#endif
+
+template<typename T>
+void loadFromMappedFile(const std::string path, T& objIn) {
+#ifdef WIN32
+    loadFromFile(path, objIn);
+#else
+    LOCK(cs_ParamsIO);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(strprintf("could not load param file at %s", path));
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(strprintf("could not map param file at %s", path));
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    try {
+        MappedFileBuf buf(static_cast<char*>(data), st.st_size);
+        std::istream is(&buf);
+        is >> objIn;
+    } catch (...) {
+        munmap(data, st.st_size);
+        throw;
+    }
+    munmap(data, st.st_size);
+#endif
+}
+
 template<size_t NumInputs, size_t NumOutputs>
 class JoinSplitCircuit : public JoinSplit<NumInputs, NumOutputs> {
 public:
@@ -76,6 +126,11 @@ public:
     r1cs_ppzksnark_processed_verification_key<ppzksnark_ppT> vk_precomp;
     std::string pkPath;
 
+    // The proving key when kept in memory. Provers hold a reference, so it can be
+    // unloaded while they run.
+    std::shared_ptr<const r1cs_ppzksnark_proving_key<ppzksnark_ppT>> pk;
+    CCriticalSection cs_pk;
+
     JoinSplitCircuit(const std::string vkPath, const std::string pkPath) : pkPath(pkPath) {
         loadFromFile(vkPath, vk);
         vk_precomp = r1cs_ppzksnark_verifier_process_vk(vk);
@@ -101,6 +156,32 @@ public:
         saveToFile(pkPath, keypair.pk);
     }
 
+    void loadProvingKey() {
+        {
+            LOCK(cs_pk);
+            if (pk)
+                return;
+        }
+
+        // Parse the points once; proofs can be made from the file meanwhile
+        auto pkLoaded = std::make_shared<r1cs_ppzksnark_proving_key<ppzksnark_ppT>>();
+        loadFromMappedFile(pkPath, *pkLoaded);
+
+        LOCK(cs_pk);
+        if (!pk)
+            pk = pkLoaded;
+    }
+
+    void unloadProvingKey() {
+        LOCK(cs_pk);
+        pk.reset();
+    }
+
+    bool hasProvingKey() {
+        LOCK(cs_pk);
+        return bool(pk);
+    }
+
     bool verify(
         const PHGRProof& proof,
         ProofVerifier& verifier,
@@ -353,6 +434,20 @@ public:
         // estimate that it doesn't matter if we check every time.
         pb.constraint_system.swap_AB_if_beneficial();
 
+        std::shared_ptr<const r1cs_ppzksnark_proving_key<ppzksnark_ppT>> pkCached;
+        {
+            LOCK(cs_pk);
+            pkCached = pk;
+        }
+        if (pkCached) {
+            return PHGRProof(r1cs_ppzksnark_prover<ppzksnark_ppT>(
+                *pkCached,
+                primary_input,
+                aux_input,
+                pb.constraint_system
+            ));
+        }
+
         std::ifstream fh(pkPath, std::ios::binary);
 
         if(!fh.is_open()) {
@@ -90,6 +90,12 @@ public:
         uint256 *out_esk = nullptr
     ) = 0;
 
+    // Keep the PHGR proving key in memory, shared by all the provers, instead of
+    // reading it from disk for every proof
+    virtual void loadProvingKey() = 0;
+    virtual void unloadProvingKey() = 0;
+    virtual bool hasProvingKey() = 0;
+
     virtual bool verify(
         const PHGRProof& proof,
         ProofVerifier& verifier,
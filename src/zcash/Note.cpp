@@ -61,7 +61,19 @@ NotePlaintext NotePlaintext::decrypt(const ZCNoteDecryption& decryptor,
                                      unsigned char nonce
                                     )
 {
-    auto plaintext = decryptor.decrypt(ciphertext, ephemeralKey, h_sig, nonce);
+    return decrypt(decryptor, ciphertext, ephemeralKey,
+                   decryptor.dh_secret(ephemeralKey), h_sig, nonce);
+}
+
+NotePlaintext NotePlaintext::decrypt(const ZCNoteDecryption& decryptor,
+                                     const ZCNoteDecryption::Ciphertext& ciphertext,
+                                     const uint256& ephemeralKey,
+                                     const uint256& dhsecret,
+                                     const uint256& h_sig,
+                                     unsigned char nonce
+                                    )
+{
+    auto plaintext = decryptor.decrypt(ciphertext, ephemeralKey, dhsecret, h_sig, nonce);
 
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << plaintext;
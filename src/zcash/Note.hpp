@@ -91,6 +91,15 @@ public:
                                  unsigned char nonce
                                 );
 
+    // As above, with the DH secret of the JoinSplit already computed
+    static NotePlaintext decrypt(const ZCNoteDecryption& decryptor,
+                                 const ZCNoteDecryption::Ciphertext& ciphertext,
+                                 const uint256& ephemeralKey,
+                                 const uint256& dhsecret,
+                                 const uint256& h_sig,
+                                 unsigned char nonce
+                                );
+
     ZCNoteEncryption::Ciphertext encrypt(ZCNoteEncryption& encryptor,
                                          const uint256& pk_enc
                                         ) const;
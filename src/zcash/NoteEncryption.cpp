@@ -106,6 +106,12 @@ typename NoteDecryption<MLEN>::Plaintext NoteDecryption<MLEN>::decrypt
                                           const uint256 &hSig,
                                           unsigned char nonce
                                          ) const
+{
+    return decrypt(ciphertext, epk, dh_secret(epk), hSig, nonce);
+}
+
+template<size_t MLEN>
+uint256 NoteDecryption<MLEN>::dh_secret(const uint256 &epk) const
 {
     uint256 dhsecret;
 
@@ -113,6 +119,18 @@ typename NoteDecryption<MLEN>::Plaintext NoteDecryption<MLEN>::decrypt
         throw std::logic_error("Could not create DH secret");
     }
 
+    return dhsecret;
+}
+
+template<size_t MLEN>
+typename NoteDecryption<MLEN>::Plaintext NoteDecryption<MLEN>::decrypt
+                                         (const NoteDecryption<MLEN>::Ciphertext &ciphertext,
+                                          const uint256 &epk,
+                                          const uint256 &dhsecret,
+                                          const uint256 &hSig,
+                                          unsigned char nonce
+                                         ) const
+{
     unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE];
     KDF(K, dhsecret, epk, pk_enc, hSig, nonce);
 
@@ -78,6 +78,19 @@ public:
                       unsigned char nonce
                      ) const;
 
+    // Computes the DH secret shared with the sender from the ephemeral
+    // public key of a JoinSplit. It is the same for all of its ciphertexts,
+    // so trial decryption only needs to compute it once per JoinSplit.
+    uint256 dh_secret(const uint256 &epk) const;
+
+    // Decrypts `ciphertext` with a DH secret obtained from dh_secret().
+    Plaintext decrypt(const Ciphertext &ciphertext,
+                      const uint256 &epk,
+                      const uint256 &dhsecret,
+                      const uint256 &hSig,
+                      unsigned char nonce
+                     ) const;
+
     friend inline bool operator==(const NoteDecryption& a, const NoteDecryption& b) {
         return a.sk_enc == b.sk_enc && a.pk_enc == b.pk_enc;
     }
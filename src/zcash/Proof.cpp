@@ -2,6 +2,7 @@
 
 #include "crypto/common.h"
 
+#include <algorithm>
 #include <boost/static_assert.hpp>
 #include <libsnark/common/default_types/r1cs_ppzksnark_pp.hpp>
 #include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
@@ -16,6 +17,7 @@ typedef alt_bn128_pp::GT_type curve_GT;
 typedef alt_bn128_pp::Fp_type curve_Fr;
 typedef alt_bn128_pp::Fq_type curve_Fq;
 typedef alt_bn128_pp::Fqe_type curve_Fq2;
+typedef alt_bn128_pp::Fqk_type curve_Fq12;
 
 BOOST_STATIC_ASSERT(sizeof(mp_limb_t) == 8);
 
@@ -223,6 +225,22 @@ void initialize_curve_params()
     std::call_once (init_public_params_once_flag, curve_pp::init_public_params);
 }
 
+struct ProofBatch {
+    struct Entry {
+        const r1cs_ppzksnark_processed_verification_key<curve_pp>* pvk;
+        r1cs_primary_input<curve_Fr> primary_input;
+        r1cs_ppzksnark_proof<curve_pp> proof;
+    };
+
+    std::vector<Entry> entries;
+};
+
+ProofVerifier::ProofVerifier(bool perform_verification, bool batch_verification) :
+    perform_verification(perform_verification),
+    batch(batch_verification ? new ProofBatch() : nullptr) { }
+
+ProofVerifier::~ProofVerifier() { }
+
 ProofVerifier ProofVerifier::Strict() {
     initialize_curve_params();
     return ProofVerifier(true);
@@ -233,6 +251,11 @@ ProofVerifier ProofVerifier::Disabled() {
     return ProofVerifier(false);
 }
 
+ProofVerifier ProofVerifier::Batch() {
+    initialize_curve_params();
+    return ProofVerifier(true, true);
+}
+
 template<>
 bool ProofVerifier::check(
     const r1cs_ppzksnark_verification_key<curve_pp>& vk,
@@ -241,11 +264,140 @@ bool ProofVerifier::check(
     const r1cs_ppzksnark_proof<curve_pp>& proof
 )
 {
-    if (perform_verification) {
-        return r1cs_ppzksnark_online_verifier_strong_IC<curve_pp>(pvk, primary_input, proof);
-    } else {
+    if (!perform_verification) {
+        return true;
+    }
+
+    if (batch) {
+        // Reject what the strong IC verifier would reject before
+        // getting to the pairings; those are left to verify_batch().
+        if (pvk.encoded_IC_query.domain_size() != primary_input.size() || !proof.is_well_formed()) {
+            return false;
+        }
+        batch->entries.push_back({&pvk, primary_input, proof});
         return true;
     }
+
+    return r1cs_ppzksnark_online_verifier_strong_IC<curve_pp>(pvk, primary_input, proof);
+}
+
+// Returns a random 128-bit scalar, which makes the chance of an invalid
+// proof cancelling out in the combined check negligible.
+static bigint<2> random_batch_scalar()
+{
+    bigint<2> r;
+    randombytes_buf(r.data, sizeof(r.data));
+    return r;
+}
+
+// Checks the five PHGR13 verification equations of every proof at once.
+// Each equation of each proof is raised to an independent random scalar and
+// all of them are multiplied together; terms sharing a fixed verification
+// key element are aggregated on the other side of the pairing, so only the
+// e(A + acc, B) term needs one Miller loop per proof, and there is a single
+// final exponentiation.
+static bool verify_combined(const std::vector<ProofBatch::Entry>& entries)
+{
+    const auto& pvk = *entries[0].pvk;
+
+    curve_G1 g1_one = curve_G1::zero();         // paired with G2::one()
+    curve_G1 g1_alphaA = curve_G1::zero();      // paired with vk.alphaA_g2
+    curve_G1 g1_alphaC = curve_G1::zero();      // paired with vk.alphaC_g2
+    curve_G1 g1_rC_Z = curve_G1::zero();        // paired with vk.rC_Z_g2
+    curve_G1 g1_gamma = curve_G1::zero();       // paired with vk.gamma_g2
+    curve_G1 g1_gamma_beta = curve_G1::zero();  // paired with vk.gamma_beta_g2
+    curve_G2 g2_alphaB = curve_G2::zero();      // paired with vk.alphaB_g1
+    curve_G2 g2_gamma_beta = curve_G2::zero();  // paired with vk.gamma_beta_g1
+
+    curve_Fq12 result = curve_Fq12::one();
+
+    for (const auto& entry : entries) {
+        const auto& proof = entry.proof;
+        const curve_G1 acc = pvk.encoded_IC_query.template accumulate_chunk<curve_Fr>(
+            entry.primary_input.begin(), entry.primary_input.end(), 0).first;
+        const curve_G1 A_acc = proof.g_A.g + acc;
+
+        const auto r1 = random_batch_scalar();
+        const auto r2 = random_batch_scalar();
+        const auto r3 = random_batch_scalar();
+        const auto r4 = random_batch_scalar();
+        const auto r5 = random_batch_scalar();
+
+        // e(A_g, alphaA) = e(A_h, 1)
+        g1_alphaA = g1_alphaA + r1 * proof.g_A.g;
+        g1_one = g1_one - r1 * proof.g_A.h;
+        // e(alphaB, B_g) = e(B_h, 1)
+        g2_alphaB = g2_alphaB + r2 * proof.g_B.g;
+        g1_one = g1_one - r2 * proof.g_B.h;
+        // e(C_g, alphaC) = e(C_h, 1)
+        g1_alphaC = g1_alphaC + r3 * proof.g_C.g;
+        g1_one = g1_one - r3 * proof.g_C.h;
+        // e(A_g + acc, B_g) = e(H, rC_Z) * e(C_g, 1)
+        const curve_G1 qap = r4 * A_acc;
+        if (!qap.is_zero() && !proof.g_B.g.is_zero()) {
+            result = result * curve_pp::miller_loop(curve_pp::precompute_G1(qap),
+                                                    curve_pp::precompute_G2(proof.g_B.g));
+        }
+        g1_rC_Z = g1_rC_Z - r4 * proof.g_H;
+        g1_one = g1_one - r4 * proof.g_C.g;
+        // e(K, gamma) = e(A_g + acc + C_g, gamma_beta_g2) * e(gamma_beta_g1, B_g)
+        g1_gamma = g1_gamma + r5 * proof.g_K;
+        g1_gamma_beta = g1_gamma_beta - r5 * (A_acc + proof.g_C.g);
+        g2_gamma_beta = g2_gamma_beta - r5 * proof.g_B.g;
+    }
+
+    // Pairings with the identity are one, and are skipped as the
+    // Miller loop is not defined for it.
+    auto pair_vk_g2 = [&](const curve_G1& P, const G2_precomp<curve_pp>& vk_precomp) {
+        if (!P.is_zero()) {
+            result = result * curve_pp::miller_loop(curve_pp::precompute_G1(P), vk_precomp);
+        }
+    };
+    auto pair_vk_g1 = [&](const G1_precomp<curve_pp>& vk_precomp, const curve_G2& Q) {
+        if (!Q.is_zero()) {
+            result = result * curve_pp::miller_loop(vk_precomp, curve_pp::precompute_G2(Q));
+        }
+    };
+
+    pair_vk_g2(g1_one, pvk.pp_G2_one_precomp);
+    pair_vk_g2(g1_alphaA, pvk.vk_alphaA_g2_precomp);
+    pair_vk_g2(g1_alphaC, pvk.vk_alphaC_g2_precomp);
+    pair_vk_g2(g1_rC_Z, pvk.vk_rC_Z_g2_precomp);
+    pair_vk_g2(g1_gamma, pvk.vk_gamma_g2_precomp);
+    pair_vk_g2(g1_gamma_beta, pvk.vk_gamma_beta_g2_precomp);
+    pair_vk_g1(pvk.vk_alphaB_g1_precomp, g2_alphaB);
+    pair_vk_g1(pvk.vk_gamma_beta_g1_precomp, g2_gamma_beta);
+
+    return curve_pp::final_exponentiation(result) == curve_GT::one();
+}
+
+bool ProofVerifier::verify_batch(size_t* invalid_index)
+{
+    if (!batch || batch->entries.empty()) {
+        return true;
+    }
+
+    std::vector<ProofBatch::Entry> entries;
+    entries.swap(batch->entries);
+
+    // The combined check needs a single verification key
+    bool same_vk = std::all_of(entries.begin(), entries.end(),
+        [&](const ProofBatch::Entry& entry) { return entry.pvk == entries[0].pvk; });
+    if (same_vk && verify_combined(entries)) {
+        return true;
+    }
+
+    // Find the culprit. Individual verification is authoritative, so
+    // this also covers the negligible chance of a false negative.
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!r1cs_ppzksnark_online_verifier_strong_IC<curve_pp>(*entries[i].pvk, entries[i].primary_input, entries[i].proof)) {
+            if (invalid_index) {
+                *invalid_index = i;
+            }
+            return false;
+        }
+    }
+    return true;
 }
 
 }
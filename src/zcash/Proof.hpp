@@ -4,6 +4,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+
 namespace libzcash {
 
 const unsigned char G1_PREFIX_MASK = 0x02;
@@ -237,11 +239,17 @@ public:
 
 void initialize_curve_params();
 
+struct ProofBatch;
+
 class ProofVerifier {
 private:
     bool perform_verification;
 
-    ProofVerifier(bool perform_verification) : perform_verification(perform_verification) { }
+    // Proofs accumulated by a batch verification context,
+    // NULL for all other contexts.
+    std::unique_ptr<ProofBatch> batch;
+
+    ProofVerifier(bool perform_verification, bool batch_verification = false);
 
 public:
     // ProofVerifier should never be copied
@@ -249,6 +257,7 @@ public:
     ProofVerifier& operator=(const ProofVerifier&) = delete;
     ProofVerifier(ProofVerifier&&);
     ProofVerifier& operator=(ProofVerifier&&);
+    ~ProofVerifier();
 
     // Creates a verification context that strictly verifies
     // all proofs using libsnark's API.
@@ -259,6 +268,20 @@ public:
     // such as during reindexing.
     static ProofVerifier Disabled();
 
+    // Creates a verification context that only performs the
+    // cheap per-proof checks in check(), and defers the pairing
+    // checks of all proofs to a single randomized multi-pairing
+    // in verify_batch().
+    static ProofVerifier Batch();
+
+    // Verifies all proofs accumulated since the last call, and
+    // returns whether they are all valid. If the combined check
+    // fails, the proofs are verified one by one, and the index
+    // of the first invalid one (in the order check() was called)
+    // is stored in invalid_index. Always true for contexts which
+    // are not batching.
+    bool verify_batch(size_t* invalid_index = nullptr);
+
     template <typename VerificationKey,
               typename ProcessedVerificationKey,
               typename PrimaryInput,
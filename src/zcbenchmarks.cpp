@@ -3,33 +3,45 @@
 #include <map>
 #include <thread>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #include "coins.h"
 #include "util.h"
 #include "init.h"
 #include "primitives/transaction.h"
 #include "base58.h"
+#include "blockfilemap.h"
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
+#include "net.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
 #include "txdb.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
+#include "zen/tlsmanager.h"
 
 #include "zcbenchmarks.h"
 
 #include "zcash/Zcash.h"
 #include "zcash/IncrementalMerkleTree.hpp"
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 using namespace libzcash;
 // This method is based on Shutdown from init.cpp
 void pre_wallet_load()
@@ -106,7 +118,7 @@ double benchmark_parameter_loading()
     return ret;
 }
 
-double benchmark_create_joinsplit()
+double benchmark_create_joinsplit(bool makeGrothProof)
 {
     uint256 pubKeyHash;
 
@@ -115,7 +127,7 @@ double benchmark_create_joinsplit()
 
     struct timeval tv_start;
     timer_start(tv_start);
-    JSDescription jsdesc(true,
+    JSDescription jsdesc(makeGrothProof,
 						 *pzcashParams,
                          pubKeyHash,
                          anchor,
@@ -130,13 +142,13 @@ double benchmark_create_joinsplit()
     return ret;
 }
 
-std::vector<double> benchmark_create_joinsplit_threaded(int nThreads)
+std::vector<double> benchmark_create_joinsplit_threaded(int nThreads, bool makeGrothProof)
 {
     std::vector<double> ret;
     std::vector<std::future<double>> tasks;
     std::vector<std::thread> threads;
     for (int i = 0; i < nThreads; i++) {
-        std::packaged_task<double(void)> task(&benchmark_create_joinsplit);
+        std::packaged_task<double(void)> task(std::bind(&benchmark_create_joinsplit, makeGrothProof));
         tasks.emplace_back(task.get_future());
         threads.emplace_back(std::move(task));
     }
@@ -161,6 +173,251 @@ double benchmark_verify_joinsplit(const JSDescription &joinsplit)
     return timer_stop(tv_start);
 }
 
+double benchmark_verify_block_joinsplits(size_t nJoinSplits, int nThreads)
+{
+    // A block's worth of proof checks, all against the same valid JoinSplit,
+    // as ConnectBlock queues them when -par is in effect.
+    auto sk = libzcash::SpendingKey::random();
+    CTransaction tx = GetValidReceive(*pzcashParams, sk, 10, true);
+
+    CCheckQueue<CProofCheck> queue(8);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads - 1; i++) {
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CProofCheck>::Thread, &queue));
+    }
+
+    std::vector<CProofCheck> vChecks;
+    for (size_t i = 0; i < nJoinSplits; i++) {
+        vChecks.push_back(CProofCheck(tx, 0));
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    {
+        CCheckQueueControl<CProofCheck> control(&queue);
+        control.Add(vChecks);
+        assert(control.Wait());
+    }
+    double ret = timer_stop(tv_start);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    return ret;
+}
+
+double benchmark_sigcache_lookup(size_t nSigs, int nThreads)
+{
+    // Fill the signature cache with nSigs valid signatures, then time every
+    // thread looking all of them up, as parallel script checks do during
+    // ConnectBlock.
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::vector<uint256> vHashes(nSigs);
+    std::vector<std::vector<unsigned char> > vSigs(nSigs);
+    for (size_t i = 0; i < nSigs; i++) {
+        vHashes[i] = GetRandHash();
+        assert(key.Sign(vHashes[i], vSigs[i]));
+    }
+
+    CachingTransactionSignatureChecker checker(NULL, 0, NULL, true);
+    for (size_t i = 0; i < nSigs; i++) {
+        assert(checker.VerifySignature(vSigs[i], pubkey, vHashes[i]));
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    boost::thread_group threadGroup;
+    for (int t = 0; t < nThreads; t++) {
+        threadGroup.create_thread([&checker, &vSigs, &vHashes, &pubkey, nSigs]() {
+            for (size_t i = 0; i < nSigs; i++) {
+                assert(checker.VerifySignature(vSigs[i], pubkey, vHashes[i]));
+            }
+        });
+    }
+    threadGroup.join_all();
+    return timer_stop(tv_start);
+}
+
+double benchmark_socket_events(size_t nPeers, const std::string& strMode)
+{
+    // One round of the socket handler's readiness wait with nPeers idle
+    // local peers, one of which has received a message. select() rebuilds
+    // and scans the fd_set every round, epoll only reports the active peer.
+    SocketEventsMode mode;
+    if (!ParseSocketEventsMode(strMode, mode))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid socket events mode");
+
+    std::vector<std::pair<SOCKET, SOCKET> > vPeers;
+    for (size_t i = 0; i < nPeers; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        vPeers.push_back(std::make_pair(fds[0], fds[1]));
+    }
+    if (vPeers.size() < nPeers || (mode == SOCKETEVENTS_SELECT && !IsSelectableSocket(vPeers.back().second))) {
+        for (size_t i = 0; i < vPeers.size(); i++) {
+            CloseSocket(vPeers[i].first);
+            CloseSocket(vPeers[i].second);
+        }
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many peers for this socket events mode");
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    SOCKET hEpoll = INVALID_SOCKET;
+    if (mode == SOCKETEVENTS_EPOLL) {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        for (size_t i = 0; i < nPeers; i++) {
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLET;
+            event.data.u64 = i;
+            epoll_ctl(hEpoll, EPOLL_CTL_ADD, vPeers[i].second, &event);
+        }
+    }
+#endif
+
+    const int nRounds = 1000;
+    char ch = 0;
+    size_t nReady = 0;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (int round = 0; round < nRounds; round++) {
+        size_t nActive = round % nPeers;
+        assert(send(vPeers[nActive].first, &ch, 1, 0) == 1);
+#ifdef HAVE_SYS_EPOLL_H
+        if (mode == SOCKETEVENTS_EPOLL) {
+            std::vector<struct epoll_event> vEvents(nPeers);
+            int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), 50);
+            for (int i = 0; i < nEvents; i++) {
+                recv(vPeers[vEvents[i].data.u64].second, &ch, 1, MSG_DONTWAIT);
+                nReady++;
+            }
+            continue;
+        }
+#endif
+        fd_set fdsetRecv;
+        FD_ZERO(&fdsetRecv);
+        SOCKET hSocketMax = 0;
+        for (size_t i = 0; i < nPeers; i++) {
+            FD_SET(vPeers[i].second, &fdsetRecv);
+            hSocketMax = std::max(hSocketMax, vPeers[i].second);
+        }
+        struct timeval timeout = MillisToTimeval(50);
+        select(hSocketMax + 1, &fdsetRecv, NULL, NULL, &timeout);
+        for (size_t i = 0; i < nPeers; i++) {
+            if (FD_ISSET(vPeers[i].second, &fdsetRecv)) {
+                recv(vPeers[i].second, &ch, 1, MSG_DONTWAIT);
+                nReady++;
+            }
+        }
+    }
+    double ret = timer_stop(tv_start);
+    assert(nReady == (size_t)nRounds);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != INVALID_SOCKET)
+        CloseSocket(hEpoll);
+#endif
+    for (size_t i = 0; i < nPeers; i++) {
+        CloseSocket(vPeers[i].first);
+        CloseSocket(vPeers[i].second);
+    }
+    return ret;
+}
+
+double benchmark_tls_accept(size_t nPeers, size_t nSlowPeers)
+{
+    // nPeers local clients connect concurrently while nSlowPeers connected
+    // peers never send a ClientHello. The server side is driven the way
+    // ThreadSocketHandler drives inbound handshakes. Returns the time until
+    // every well-behaved peer is accepted; the accept rate is nPeers over it.
+    if (tls_ctx_server == NULL || tls_ctx_client == NULL)
+        throw JSONRPCError(RPC_MISC_ERROR, "TLS is not initialized");
+
+    zen::TLSManager tls;
+    size_t nTotal = nPeers + nSlowPeers;
+    std::vector<SOCKET> vServer, vClient;
+    std::vector<SSL*> vServerSSL;
+    for (size_t i = 0; i < nTotal; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        vServer.push_back(fds[0]);
+        vClient.push_back(fds[1]);
+        SetSocketNonBlocking(vServer.back(), true);
+        SetSocketNonBlocking(vClient.back(), true);
+        unsigned long err_code = 0;
+        vServerSSL.push_back(tls.startHandshake(vServer.back(), zen::SERVER_CONTEXT, err_code));
+        assert(vServerSSL.back() != NULL);
+    }
+    if (vServer.size() < nTotal) {
+        for (size_t i = 0; i < vServer.size(); i++) {
+            SSL_free(vServerSSL[i]);
+            CloseSocket(vServer[i]);
+            CloseSocket(vClient[i]);
+        }
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many peers");
+    }
+
+    std::vector<SSL*> vClientSSL(nPeers, NULL);
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    boost::thread_group clients;
+    for (size_t i = 0; i < nPeers; i++) {
+        clients.create_thread([&tls, &vClient, &vClientSSL, i]() {
+            SSL* ssl = SSL_new(tls_ctx_client);
+            SSL_set_fd(ssl, vClient[i]);
+            unsigned long err_code = 0;
+            tls.waitFor(zen::SSL_CONNECT, vClient[i], ssl, DEFAULT_CONNECT_TIMEOUT / 1000, err_code);
+            vClientSSL[i] = ssl;
+        });
+    }
+
+    std::vector<struct pollfd> vPoll(nTotal);
+    for (size_t i = 0; i < nTotal; i++) {
+        vPoll[i].fd = vServer[i];
+        vPoll[i].events = POLLIN;
+    }
+    size_t nAccepted = 0;
+    int64_t nDeadline = GetTimeMillis() + DEFAULT_CONNECT_TIMEOUT;
+    while (nAccepted < nPeers && GetTimeMillis() < nDeadline) {
+        for (size_t i = 0; i < nTotal; i++)
+            vPoll[i].revents = 0;
+        if (poll(&vPoll[0], vPoll.size(), 50) <= 0)
+            continue;
+        for (size_t i = 0; i < nTotal; i++) {
+            if (vPoll[i].fd < 0 || !vPoll[i].revents)
+                continue;
+            bool fWantWrite = false;
+            unsigned long err_code = 0;
+            int ret = tls.continueHandshake(vServerSSL[i], fWantWrite, err_code);
+            if (ret == 0) {
+                vPoll[i].events = fWantWrite ? POLLOUT : POLLIN;
+            } else {
+                // done or failed, either way this peer no longer holds up the others
+                vPoll[i].fd = -1;
+                if (ret == 1)
+                    nAccepted++;
+            }
+        }
+    }
+    double ret = timer_stop(tv_start);
+    clients.join_all();
+
+    for (size_t i = 0; i < nTotal; i++) {
+        if (i < nPeers)
+            SSL_free(vClientSSL[i]);
+        SSL_free(vServerSSL[i]);
+        CloseSocket(vServer[i]);
+        CloseSocket(vClient[i]);
+    }
+    if (nAccepted < nPeers)
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Only %d of %d TLS peers were accepted", nAccepted, nPeers));
+    return ret;
+}
+
 #ifdef ENABLE_MINING
 double benchmark_solve_equihash()
 {
@@ -222,6 +479,31 @@ double benchmark_verify_equihash()
     return timer_stop(tv_start);
 }
 
+double benchmark_verify_equihash_threaded(size_t nVerifications, int nThreads)
+{
+    // Every thread checks the genesis solution nVerifications times, as
+    // header sync does for every header; returns the seconds per check
+    // on one core.
+    CChainParams params = Params(CBaseChainParams::MAIN);
+    CBlockHeader genesis_header = params.GenesisBlock().GetBlockHeader();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    boost::thread_group threadGroup;
+    for (int t = 0; t < nThreads; t++) {
+        threadGroup.create_thread([&genesis_header, &params, nVerifications]() {
+            for (size_t i = 0; i < nVerifications; i++) {
+                assert(CheckEquihashSolution(&genesis_header, params));
+            }
+        });
+    }
+    threadGroup.join_all();
+    double elapsed = timer_stop(tv_start);
+
+    LogPrintf("%s: %.0f verifications per second per core\n", __func__, nVerifications / elapsed);
+    return elapsed / nVerifications;
+}
+
 double benchmark_large_tx()
 {
     // Number of inputs in the spending transaction that we will simulate
@@ -284,7 +566,7 @@ double benchmark_large_tx()
     return timer_stop(tv_start);
 }
 
-double benchmark_try_decrypt_notes(size_t nAddrs)
+double benchmark_try_decrypt_notes(size_t nAddrs, size_t nTxs, int nThreads)
 {
     CWallet wallet;
     for (int i = 0; i < nAddrs; i++) {
@@ -292,16 +574,32 @@ double benchmark_try_decrypt_notes(size_t nAddrs)
         wallet.AddSpendingKey(sk);
     }
 
+    // None of the notes belong to the wallet, so every address is tried
     auto sk = libzcash::SpendingKey::random();
-    auto tx = GetValidReceive(*pzcashParams, sk, 10, true);
+    std::vector<CTransaction> vtx;
+    for (size_t i = 0; i < nTxs; i++) {
+        vtx.push_back(GetValidReceive(*pzcashParams, sk, 10, true));
+    }
 
     struct timeval tv_start;
     timer_start(tv_start);
-    auto nd = wallet.FindMyNotes(tx);
+    auto vNoteData = wallet.FindMyNotes(vtx, nThreads);
     return timer_stop(tv_start);
 }
 
-double benchmark_increment_note_witnesses(size_t nTxs)
+// Only the note commitments matter when witnesses are incremented, so the
+// wallet is filled with copies of a single receive carrying fresh commitments
+// instead of building a JoinSplit for each of its transactions.
+static CWalletTx GetWitnessBenchmarkReceive(CMutableTransaction& mtx)
+{
+    mtx.vin[0].prevout.hash = GetRandHash();
+    for (uint256& cm : mtx.vjoinsplit[0].commitments) {
+        cm = GetRandHash();
+    }
+    return CWalletTx(NULL, CTransaction(mtx));
+}
+
+double benchmark_increment_note_witnesses(size_t nTxs, size_t nBlockTxs)
 {
     CWallet wallet;
     ZCIncrementalMerkleTree tree;
@@ -309,12 +607,15 @@ double benchmark_increment_note_witnesses(size_t nTxs)
     auto sk = libzcash::SpendingKey::random();
     wallet.AddSpendingKey(sk);
 
+    auto wtxTemplate = GetValidReceive(*pzcashParams, sk, 10, true);
+    auto note = GetNote(*pzcashParams, sk, wtxTemplate, 0, 1);
+    CMutableTransaction mtx(wtxTemplate);
+    auto nullifier = note.nullifier(sk);
+
     // First block
     CBlock block1;
-    for (int i = 0; i < nTxs; i++) {
-        auto wtx = GetValidReceive(*pzcashParams, sk, 10, true);
-        auto note = GetNote(*pzcashParams, sk, wtx, 0, 1);
-        auto nullifier = note.nullifier(sk);
+    for (size_t i = 0; i < nTxs; i++) {
+        auto wtx = GetWitnessBenchmarkReceive(mtx);
 
         mapNoteData_t noteData;
         JSOutPoint jsoutpt {wtx.GetHash(), 0, 1};
@@ -331,13 +632,12 @@ double benchmark_increment_note_witnesses(size_t nTxs)
     // Increment to get transactions witnessed
     wallet.ChainTip(&index1, &block1, tree, true);
 
-    // Second block
+    // Second block, with one transaction of ours and the rest of its
+    // commitments belonging to other wallets
     CBlock block2;
     block2.hashPrevBlock = block1.GetHash();
     {
-        auto wtx = GetValidReceive(*pzcashParams, sk, 10, true);
-        auto note = GetNote(*pzcashParams, sk, wtx, 0, 1);
-        auto nullifier = note.nullifier(sk);
+        auto wtx = GetWitnessBenchmarkReceive(mtx);
 
         mapNoteData_t noteData;
         JSOutPoint jsoutpt {wtx.GetHash(), 0, 1};
@@ -348,6 +648,9 @@ double benchmark_increment_note_witnesses(size_t nTxs)
         wallet.AddToWallet(wtx, true, NULL);
         block2.vtx.push_back(wtx);
     }
+    for (size_t i = 1; i < nBlockTxs; i++) {
+        block2.vtx.push_back(GetWitnessBenchmarkReceive(mtx));
+    }
     CBlockIndex index2(block2);
     index2.nHeight = 2;
 
@@ -467,11 +770,183 @@ double benchmark_loadwallet()
     return res;
 }
 
-double benchmark_listunspent()
+double benchmark_listunspent(size_t nTxs)
 {
-    UniValue params(UniValue::VARR);
+    if (nTxs == 0) {
+        UniValue params(UniValue::VARR);
+        struct timeval tv_start;
+        timer_start(tv_start);
+        auto unspent = listunspent(params, false);
+        return timer_stop(tv_start);
+    }
+
+    // Fill a scratch wallet with a chain of confirmed transactions, each
+    // spending the output of the previous one, so that only the last one
+    // holds an unspent output
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    assert(chainActive.Tip() != NULL);
+    uint256 hashPrev = GetRandHash();
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(hashPrev, 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = COIN;
+        mtx.vout[0].scriptPubKey = scriptPubKey;
+        CWalletTx wtx(&wallet, mtx);
+        wtx.hashBlock = chainActive.Tip()->GetBlockHash();
+        wtx.nIndex = 0;
+        wtx.fMerkleVerified = true;
+        wallet.AddToWallet(wtx, true, NULL);
+        hashPrev = wtx.GetHash();
+    }
+    wallet.MarkDirty();
+    wallet.GetBalance();
+
+    // What listunspent looks up in the wallet
+    std::vector<COutput> vecOutputs;
     struct timeval tv_start;
     timer_start(tv_start);
-    auto unspent = listunspent(params, false);
+    wallet.AvailableCoins(vecOutputs, false, NULL, true, true);
     return timer_stop(tv_start);
 }
+
+double benchmark_create_block_template(size_t nTxs, const std::string& strMode)
+{
+    LOCK2(cs_main, mempool.cs);
+
+    // Fund the transactions from a fake coin layered on top of the chain state
+    CMutableTransaction mtxFund;
+    mtxFund.vout.resize(nTxs);
+    for (size_t i = 0; i < nTxs; i++) {
+        mtxFund.vout[i].nValue = COIN;
+        mtxFund.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    CTransaction txFund(mtxFund);
+    CCoinsViewCache viewBench(pcoinsTip);
+    *viewBench.ModifyCoins(txFund.GetHash()) = CCoins(txFund, chainActive.Height());
+
+    // Fill the mempool with transactions of varying fee rate, every fourth
+    // one spending its predecessor so that the pool holds some packages
+    std::vector<CTransaction> vtx;
+    vtx.reserve(nTxs);
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        if (i % 4 == 3) {
+            mtx.vin[0].prevout = COutPoint(vtx.back().GetHash(), 0);
+        } else {
+            mtx.vin[0].prevout = COutPoint(txFund.GetHash(), i);
+        }
+        CAmount nValueIn = (i % 4 == 3) ? vtx.back().vout[0].nValue : COIN;
+        CAmount nFee = 1000 + (GetRand(100) * 100);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = nValueIn - nFee;
+        mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        vtx.push_back(CTransaction(mtx));
+        mempool.addUnchecked(vtx.back().GetHash(), CTxMemPoolEntry(vtx.back(), nFee, GetTime(), 0, chainActive.Height()), false);
+    }
+
+    // "package" times the default fee ordered assembly, "priority" the
+    // legacy one that is used when a priority area is configured
+    bool fHadPrioritySize = mapArgs.count("-blockprioritysize");
+    std::string strPrioritySize = GetArg("-blockprioritysize", "");
+    mapArgs["-blockprioritysize"] = (strMode == "priority") ? itostr(DEFAULT_BLOCK_PRIORITY_SIZE) : "0";
+    CCoinsViewCache* pcoinsSaved = pcoinsTip;
+    pcoinsTip = &viewBench;
+
+    // Time a template on an already seen mempool, as when a pool polls
+    // getblocktemplate between blocks
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    double duration = 0;
+    try {
+        delete CreateNewBlock(scriptPubKey);
+        struct timeval tv_start;
+        timer_start(tv_start);
+        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(scriptPubKey));
+        duration = timer_stop(tv_start);
+    } catch (...) {
+        duration = -1;
+    }
+
+    // Undo alterations to global state
+    pcoinsTip = pcoinsSaved;
+    if (fHadPrioritySize) {
+        mapArgs["-blockprioritysize"] = strPrioritySize;
+    } else {
+        mapArgs.erase("-blockprioritysize");
+    }
+    std::list<CTransaction> removed;
+    for (const CTransaction& tx : vtx) {
+        mempool.remove(tx, removed, true);
+    }
+
+    if (duration < 0) {
+        throw std::runtime_error("benchmark_create_block_template(): CreateNewBlock failed");
+    }
+    return duration;
+}
+
+double benchmark_getrawtransaction(size_t nLookups, const std::string& strMode)
+{
+    // Locate every transaction of the active chain, as the txindex would
+    std::vector<CDiskTxPos> vPos;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->nStatus & BLOCK_HAVE_DATA; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            throw std::runtime_error("benchmark_getrawtransaction(): ReadBlockFromDisk failed");
+        CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+        for (const CTransaction& tx : block.vtx) {
+            vPos.push_back(pos);
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+    }
+    if (vPos.empty())
+        throw std::runtime_error("benchmark_getrawtransaction(): no blocks on disk");
+
+    // "mmap" reads through the mapped block files, "file" opens them for every read
+    size_t nMaxMappings = blockFileMap.GetMaxMappings();
+    blockFileMap.SetMaxMappings(strMode == "file" ? 0 : std::max<size_t>(nMaxMappings, 1));
+
+    CTransaction tx;
+    uint256 hashBlock;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < nLookups; i++) {
+        assert(ReadTransactionFromDisk(tx, hashBlock, vPos[GetRand(vPos.size())]));
+    }
+    double duration = timer_stop(tv_start);
+
+    blockFileMap.SetMaxMappings(nMaxMappings);
+    return duration;
+}
+
+double benchmark_serve_blocks(size_t nBlocks, const std::string& strMode)
+{
+    if (chainActive.Height() < 1)
+        throw std::runtime_error("benchmark_serve_blocks(): no blocks to serve");
+
+    // "verify" checks the Equihash solution of every block read, as -checkblockreads does
+    bool fCheckBlockReadsSaved = fCheckBlockReads;
+    fCheckBlockReads = (strMode == "verify");
+
+    // Read random blocks and serialize them as for a getdata reply
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < nBlocks; i++) {
+        CBlock block;
+        assert(ReadBlockFromDisk(block, chainActive[1 + GetRand(chainActive.Height())]));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+    double duration = timer_stop(tv_start);
+
+    fCheckBlockReads = fCheckBlockReadsSaved;
+    return duration;
+}
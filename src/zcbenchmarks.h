@@ -6,18 +6,26 @@
 
 extern double benchmark_sleep();
 extern double benchmark_parameter_loading();
-extern double benchmark_create_joinsplit();
-extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads);
+extern double benchmark_create_joinsplit(bool makeGrothProof = true);
+extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads, bool makeGrothProof = true);
 extern double benchmark_solve_equihash();
 extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
+extern double benchmark_verify_block_joinsplits(size_t nJoinSplits, int nThreads);
+extern double benchmark_sigcache_lookup(size_t nSigs, int nThreads);
+extern double benchmark_socket_events(size_t nPeers, const std::string& strMode);
+extern double benchmark_tls_accept(size_t nPeers, size_t nSlowPeers);
 extern double benchmark_verify_equihash();
+extern double benchmark_verify_equihash_threaded(size_t nVerifications, int nThreads);
 extern double benchmark_large_tx();
-extern double benchmark_try_decrypt_notes(size_t nAddrs);
-extern double benchmark_increment_note_witnesses(size_t nTxs);
+extern double benchmark_try_decrypt_notes(size_t nAddrs, size_t nTxs, int nThreads);
+extern double benchmark_increment_note_witnesses(size_t nTxs, size_t nBlockTxs);
 extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
-extern double benchmark_listunspent();
+extern double benchmark_listunspent(size_t nTxs);
+extern double benchmark_create_block_template(size_t nTxs, const std::string& strMode);
+extern double benchmark_getrawtransaction(size_t nLookups, const std::string& strMode);
+extern double benchmark_serve_blocks(size_t nBlocks, const std::string& strMode);
 
 #endif
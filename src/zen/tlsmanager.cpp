@@ -89,7 +89,46 @@ DH *tmp_dh_callback(SSL *ssl, int is_export, int keylength)
     LogPrint("tls", "TLS: %s: %s():%d - Using Diffie-Hellman param for PFS: is_export=%d, keylength=%d\n",
         __FILE__, __func__, __LINE__, is_export, keylength);
 
-    return get_dh2048(); 
+    // OpenSSL does not take ownership of the returned params, so build them only once
+    static DH *dh2048 = get_dh2048();
+    return dh2048;
+}
+
+// Sessions of outbound peers keyed by peer address, so that reconnecting to a
+// known peer can resume instead of doing a full key exchange
+static std::map<std::string, SSL_SESSION*> mapClientSessions;
+static CCriticalSection cs_mapClientSessions;
+// ex_data slot holding the std::string key of an outbound ssl
+static int nPeerExIndex = -1;
+
+static void freePeerExData(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp)
+{
+    delete static_cast<std::string*>(ptr);
+}
+
+/** Called by OpenSSL whenever the server hands out a session (or a TLS 1.3 ticket) on an outbound connection */
+static int newClientSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    std::string* pstrPeer = static_cast<std::string*>(SSL_get_ex_data(ssl, nPeerExIndex));
+    if (pstrPeer == NULL || !SSL_SESSION_is_resumable(session))
+        return 0;
+
+    LOCK(cs_mapClientSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapClientSessions.find(*pstrPeer);
+    if (it != mapClientSessions.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+    } else {
+        if (mapClientSessions.size() >= TLSManager::MAX_CLIENT_SESSIONS) {
+            // evict an arbitrary peer rather than tracking recency
+            it = mapClientSessions.begin();
+            SSL_SESSION_free(it->second);
+            mapClientSessions.erase(it);
+        }
+        mapClientSessions.insert(std::make_pair(*pstrPeer, session));
+    }
+    // we keep the reference
+    return 1;
 }
 
 /** if 'tls' debug category is enabled, collect info about certificates relevant to the passed context and print them on logs */
@@ -286,14 +325,8 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
             break;
         }
 
-        fd_set socketSet;
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
-        struct timeval timeout = {timeoutSec, 0};
-
         if (sslErr == SSL_ERROR_WANT_READ) {
-            int result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            int result = WaitForSocket(hSocket, false, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_READ timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" : 
@@ -308,7 +341,7 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
                 break;
             }
         } else {
-            int result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            int result = WaitForSocket(hSocket, true, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_WRITE timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" : 
@@ -329,52 +362,109 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
 }
 
 /**
- * @brief establish TLS connection to an address
+ * @brief Create the ssl object for a non-blocking TLS handshake.
+ * 
+ * Nothing is sent or received here: the handshake is driven by
+ * continueHandshake() from the socket handler thread whenever the socket
+ * becomes ready, so a slow peer only delays its own connection.
  * 
- * @param hSocket socket
- * @param addrConnect the outgoing address
- * @param tls_ctx_client TLS Client context
+ * @param hSocket the non-blocking TCP socket.
+ * @param ctxType SERVER_CONTEXT for inbound connections, CLIENT_CONTEXT for outbound ones.
  * @return SSL* returns a ssl* if successful, otherwise returns NULL.
  */
-SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code)
+SSL* TLSManager::startHandshake(SOCKET hSocket, TLSContextType ctxType, unsigned long& err_code)
 {
-    LogPrint("tls", "TLS: establishing connection (tid = %X), (peerid = %s)\n", pthread_self(), addrConnect.ToString());
-
     err_code = 0;
-    SSL* ssl = NULL;
-    bool bConnectedTLS = false;
+    SSL* ssl = SSL_new(ctxType == SERVER_CONTEXT ? tls_ctx_server : tls_ctx_client);
 
-    if ((ssl = SSL_new(tls_ctx_client))) {
-        if (SSL_set_fd(ssl, hSocket)) {
-            int ret = TLSManager::waitFor(SSL_CONNECT, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000), err_code);
-            if (ret == 1)
-            {
-                bConnectedTLS = true;
-            }
-        }
-    }
-    else
-    {
+    if (!ssl) {
         err_code = ERR_get_error();
         const char* error_str = ERR_error_string(err_code, NULL);
         LogPrint("tls", "TLS: %s: %s():%d - SSL_new failed err: %s\n",
             __FILE__, __func__, __LINE__, error_str);
+        return NULL;
+    }
+
+    if (!SSL_set_fd(ssl, hSocket)) {
+        err_code = ERR_get_error();
+        LogPrint("tls", "TLS: %s: %s():%d - SSL_set_fd failed err: %s\n",
+            __FILE__, __func__, __LINE__, ERR_error_string(err_code, NULL));
+        SSL_free(ssl);
+        return NULL;
     }
 
+    if (ctxType == SERVER_CONTEXT)
+        SSL_set_accept_state(ssl);
+    else
+        SSL_set_connect_state(ssl);
 
-    if (bConnectedTLS) {
-        LogPrintf("TLS: connection to %s has been established (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
-            addrConnect.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
-    } else {
-        LogPrintf("TLS: %s: %s():%d - TLS connection to %s failed (err_code 0x%X)\n",
-            __FILE__, __func__, __LINE__, addrConnect.ToString(), err_code);
+    return ssl;
+}
 
-        if (ssl) {
-            SSL_free(ssl);
-            ssl = NULL;
-        }
+/**
+ * @brief Offer the last session of an outbound peer for resumption, and remember the peer for new sessions.
+ * 
+ * @param ssl pointer to an SSL instance created by startHandshake() with CLIENT_CONTEXT.
+ * @param strPeer the peer address the sessions are keyed by.
+ */
+void TLSManager::setClientSession(SSL* ssl, const std::string& strPeer)
+{
+    SSL_set_ex_data(ssl, nPeerExIndex, new std::string(strPeer));
+
+    LOCK(cs_mapClientSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapClientSessions.find(strPeer);
+    if (it != mapClientSessions.end())
+        SSL_set_session(ssl, it->second);
+}
+
+/**
+ * @brief Drop the cached session of an outbound peer, e.g. after a failed handshake.
+ * 
+ * @param strPeer the peer address the sessions are keyed by.
+ */
+void TLSManager::forgetClientSession(const std::string& strPeer)
+{
+    LOCK(cs_mapClientSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapClientSessions.find(strPeer);
+    if (it != mapClientSessions.end()) {
+        SSL_SESSION_free(it->second);
+        mapClientSessions.erase(it);
     }
-    return ssl;
+}
+
+/**
+ * @brief Advance a handshake started by startHandshake() as far as the socket allows without blocking.
+ * 
+ * @param ssl pointer to an SSL instance.
+ * @param fWantWrite set when the handshake is waiting for the socket to become writable rather than readable.
+ * @return int returns 1 when the handshake has completed, 0 when it has to wait for the socket and -1 on failure.
+ */
+int TLSManager::continueHandshake(SSL* ssl, bool& fWantWrite, unsigned long& err_code)
+{
+    err_code = 0;
+    fWantWrite = false;
+
+    // clear the current thread's error queue
+    ERR_clear_error();
+
+    int retOp = SSL_do_handshake(ssl);
+    if (retOp == 1)
+        return 1;
+
+    int sslErr = SSL_get_error(ssl, retOp);
+    if (sslErr == SSL_ERROR_WANT_READ)
+        return 0;
+    if (sslErr == SSL_ERROR_WANT_WRITE) {
+        fWantWrite = true;
+        return 0;
+    }
+
+    err_code = ERR_get_error();
+    const char* error_str = ERR_error_string(err_code, NULL);
+    LogPrint("tls", "TLS: WARNING: %s: %s():%d - handshake failed, sslErr[0x%x], retOp[%d], errno[0x%x], lib[0x%x], reas[0x%x]-> err: %s\n",
+        __FILE__, __func__, __LINE__,
+        sslErr, retOp, errno, ERR_GET_LIB(err_code), ERR_GET_REASON(err_code), error_str);
+    return -1;
 }
 /**
  * @brief Initialize TLS Context
@@ -426,6 +516,16 @@ SSL_CTX* TLSManager::initCtx(
         // TLS 1.3 has ephemeral Diffie-Hellman as the only key exchange mechanism, so that perfect forward
         // secrecy is ensured.
 
+        // prefer the cheapest curves for ECDHE; finite field DHE is only used with peers offering no ECDHE at all
+        if (SSL_CTX_set1_groups_list(tlsCtx, "X25519:P-256:P-384") == 0) {
+            LogPrintf("TLS: WARNING: %s: %s():%d - failed to set the ECDHE groups\n", __FILE__, __func__, __LINE__);
+        }
+
+        // Resumed sessions skip the key exchange and certificate verification when
+        // connections to the same peers churn. Sessions keep the peer certificate,
+        // so ValidatePeerCertificate() still works on a resumed connection.
+        SSL_CTX_set_timeout(tlsCtx, TLS_SESSION_TIMEOUT);
+
         if (ctxType == SERVER_CONTEXT)
         {
             // amongst the Cl/Srv mutually-acceptable set, pick the one that the server prefers most instead of the one that
@@ -434,6 +534,18 @@ SSL_CTX* TLSManager::initCtx(
 
             LogPrintf("TLS: %s: %s():%d - setting dh callback\n", __FILE__, __func__, __LINE__);
             SSL_CTX_set_tmp_dh_callback(tlsCtx, tmp_dh_callback);
+
+            // server side cache for TLS 1.2 session ids; tickets are on by default
+            static const unsigned char sid_ctx[] = "zend";
+            SSL_CTX_set_session_id_context(tlsCtx, sid_ctx, sizeof(sid_ctx) - 1);
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(tlsCtx, TLS_SERVER_SESSION_CACHE_SIZE);
+        }
+        else
+        {
+            // sessions are stored per peer address by newClientSessionCallback
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(tlsCtx, newClientSessionCallback);
         }
 
         // Fix for Secure Client-Initiated Renegotiation DoS threat
@@ -519,60 +631,6 @@ bool TLSManager::prepareCredentials()
 
     return bPrepared;
 }
-/**
- * @brief accept a TLS connection
- * 
- * @param hSocket the TLS socket.
- * @param addr incoming address.
- * @param tls_ctx_server TLS server context.
- * @return SSL* returns pointer to the ssl object if successful, otherwise returns NULL
- */
-SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code)
-{
-    LogPrint("tls", "TLS: accepting connection from %s (tid = %X)\n", addr.ToString(), pthread_self());
-
-    err_code = 0; 
-    SSL* ssl = NULL;
-    bool bAcceptedTLS = false;
-
-    if ((ssl = SSL_new(tls_ctx_server))) {
-        if (SSL_set_fd(ssl, hSocket)) {
-            int ret = TLSManager::waitFor(SSL_ACCEPT, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000), err_code);
-            if (ret == 1)
-            {
-                bAcceptedTLS = true;
-            }
-        }
-    }
-    else
-    {
-        err_code = ERR_get_error();
-        const char* error_str = ERR_error_string(err_code, NULL);
-        LogPrint("tls", "TLS: %s: %s():%d - SSL_new failed err: %s\n",
-            __FILE__, __func__, __LINE__, error_str);
-    }
-
-    if (bAcceptedTLS) {
-        LogPrintf("TLS: connection from %s has been accepted (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
-            addr.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
-
-        STACK_OF(SSL_CIPHER) *sk = SSL_get_ciphers(ssl); 
-        for (int i = 0; i < sk_SSL_CIPHER_num(sk); i++) {
-            const SSL_CIPHER *c = sk_SSL_CIPHER_value(sk, i);
-            LogPrint("tls", "TLS: supporting cipher: %s\n", SSL_CIPHER_get_name(c));
-        }
-    } else {
-        LogPrintf("TLS: %s: %s():%d - TLS connection from %s failed (err_code 0x%X)\n",
-            __FILE__, __func__, __LINE__, addr.ToString(), err_code);
-
-        if (ssl) {
-            SSL_free(ssl);
-            ssl = NULL;
-        }
-    }
-
-    return ssl;
-}
 /**
  * @brief Determines whether a string exists in the non-TLS address pool.
  * 
@@ -619,31 +677,28 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
 /**
  * @brief Handles send and recieve functionality in TLS Sockets.
  * 
+ * Clears pnode->fSocketRecvReady / fSocketSendReady once a read or write
+ * would block, so that edge-triggered readiness is only consumed when the
+ * socket has actually been drained.
+ *
  * @param pnode reference to the CNode object.
- * @param fdsetRecv 
- * @param fdsetSend 
- * @param fdsetError 
+ * @param recvSet the socket is readable or has a pending error
+ * @param sendSet the socket is writable
  * @return int returns -1 when socket is invalid. returns 0 otherwise.
  */
-int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError)
+int TLSManager::threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet)
 {
     //
     // Receive
     //
-    bool recvSet = false, sendSet = false, errorSet = false;
-
     {
         LOCK(pnode->cs_hSocket);
 
         if (pnode->hSocket == INVALID_SOCKET)
             return -1;
-
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
     }
 
-    if (recvSet || errorSet) {
+    if (recvSet) {
         TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
         if (lockRecv) {
             {
@@ -709,6 +764,8 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                             LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read - code[0x%x], err: %s\n",
                                 __FILE__, __func__, __LINE__, nRet, error_str);
 
+                        } else if (nRet == SSL_ERROR_WANT_READ) {
+                            pnode->fSocketRecvReady = false;
                         } else {
                             // preventive measure from exhausting CPU usage
                             //
@@ -719,6 +776,8 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                             if (!pnode->fDisconnect)
                                 LogPrintf("TSL: ERROR: socket recv %s\n", NetworkErrorString(nRet));
                             pnode->CloseSocketDisconnect();
+                        } else if (nRet == WSAEWOULDBLOCK) {
+                            pnode->fSocketRecvReady = false;
                         }
                     }
                 }
@@ -731,8 +790,12 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
     //
     if (sendSet) {
         TRY_LOCK(pnode->cs_vSend, lockSend);
-        if (lockSend)
+        if (lockSend) {
             SocketSendData(pnode);
+            // whatever is left over did not fit in the socket buffer
+            if (!pnode->vSendMsg.empty())
+                pnode->fSocketSendReady = false;
+        }
     }
     return 0;
 }
@@ -751,6 +814,9 @@ bool TLSManager::initialize()
     SSL_load_error_strings();
     ERR_load_crypto_strings();
     OpenSSL_add_ssl_algorithms(); // OpenSSL_add_ssl_algorithms() always returns "1", so it is safe to discard the return value.
+
+    if (nPeerExIndex == -1)
+        nPeerExIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freePeerExData);
     
     namespace fs = boost::filesystem;
     fs::path certFile = GetArg("-tlscertpath", "");
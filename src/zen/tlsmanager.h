@@ -43,9 +43,19 @@ public:
         function code and reason code. */
      static const long SELECT_TIMEDOUT = 0xFFFFFFFF;
 
+     /* Number of outbound peers whose last session is kept for resumption */
+     static const size_t MAX_CLIENT_SESSIONS = 1000;
+     /* Sessions the server side keeps for TLS 1.2 session id resumption */
+     static const long TLS_SERVER_SESSION_CACHE_SIZE = 20000;
+     /* Lifetime of a session, in seconds */
+     static const long TLS_SESSION_TIMEOUT = 2 * 60 * 60;
+
      int waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl, int timeoutSec, unsigned long& err_code);
 
-     SSL* connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code);
+     SSL* startHandshake(SOCKET hSocket, TLSContextType ctxType, unsigned long& err_code);
+     int continueHandshake(SSL* ssl, bool& fWantWrite, unsigned long& err_code);
+     void setClientSession(SSL* ssl, const std::string& strPeer);
+     void forgetClientSession(const std::string& strPeer);
      SSL_CTX* initCtx(
         TLSContextType ctxType,
         const boost::filesystem::path& privateKeyFile,
@@ -53,10 +63,9 @@ public:
         const std::vector<boost::filesystem::path>& trustedDirs);
 
      bool prepareCredentials();
-     SSL* accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code);
      bool isNonTLSAddr(const string& strAddr, const vector<NODE_ADDR>& vPool, CCriticalSection& cs);
      void cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection& cs);
-     int threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError);
+     int threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet);
      bool initialize();
 };
 }